@@ -29,6 +29,14 @@
 
 void protect_allocations(SCTX_ struct allocator_struct *desc)
 {
+	struct allocation_blob *blob = desc->blobs;
+
+	if (!blob)
+		return;
+	while (blob->next)
+		blob = blob->next;
+	blob->next = desc->protected;
+	desc->protected = desc->blobs;
 	desc->blobs = NULL;
 }
 
@@ -48,6 +56,94 @@ void drop_all_allocations(SCTX_ struct allocator_struct *desc)
 	}
 }
 
+/*
+ * Give back every blob, protected ones included and regardless of
+ * nofree: only for tearing down a whole context.
+ */
+void destroy_allocations(SCTX_ struct allocator_struct *desc)
+{
+	struct allocation_blob *blob = desc->protected;
+
+	desc->protected = NULL;
+	while (blob) {
+		struct allocation_blob *next = blob->next;
+		blob_free(sctx_ blob, desc->chunking);
+		blob = next;
+	}
+	drop_all_allocations(sctx_ desc);
+}
+
+void for_each_blob(SCTX_ struct allocator_struct *desc,
+		   void (*fn)(SCTX_ struct allocator_struct *, struct allocation_blob *, void *),
+		   void *data)
+{
+	struct allocation_blob *blob;
+
+	for (blob = desc->blobs; blob; blob = blob->next)
+		fn(sctx_ desc, blob, data);
+	for (blob = desc->protected; blob; blob = blob->next)
+		fn(sctx_ desc, blob, data);
+}
+
+static int ptr_cmp(const void *a, const void *b)
+{
+	const char *x = *(void * const *)a, *y = *(void * const *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Every live object of a fixed size allocator, oldest first: what is
+ * on the freelist is skipped.
+ */
+void for_each_allocation(SCTX_ struct allocator_struct *desc, unsigned int size,
+			 void (*fn)(SCTX_ void *, void *), void *data)
+{
+	unsigned long alignment = desc->alignment;
+	unsigned long start = offsetof(struct allocation_blob, data);
+	struct allocation_blob *blob, **all;
+	void **freed = NULL, **p;
+	int nr = 0, nr_freed = 0, i;
+
+	for (blob = desc->blobs; blob; blob = blob->next)
+		nr++;
+	for (blob = desc->protected; blob; blob = blob->next)
+		nr++;
+	if (!nr)
+		return;
+	all = malloc(nr * sizeof(*all));
+	nr = 0;
+	for (blob = desc->blobs; blob; blob = blob->next)
+		all[nr++] = blob;
+	for (blob = desc->protected; blob; blob = blob->next)
+		all[nr++] = blob;
+
+	for (p = desc->freelist; p; p = *p)
+		nr_freed++;
+	if (nr_freed) {
+		freed = malloc(nr_freed * sizeof(*freed));
+		nr_freed = 0;
+		for (p = desc->freelist; p; p = *p)
+			freed[nr_freed++] = p;
+		qsort(freed, nr_freed, sizeof(*freed), ptr_cmp);
+	}
+
+	size = (size + alignment - 1) & ~(alignment-1);
+	start = ((start + alignment - 1) & ~(alignment-1)) - start;
+	for (i = nr - 1; i >= 0; i--) {
+		unsigned long o;
+		for (o = start; o + size <= all[i]->offset; o += size) {
+			void *entry = all[i]->data + o;
+
+			if (nr_freed && bsearch(&entry, freed, nr_freed, sizeof(*freed), ptr_cmp))
+				continue;
+			fn(sctx_ entry, data);
+		}
+	}
+	free(freed);
+	free(all);
+}
+
 void free_one_entry(SCTX_ struct allocator_struct *desc, void *entry)
 {
 	void **p = entry;
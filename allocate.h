@@ -7,6 +7,12 @@
 
 extern void protect_allocations(SCTX_ struct allocator_struct *desc);
 extern void drop_all_allocations(SCTX_ struct allocator_struct *desc);
+extern void destroy_allocations(SCTX_ struct allocator_struct *desc);
+extern void for_each_blob(SCTX_ struct allocator_struct *desc,
+			  void (*fn)(SCTX_ struct allocator_struct *, struct allocation_blob *, void *),
+			  void *data);
+extern void for_each_allocation(SCTX_ struct allocator_struct *desc, unsigned int size,
+				void (*fn)(SCTX_ void *, void *), void *data);
 extern void *allocate(SCTX_ struct allocator_struct *desc, unsigned int size);
 extern void free_one_entry(SCTX_ struct allocator_struct *desc, void *entry);
 extern void show_allocations(SCTX_ struct allocator_struct *);
@@ -12,6 +12,7 @@ struct allocation_blob {
 struct allocator_struct {
 	const char *name;
 	struct allocation_blob *blobs;
+	struct allocation_blob *protected;	/* kept by protect_allocations() */
 	unsigned int alignment;
 	unsigned int chunking;
 	void *freelist;
@@ -0,0 +1,248 @@
+/*
+ * astdump - write the parse of a translation unit as a binary dump,
+ * or show what a dump holds.
+ *
+ *	astdump -o out.dump [sparse options] file.c
+ *	astdump -r out.dump
+ *
+ * Licensed under the Open Software License version 1.1
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib.h"
+#include "allocate.h"
+#include "token.h"
+#include "parse.h"
+#include "symbol.h"
+#include "expression.h"
+#include "serialize.h"
+
+static const char *sym_types[] = {
+	"uninitialized", "preprocessor", "basetype", "node", "ptr", "fn",
+	"array", "struct", "union", "enum", "typedef", "typeof", "member",
+	"bitfield", "label", "restrict", "fouled", "keyword", "bad",
+};
+
+static const char *stmt_types[] = {
+	"none", "declaration", "expression", "compound", "if", "return",
+	"case", "switch", "iterator", "label", "goto", "asm", "context",
+	"range",
+};
+
+static const char *expr_types[] = {
+	"", "value", "string", "symbol", "type", "binop", "assignment",
+	"logical", "deref", "preop", "postop", "cast", "force_cast",
+	"implied_cast", "sizeof", "alignof", "ptrsizeof", "conditional",
+	"select", "statement", "call", "comma", "compare", "label",
+	"initializer", "identifier", "index", "pos", "fvalue", "slice",
+	"offsetof",
+};
+
+#define NAME(table, i) ((i) < ARRAY_SIZE(table) ? table[i] : "?")
+
+static void show_pos(const struct ast_dump *dump, uint32_t tok)
+{
+	const struct dump_token *t = dump->tokens + tok;
+
+	if (tok)
+		printf(" %u:%u", t->line, t->col);
+}
+
+static void show_stmt(const struct ast_dump *dump, uint32_t s, int indent);
+
+static void show_expr(const struct ast_dump *dump, uint32_t e, int indent)
+{
+	const struct dump_expression *expr = dump->expressions + e;
+	const uint32_t *list;
+	uint32_t nr, i;
+
+	if (!e)
+		return;
+	printf("%*s%s", indent, "", NAME(expr_types, expr->type));
+	if (expr->op > ' ' && expr->op < 127)
+		printf(" '%c'", expr->op);
+	switch (expr->type) {
+	case EXPR_VALUE:
+		printf(" %llu", (unsigned long long)expr->value);
+		break;
+	case EXPR_SYMBOL:
+		printf(" %s", dump_string(dump, expr->b));
+		break;
+	case EXPR_STRING:
+		printf(" \"%s\"", dump_string(dump, expr->a));
+		break;
+	case EXPR_DEREF:
+		printf(" .%s", dump_string(dump, expr->b));
+		break;
+	}
+	printf("\n");
+
+	switch (expr->type) {
+	case EXPR_BINOP: case EXPR_COMMA: case EXPR_COMPARE:
+	case EXPR_LOGICAL: case EXPR_ASSIGNMENT:
+		show_expr(dump, expr->a, indent + 2);
+		show_expr(dump, expr->b, indent + 2);
+		break;
+	case EXPR_PREOP: case EXPR_POSTOP: case EXPR_DEREF:
+		show_expr(dump, expr->a, indent + 2);
+		break;
+	case EXPR_CAST: case EXPR_FORCE_CAST: case EXPR_IMPLIED_CAST:
+	case EXPR_SIZEOF: case EXPR_ALIGNOF: case EXPR_PTRSIZEOF:
+		show_expr(dump, expr->b, indent + 2);
+		break;
+	case EXPR_CONDITIONAL: case EXPR_SELECT:
+		show_expr(dump, expr->a, indent + 2);
+		show_expr(dump, expr->b, indent + 2);
+		show_expr(dump, expr->c, indent + 2);
+		break;
+	case EXPR_STATEMENT:
+		show_stmt(dump, expr->a, indent + 2);
+		break;
+	case EXPR_CALL:
+		show_expr(dump, expr->a, indent + 2);
+		/* fall through */
+	case EXPR_INITIALIZER:
+		list = dump_list(dump, expr->list, &nr);
+		for (i = 0; i < nr; i++)
+			show_expr(dump, list[i], indent + 2);
+		break;
+	}
+}
+
+static void show_stmt(const struct ast_dump *dump, uint32_t s, int indent)
+{
+	const struct dump_statement *stmt = dump->statements + s;
+	const uint32_t *list;
+	uint32_t nr, i;
+
+	if (!s)
+		return;
+	printf("%*s%s", indent, "", NAME(stmt_types, stmt->type));
+	show_pos(dump, stmt->pos);
+	printf("\n");
+	switch (stmt->type) {
+	case STMT_DECLARATION:
+		list = dump_list(dump, stmt->list, &nr);
+		for (i = 0; i < nr; i++) {
+			const struct dump_symbol *sym = dump->symbols + list[i];
+			printf("%*s%s\n", indent + 2, "", dump_string(dump, sym->ident));
+			show_expr(dump, sym->initializer, indent + 4);
+		}
+		break;
+	case STMT_EXPRESSION: case STMT_CONTEXT: case STMT_RETURN:
+		show_expr(dump, stmt->a, indent + 2);
+		break;
+	case STMT_COMPOUND:
+		list = dump_list(dump, stmt->list, &nr);
+		for (i = 0; i < nr; i++)
+			show_stmt(dump, list[i], indent + 2);
+		break;
+	case STMT_IF:
+		show_expr(dump, stmt->a, indent + 2);
+		show_stmt(dump, stmt->b, indent + 2);
+		show_stmt(dump, stmt->c, indent + 2);
+		break;
+	case STMT_ITERATOR:
+		show_stmt(dump, stmt->a, indent + 2);
+		show_expr(dump, stmt->b, indent + 2);
+		show_stmt(dump, stmt->c, indent + 2);
+		show_stmt(dump, stmt->d, indent + 2);
+		show_expr(dump, stmt->e, indent + 2);
+		break;
+	case STMT_SWITCH:
+		show_expr(dump, stmt->a, indent + 2);
+		show_stmt(dump, stmt->b, indent + 2);
+		break;
+	case STMT_CASE:
+		show_expr(dump, stmt->a, indent + 2);
+		show_stmt(dump, stmt->c, indent + 2);
+		break;
+	case STMT_LABEL:
+		show_stmt(dump, stmt->b, indent + 2);
+		break;
+	}
+}
+
+static int show_dump(const char *name)
+{
+	struct ast_dump *dump = open_ast_dump(name);
+	const struct dump_header *h;
+	const uint32_t *list;
+	uint32_t nr, i;
+
+	if (!dump) {
+		fprintf(stderr, "%s: not a readable dump\n", name);
+		return 1;
+	}
+	h = dump->header;
+
+	/* macros expanded in the source, with the invocation */
+	for (i = 1; i < dump_count(dump, DUMP_EXPANSIONS); i++) {
+		const struct dump_expansion *e = dump->expansions + i;
+		const struct dump_token *t = dump->tokens + e->tok;
+		if (e->typ != EXPANSION_MACRO || !e->sym || !e->tok ||
+		    *dump_string(dump, dump->streams[t->stream].name) == '<')
+			continue;
+		printf("macro %s", dump_string(dump, dump->symbols[e->sym].ident));
+		show_pos(dump, e->tok);
+		printf("\n");
+	}
+
+	list = dump_list(dump, h->symbols, &nr);
+	for (i = 0; i < nr; i++) {
+		const struct dump_symbol *sym = dump->symbols + list[i];
+		const struct dump_symbol *base = dump->symbols + sym->base;
+
+		printf("%s %s", NAME(sym_types, sym->type), dump_string(dump, sym->ident));
+		show_pos(dump, sym->pos);
+		if (sym->base)
+			printf(" %s", NAME(sym_types, base->type));
+		printf("\n");
+		show_expr(dump, sym->initializer, 2);
+		if (sym->base && base->type == SYM_FN)
+			show_stmt(dump, base->stmt, 2);
+	}
+	close_ast_dump(dump);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct string_list *filelist = NULL;
+	struct symbol_list *all = NULL;
+	const char *out = NULL, *in = NULL;
+	char *file;
+	int i, j, ret = 0;
+	SPARSE_CTX_INIT;
+
+	for (i = j = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			out = argv[++i];
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			in = argv[++i];
+		else
+			argv[j++] = argv[i];
+	}
+	argv[j] = NULL;
+	argc = j;
+
+	if (out) {
+		FILE *f;
+
+		sparse_initialize(sctx_ argc, argv, &filelist);
+		FOR_EACH_PTR_NOTAG(filelist, file) {
+			concat_symbol_list(sctx_ sparse(sctx_ file), &all);
+		} END_FOR_EACH_PTR_NOTAG(file);
+
+		f = fopen(out, "wb");
+		if (!f || write_ast_dump(sctx_ f, all) || fclose(f)) {
+			fprintf(stderr, "%s: can't write the dump\n", out);
+			return 1;
+		}
+	}
+	if (in)
+		ret = show_dump(in);
+	return ret;
+}
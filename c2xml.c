@@ -1,7 +1,8 @@
 /*
  * Sparse c2xml
  *
- * Dumps the parse tree as an xml document
+ * Dumps the parse tree as an xml document, or with --json as one
+ * JSON object per line and top level symbol
  *
  * Copyright (C) 2007 Rob Taylor
  *
@@ -13,8 +14,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <assert.h>
-#include <libxml/parser.h>
-#include <libxml/tree.h>
+#include <libxml/xmlwriter.h>
 
 #include "expression.h"
 #include "parse.h"
@@ -22,67 +22,188 @@
 #include "symbol.h"
 #include "token.h"
 
-static xmlDocPtr doc = NULL;       /* document pointer */
-static xmlNodePtr root_node = NULL;/* root node pointer */
+/*
+ * Symbols are written out as soon as a top level one has been examined:
+ * examining assigns the ids and records which symbols nest under which,
+ * then the nodes are emitted and freed. Nothing but the id in sym->aux
+ * outlives a top level symbol.
+ */
+struct sym_node {
+	struct symbol *sym;
+	const char *type;
+	int id;
+	unsigned long modifiers;	/* as they were before examining */
+	struct sym_node *children, **tail, *next;
+};
+
+struct output {
+	void (*begin)(void);
+	void (*start)(int first);
+	void (*prop)(const char *name, const char *value);
+	void (*num)(const char *name, int value);
+	void (*start_children)(void);
+	void (*end_children)(void);
+	void (*end)(void);
+	void (*finish)(void);
+};
+
+static struct sym_node *roots, **roots_tail = &roots;
 static int idcount = 0;
+static const struct output *out;
+
+#define sym_id(sym)	((int)(long)(sym)->aux - 1)
 
-static void examine_symbol(SCTX_ struct symbol *sym, xmlNodePtr node);
+static xmlTextWriterPtr writer;
 
-static xmlAttrPtr newProp(SCTX_ xmlNodePtr node, const char *name, const char *value)
+static void xml_begin(void)
 {
-	return xmlNewProp(node, BAD_CAST name, BAD_CAST value);
+	writer = xmlNewTextWriter(xmlOutputBufferCreateFile(stdout, NULL));
+	xmlTextWriterSetIndent(writer, 1);
+	xmlTextWriterSetIndentString(writer, BAD_CAST "  ");
+	xmlTextWriterStartDocument(writer, NULL, "UTF-8", NULL);
+	xmlTextWriterStartElement(writer, BAD_CAST "parse");
 }
 
-static xmlAttrPtr newNumProp(SCTX_ xmlNodePtr node, const char *name, int value)
+static void xml_start(int first)
 {
-	char buf[256];
-	snprintf(buf, 256, "%d", value);
-	return newProp(sctx_ node, name, buf);
+	xmlTextWriterStartElement(writer, BAD_CAST "symbol");
 }
 
-static xmlAttrPtr newIdProp(SCTX_ xmlNodePtr node, const char *name, unsigned int id)
+static void xml_prop(const char *name, const char *value)
 {
-	char buf[256];
-	snprintf(buf, 256, "_%d", id);
-	return newProp(sctx_ node, name, buf);
+	xmlTextWriterWriteAttribute(writer, BAD_CAST name, BAD_CAST value);
 }
 
-static xmlNodePtr new_sym_node(SCTX_ struct symbol *sym, const char *name, xmlNodePtr parent)
+static void xml_num(const char *name, int value)
 {
-	xmlNodePtr node;
-	const char *ident = show_ident(sctx_ sym->ident);
+	xmlTextWriterWriteFormatAttribute(writer, BAD_CAST name, "%d", value);
+}
 
-	assert(name != NULL);
-	assert(sym != NULL);
-	assert(parent != NULL);
+static void xml_nop(void)
+{
+}
 
-	node = xmlNewChild(parent, NULL, BAD_CAST "symbol", NULL);
+static void xml_end(void)
+{
+	xmlTextWriterEndElement(writer);
+}
 
-	newProp(sctx_ node, "type", name);
+static void xml_finish(void)
+{
+	xmlTextWriterEndDocument(writer);
+	xmlFreeTextWriter(writer);
+}
 
-	newIdProp(sctx_ node, "id", idcount);
+static const struct output xml_output = {
+	xml_begin, xml_start, xml_prop, xml_num,
+	xml_nop, xml_nop, xml_end, xml_finish,
+};
 
-	if (sym->ident && ident)
-		newProp(sctx_ node, "ident", ident);
-	newProp(sctx_ node, "file", stream_name(sctx_ sym->pos->pos.stream));
+/* one object per top level symbol and line, members nest under "symbols" */
+static int json_depth, json_props;
 
-	newNumProp(sctx_ node, "start-line", sym->pos->pos.line);
-	newNumProp(sctx_ node, "start-col", sym->pos->pos.pos);
+static void json_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
 
-	if (sym->endpos) {
-		newNumProp(sctx_ node, "end-line", sym->endpos->pos.line);
-		newNumProp(sctx_ node, "end-col", sym->endpos->pos.pos);
-		if (sym->pos->pos.stream != sym->endpos->pos.stream)
-			newProp(sctx_ node, "end-file", stream_name(sctx_ sym->endpos->pos.stream));
-        }
-	sym->aux = node;
+static void json_nop(void)
+{
+}
+
+static void json_start(int first)
+{
+	if (!first)
+		putchar(',');
+	putchar('{');
+	json_depth++;
+	json_props = 0;
+}
+
+static void json_name(const char *name)
+{
+	if (json_props++)
+		putchar(',');
+	json_string(name);
+	putchar(':');
+}
+
+static void json_prop(const char *name, const char *value)
+{
+	json_name(name);
+	json_string(value);
+}
+
+static void json_num(const char *name, int value)
+{
+	json_name(name);
+	printf("%d", value);
+}
+
+static void json_start_children(void)
+{
+	json_name("symbols");
+	putchar('[');
+}
+
+static void json_end_children(void)
+{
+	putchar(']');
+}
+
+static void json_end(void)
+{
+	putchar('}');
+	if (!--json_depth)
+		putchar('\n');
+}
+
+static const struct output json_output = {
+	json_nop, json_start, json_prop, json_num,
+	json_start_children, json_end_children, json_end, json_nop,
+};
+
+static void examine_symbol(SCTX_ struct symbol *sym, struct sym_node *parent);
 
-	idcount++;
+static struct sym_node *new_sym_node(SCTX_ struct symbol *sym, const char *name, struct sym_node *parent)
+{
+	struct sym_node *node;
+
+	assert(name != NULL);
+	assert(sym != NULL);
+
+	node = calloc(1, sizeof(*node));
+	if (!node)
+		sparse_die(sctx_ "out of memory");
+	node->sym = sym;
+	node->type = name;
+	node->id = idcount++;
+	node->modifiers = sym->ctype.modifiers;
+	node->tail = &node->children;
+
+	if (parent) {
+		*parent->tail = node;
+		parent->tail = &node->next;
+	} else {
+		*roots_tail = node;
+		roots_tail = &node->next;
+	}
+	sym->aux = (void *)(long)(node->id + 1);
 
 	return node;
 }
 
-static inline void examine_members(SCTX_ struct symbol_list *list, xmlNodePtr node)
+static inline void examine_members(SCTX_ struct symbol_list *list, struct sym_node *node)
 {
 	struct symbol *sym;
 
@@ -91,7 +212,64 @@ static inline void examine_members(SCTX_ struct symbol_list *list, xmlNodePtr no
 	} END_FOR_EACH_PTR(sym);
 }
 
-static void examine_modifiers(SCTX_ struct symbol *sym, xmlNodePtr node)
+static void examine_symbol(SCTX_ struct symbol *sym, struct sym_node *parent)
+{
+	struct symbol *base = sym ? sym->ctype.base_type : NULL;
+	struct sym_node *node;
+
+	if (!sym)
+		return;
+	if (sym->aux)		/*already visited */
+		return;
+
+	if (sym->ident && sym->ident->reserved)
+		return;
+
+	node = new_sym_node(sctx_ sym, get_type_name(sctx_ sym->type), parent);
+	examine_symbol_type(sctx_ sym);
+
+	if (base && !builtin_typename(sctx_ base) && !base->aux)
+		examine_symbol(sctx_ base, NULL);
+
+	switch (sym->type) {
+	case SYM_STRUCT:
+	case SYM_UNION:
+		examine_members(sctx_ sym->symbol_list, node);
+		break;
+	case SYM_FN:
+		examine_members(sctx_ sym->arguments, node);
+		break;
+	default:
+		break;
+	}
+}
+
+static void emit_position(SCTX_ struct sym_node *node)
+{
+	struct symbol *sym = node->sym;
+	const char *ident = show_ident(sctx_ sym->ident);
+	char id[32];
+
+	snprintf(id, sizeof(id), "_%d", node->id);
+	out->prop("type", node->type);
+	out->prop("id", id);
+
+	if (sym->ident && ident)
+		out->prop("ident", ident);
+	out->prop("file", stream_name(sctx_ sym->pos->pos.stream));
+
+	out->num("start-line", sym->pos->pos.line);
+	out->num("start-col", sym->pos->pos.pos);
+
+	if (sym->endpos) {
+		out->num("end-line", sym->endpos->pos.line);
+		out->num("end-col", sym->endpos->pos.pos);
+		if (sym->pos->pos.stream != sym->endpos->pos.stream)
+			out->prop("end-file", stream_name(sctx_ sym->endpos->pos.stream));
+	}
+}
+
+static void emit_modifiers(SCTX_ struct sym_node *node)
 {
 	const char *modifiers[] = {
 			"auto",
@@ -129,80 +307,81 @@ static void examine_modifiers(SCTX_ struct symbol *sym, xmlNodePtr node)
 
 	int i;
 
-	if (sym->namespace != NS_SYMBOL)
+	if (node->sym->namespace != NS_SYMBOL)
 		return;
 
 	/*iterate over the 32 bit bitfield*/
 	for (i=0; i < 32; i++) {
-		if ((sym->ctype.modifiers & 1<<i) && modifiers[i])
-			newProp(sctx_ node, modifiers[i], "1");
+		if ((node->modifiers & 1<<i) && modifiers[i])
+			out->prop(modifiers[i], "1");
 	}
 }
 
-static void
-examine_layout(SCTX_ struct symbol *sym, xmlNodePtr node)
+static void emit_layout(SCTX_ struct symbol *sym)
 {
-	examine_symbol_type(sctx_ sym);
-
-	newNumProp(sctx_ node, "bit-size", sym->bit_size);
-	newNumProp(sctx_ node, "alignment", sym->ctype.alignment);
-	newNumProp(sctx_ node, "offset", sym->offset);
+	out->num("bit-size", sym->bit_size);
+	out->num("alignment", sym->ctype.alignment);
+	out->num("offset", sym->offset);
 	if (is_bitfield_type(sym)) {
-		newNumProp(sctx_ node, "bit-offset", sym->bit_offset);
+		out->num("bit-offset", sym->bit_offset);
 	}
 }
 
-static void examine_symbol(SCTX_ struct symbol *sym, xmlNodePtr node)
+static void emit_symbol(SCTX_ struct sym_node *node, int first)
 {
-	xmlNodePtr child = NULL;
+	struct symbol *sym = node->sym;
+	struct sym_node *child, *next;
 	const char *base;
-	int array_size;
-
-	if (!sym)
-		return;
-	if (sym->aux)		/*already visited */
-		return;
-
-	if (sym->ident && sym->ident->reserved)
-		return;
-
-	child = new_sym_node(sctx_ sym, get_type_name(sctx_ sym->type), node);
-	examine_modifiers(sctx_ sym, child);
-	examine_layout(sctx_ sym, child);
-
-	if (sym->ctype.base_type) {
-		if ((base = builtin_typename(sctx_ sym->ctype.base_type)) == NULL) {
-			if (!sym->ctype.base_type->aux) {
-				examine_symbol(sctx_ sym->ctype.base_type, root_node);
+	char id[32];
+
+	out->start(first);
+	emit_position(sctx_ node);
+	if (sym->namespace != NS_MACRO) {
+		emit_modifiers(sctx_ node);
+		emit_layout(sctx_ sym);
+
+		if (sym->ctype.base_type) {
+			if ((base = builtin_typename(sctx_ sym->ctype.base_type)) == NULL) {
+				if (sym->ctype.base_type->aux) {
+					snprintf(id, sizeof(id), "_%d", sym_id(sym->ctype.base_type));
+					out->prop("base-type", id);
+				}
+			} else {
+				out->prop("base-type-builtin", base);
 			}
-			xmlNewProp(child, BAD_CAST "base-type",
-			           xmlGetProp((xmlNodePtr)sym->ctype.base_type->aux, BAD_CAST "id"));
-		} else {
-			newProp(sctx_ child, "base-type-builtin", base);
 		}
+		if (sym->array_size) {
+			/* TODO: modify get_expression_value to give error return */
+			out->num("array-size", get_expression_value(sctx_ sym->array_size));
+		}
+		if (sym->type == SYM_UNINITIALIZED)
+			out->prop("base-type-builtin", builtin_typename(sctx_ sym));
 	}
-	if (sym->array_size) {
-		/* TODO: modify get_expression_value to give error return */
-		array_size = get_expression_value(sctx_ sym->array_size);
-		newNumProp(sctx_ child, "array-size", array_size);
+
+	if (node->children) {
+		out->start_children();
+		for (child = node->children, first = 1; child; child = next, first = 0) {
+			next = child->next;
+			emit_symbol(sctx_ child, first);
+		}
+		out->end_children();
 	}
+	out->end();
+	free(node);
+}
 
+/* write out and drop what examining one top level symbol queued */
+static void emit_roots(SCTX)
+{
+	struct sym_node *node, *next;
 
-	switch (sym->type) {
-	case SYM_STRUCT:
-	case SYM_UNION:
-		examine_members(sctx_ sym->symbol_list, child);
-		break;
-	case SYM_FN:
-		examine_members(sctx_ sym->arguments, child);
-		break;
-	case SYM_UNINITIALIZED:
-		newProp(sctx_ child, "base-type-builtin", builtin_typename(sctx_ sym));
-		break;
-	default:
-	  break;
+	for (node = roots; node; node = next) {
+		next = node->next;
+		emit_symbol(sctx_ node, 1);
 	}
-	return;
+	roots = NULL;
+	roots_tail = &roots;
+	fflush(stdout);
 }
 
 static struct token *get_expansion_end (SCTX_ struct token *token)
@@ -219,7 +398,7 @@ static struct token *get_expansion_end (SCTX_ struct token *token)
 		return NULL;
 }
 
-static void examine_macro(SCTX_ struct symbol *sym, xmlNodePtr node)
+static void examine_macro(SCTX_ struct symbol *sym)
 {
 	struct token *pos;
 
@@ -230,7 +409,7 @@ static void examine_macro(SCTX_ struct symbol *sym, xmlNodePtr node)
 	else
 		sym->endpos = sym->pos;
 
-	new_sym_node(sctx_ sym, "macro", node);
+	new_sym_node(sctx_ sym, "macro", NULL);
 }
 
 static void examine_namespace(SCTX_ struct symbol *sym)
@@ -240,12 +419,12 @@ static void examine_namespace(SCTX_ struct symbol *sym)
 
 	switch(sym->namespace) {
 	case NS_MACRO:
-		examine_macro(sctx_ sym, root_node);
+		examine_macro(sctx_ sym);
 		break;
 	case NS_TYPEDEF:
 	case NS_STRUCT:
 	case NS_SYMBOL:
-		examine_symbol(sctx_ sym, root_node);
+		examine_symbol(sctx_ sym, NULL);
 		break;
 	case NS_NONE:
 	case NS_LABEL:
@@ -257,7 +436,7 @@ static void examine_namespace(SCTX_ struct symbol *sym)
 	default:
 		sparse_die(sctx_ "Unrecognised namespace type %d",sym->namespace);
 	}
-
+	emit_roots(sctx);
 }
 
 static int get_stream_id (SCTX_ const char *name)
@@ -288,34 +467,32 @@ int main(int argc, char **argv)
 	struct string_list *filelist = NULL;
 	struct symbol_list *symlist = NULL;
 	char *file;
+	int i, j, globals;
 	SPARSE_CTX_INIT;
 
-	doc = xmlNewDoc(BAD_CAST "1.0");
-	root_node = xmlNewNode(NULL, BAD_CAST "parse");
-	xmlDocSetRootElement(doc, root_node);
-
-/* - A DTD is probably unnecessary for something like this
-
-	dtd = xmlCreateIntSubset(doc, "parse", "http://www.kernel.org/pub/software/devel/sparse/parse.dtd" NULL, "parse.dtd");
-
-	ns = xmlNewNs (root_node, "http://www.kernel.org/pub/software/devel/sparse/parse.dtd", NULL);
+	out = &xml_output;
+	for (i = j = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--json"))
+			out = &json_output;
+		else
+			argv[j++] = argv[i];
+	}
+	argv[j] = NULL;
+	argc = j;
 
-	xmlSetNs(root_node, ns);
-*/
 	symlist = sparse_initialize(sctx_ argc, argv, &filelist);
+	globals = symbol_list_size(sctx_ sctxp global_scope->symbols);
 
+	out->begin();
 	FOR_EACH_PTR_NOTAG(filelist, file) {
 		examine_symbol_list(sctx_ file, symlist);
 		sparse_keep_tokens(sctx_ file);
 		examine_symbol_list(sctx_ file, sctxp file_scope->symbols);
 		examine_symbol_list(sctx_ file, sctxp global_scope->symbols);
+		/* the next file starts from the same global scope */
+		trim_global_scope(sctx_ globals);
 	} END_FOR_EACH_PTR_NOTAG(file);
-
-
-	xmlSaveFormatFileEnc("-", doc, "UTF-8", 1);
-	xmlFreeDoc(doc);
-	xmlCleanupParser();
+	out->finish();
 
 	return 0;
 }
-
@@ -149,11 +149,10 @@ void get_char_constant(SCTX_ struct token *token, unsigned long long *val)
 
 struct token *get_string_constant(SCTX_ struct token *token, struct expression *expr)
 {
-	struct string *string = token->string;
 	struct token *next = token->next, *done = NULL;
 	int stringtype = token_type(token);
 	int is_wide = stringtype == TOKEN_WIDE_STRING;
-	static char buffer[MAX_STRING];
+	static TLS_ATTR char buffer[MAX_STRING];
 	int len = 0;
 	int bits;
 
@@ -186,13 +185,8 @@ struct token *get_string_constant(SCTX_ struct token *token, struct expression *
 		len = MAX_STRING;
 	}
 
-	if (len >= string->length)	/* can't cannibalize */
-		string = __alloc_string(sctx_ len+1);
-	string->length = len+1;
-	string->used = string->length;
-	memcpy(string->data, buffer, len);
-	string->data[len] = '\0';
-	expr->string = string;
+	/* the token's string is interned, it can't be cannibalized */
+	expr->string = intern_string(sctx_ buffer, len);
 	expr->wide = is_wide;
 	return token;
 }
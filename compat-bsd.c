@@ -6,6 +6,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <string.h>
 
 #include "lib.h"
@@ -18,3 +19,8 @@ long double string_to_ld(const char *nptr, char **endptr)
 {
 	return strtod(nptr, endptr);
 }
+
+long long stat_mtime_ns(const struct stat *st)
+{
+	return st->st_mtimespec.tv_sec * 1000000000LL + st->st_mtimespec.tv_nsec;
+}
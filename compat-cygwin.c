@@ -38,3 +38,5 @@ long double string_to_ld(const char *nptr, char **endptr)
 {	
 	return strtod(nptr, endptr);	
 }
+
+#include "compat/stat-mtime.c"
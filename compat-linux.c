@@ -7,3 +7,4 @@
 
 #include "compat/mmap-blob.c"
 #include "compat/strtold.c"
+#include "compat/stat-mtime.c"
@@ -12,6 +12,7 @@
 #include <winbase.h>	
 #include <stdlib.h>	
 #include <string.h>	
+#include <sys/stat.h>
 	
 #include "lib.h"
 #include "allocate.h"
@@ -35,3 +36,8 @@ long double string_to_ld(const char *nptr, char **endptr)
 {	
 	return strtod(nptr, endptr);	
 }
+
+long long stat_mtime_ns(const struct stat *st)
+{
+	return st->st_mtime * 1000000000LL;
+}
@@ -2,6 +2,7 @@
 #include "allocate.h"
 
 #include "compat/mmap-blob.c"
+#include "compat/stat-mtime.c"
 
 #include <floatingpoint.h>
 #include <limits.h>
@@ -9,6 +9,8 @@
  *	Missing in MinGW
  *  - "string to long double" (C99 strtold())
  *	Missing in Solaris and MinGW
+ *  - nanosecond file modification times
+ *	st_mtimespec on BSD, only seconds in MinGW
  */
 struct stream;
 struct stat;
@@ -24,5 +26,6 @@ struct stat;
 void *blob_alloc(SCTX_ unsigned long size);
 void blob_free(SCTX_ void *addr, unsigned long size);
 long double string_to_ld(SCTX_ const char *nptr, char **endptr);
+long long stat_mtime_ns(const struct stat *st);
 
 #endif
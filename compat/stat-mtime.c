@@ -0,0 +1,9 @@
+#include <sys/stat.h>
+
+/*
+ * POSIX.1-2008 stat with nanosecond timestamps.
+ */
+long long stat_mtime_ns(const struct stat *st)
+{
+	return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
@@ -40,6 +40,7 @@
 #include "expression.h"
 #include "target.h"
 #include "compile.h"
+#include "linearize.h"
 #include "bitmap.h"
 
 struct textbuf {
@@ -1696,86 +1697,176 @@ static void emit_case_statement(SCTX_ struct statement *stmt)
 	x86_statement(sctx_ stmt->case_statement);
 }
 
-static void emit_switch_statement(SCTX_ struct statement *stmt)
+/* ranges of a switch that are tested one after the other */
+#define SWITCH_LEAF	3
+
+struct switch_emit {
+	struct switch_plan plan;
+	int switch_end;		/* the label when there is no default */
+	const char *jlt, *jle;
+};
+
+static struct storage *switch_label(SCTX_ struct switch_emit *sw, void *target)
 {
-	struct storage *val = x86_expression(sctx_ stmt->switch_expression);
-	struct symbol *sym, *default_sym = NULL;
-	struct storage *labelsym, *label;
-	int switch_end = 0;
+	struct storage *label;
 
-	emit_move(sctx_ val, REG_EAX, stmt->switch_expression->ctype, "begin case");
+	if (target)
+		return new_labelsym(sctx_ target);
+	label = new_storage(sctx_ STOR_LABEL);
+	label->flags |= STOR_WANTS_FREE;
+	label->label = sw->switch_end;
+	return label;
+}
 
-	/*
-	 * This is where a _real_ back-end would go through the
-	 * cases to decide whether to use a lookup table or a
-	 * series of comparisons etc
-	 */
-	FOR_EACH_PTR(stmt->switch_case->symbol_list, sym) {
-		struct statement *case_stmt = sym->stmt;
-		struct expression *expr = case_stmt->case_expression;
-		struct expression *to = case_stmt->case_to;
+/* binary search down to SWITCH_LEAF ranges, then compares */
+static void emit_switch_tree(SCTX_ struct switch_emit *sw, int lo, int hi)
+{
+	struct switch_plan *plan = &sw->plan;
+	struct storage *label;
+	int i;
 
-		/* default: */
-		if (!expr)
-			default_sym = sym;
+	if (hi - lo > SWITCH_LEAF) {
+		int mid = lo + (hi - lo) / 2;
+		int left = new_label(sctx);
 
-		/* case NNN: */
-		else {
-			struct storage *case_val = new_val(sctx_ expr->value);
+		insn(sctx_ "cmpl", new_val(sctx_ plan->ranges[mid].begin), REG_EAX, NULL);
+		label = new_storage(sctx_ STOR_LABEL);
+		label->flags |= STOR_WANTS_FREE;
+		label->label = left;
+		insn(sctx_ sw->jlt, label, NULL, NULL);
+		emit_switch_tree(sctx_ sw, mid, hi);
+		emit_label(sctx_ left, NULL);
+		emit_switch_tree(sctx_ sw, lo, mid);
+		return;
+	}
 
-			assert (expr->type == EXPR_VALUE);
+	for (i = lo; i < hi; i++) {
+		struct switch_range *r = plan->ranges + i;
 
-			insn(sctx_ "cmpl", case_val, REG_EAX, NULL);
+		insn(sctx_ "cmpl", new_val(sctx_ r->begin), REG_EAX, NULL);
+		if (r->begin == r->end) {
+			insn(sctx_ "je", switch_label(sctx_ sw, r->target), NULL, NULL);
+			continue;
+		}
+		/* the ranges are sorted, below this one is below the rest */
+		insn(sctx_ sw->jlt, switch_label(sctx_ sw, plan->def), NULL, NULL);
+		insn(sctx_ "cmpl", new_val(sctx_ r->end), REG_EAX, NULL);
+		insn(sctx_ sw->jle, switch_label(sctx_ sw, r->target), NULL, NULL);
+	}
+	insn(sctx_ "jmp", switch_label(sctx_ sw, plan->def), NULL, "default");
+}
 
-			if (!to) {
-				labelsym = new_labelsym(sctx_ sym);
-				insn(sctx_ "je", labelsym, NULL, NULL);
-			} else {
-				int next_test;
+static void emit_switch_table(SCTX_ struct switch_emit *sw)
+{
+	struct function *f = current_func;
+	struct switch_plan *plan = &sw->plan;
+	long long low = plan->ranges[0].begin, high = plan->ranges[plan->nr - 1].end;
+	long long val;
+	int table = new_label(sctx);
+	char s[64];
+	int i = 0;
+
+	if (low)
+		insn(sctx_ "subl", new_val(sctx_ low), REG_EAX, NULL);
+	insn(sctx_ "cmpl", new_val(sctx_ high - low), REG_EAX, NULL);
+	insn(sctx_ "ja", switch_label(sctx_ sw, plan->def), NULL, "default");
+	sprintf(s, "\tjmp\t*.L%d(,%%eax,4)\n", table);
+	push_text_atom(sctx_ f, s);
+
+	sprintf(s, "\t.section\t.rodata\n\t.align\t4\n.L%d:\n", table);
+	push_text_atom(sctx_ f, s);
+	for (val = low; val <= high; val++) {
+		void *target = plan->def;
+
+		if (val > plan->ranges[i].end)
+			i++;
+		if (val >= plan->ranges[i].begin)
+			target = plan->ranges[i].target;
+		if (target)
+			sprintf(s, "\t.long\t.LS%p\n", target);
+		else
+			sprintf(s, "\t.long\t.L%d\n", sw->switch_end);
+		push_text_atom(sctx_ f, s);
+	}
+	push_text_atom(sctx_ f, "\t.text\n");
+}
 
-				label = new_storage(sctx_ STOR_LABEL);
-				label->flags |= STOR_WANTS_FREE;
-				label->label = next_test = new_label(sctx);
+/* case values as the switch compares them, sign or zero extended */
+static long long case_value(SCTX_ struct expression *expr, int bits, int is_signed)
+{
+	unsigned long long value = expr->value;
 
-				/* FIXME: signed/unsigned */
-				insn(sctx_ "jl", label, NULL, NULL);
+	if (bits <= 0 || bits >= 64)
+		return value;
+	value &= (1ULL << bits) - 1;
+	if (is_signed && (value >> (bits - 1)))
+		value |= ~0ULL << bits;
+	return value;
+}
 
-				case_val = new_val(sctx_ to->value);
-				insn(sctx_ "cmpl", case_val, REG_EAX, NULL);
+static void emit_switch_statement(SCTX_ struct statement *stmt)
+{
+	struct storage *val = x86_expression(sctx_ stmt->switch_expression);
+	struct symbol *sym;
+	struct symbol *ctype = stmt->switch_expression->ctype;
+	int is_signed = type_is_signed(sctx_ ctype);
+	struct switch_emit sw;
+	int nr = 0;
 
-				/* TODO: implement and use refcounting... */
-				label = new_storage(sctx_ STOR_LABEL);
-				label->flags |= STOR_WANTS_FREE;
-				label->label = next_test;
+	emit_move(sctx_ val, REG_EAX, stmt->switch_expression->ctype, "begin case");
 
-				/* FIXME: signed/unsigned */
-				insn(sctx_ "jg", label, NULL, NULL);
+	/* see plan_switch() for how the cases are dispatched */
+	sw.plan.ranges = malloc((ptr_list_size(sctx_ (struct ptr_list *)stmt->switch_case->symbol_list) + 1) *
+				sizeof(struct switch_range));
+	sw.plan.def = NULL;
+	FOR_EACH_PTR(stmt->switch_case->symbol_list, sym) {
+		struct statement *case_stmt = sym->stmt;
+		struct expression *expr = case_stmt->case_expression;
+		struct expression *to = case_stmt->case_to;
+		struct switch_range *r = sw.plan.ranges + nr;
 
-				labelsym = new_labelsym(sctx_ sym);
-				insn(sctx_ "jmp", labelsym, NULL, NULL);
+		/* default: */
+		if (!expr) {
+			sw.plan.def = sym;
+			continue;
+		}
 
-				emit_label(sctx_ next_test, NULL);
-			}
+		/* case NNN: */
+		assert (expr->type == EXPR_VALUE);
+		r->begin = r->end = case_value(sctx_ expr, ctype->bit_size, is_signed);
+		if (to) {
+			r->end = case_value(sctx_ to, ctype->bit_size, is_signed);
+			/* empty, as in linearize_switch() */
+			if (r->end < r->begin)
+				continue;
 		}
+		r->target = sym;
+		nr++;
 	} END_FOR_EACH_PTR(sym);
+	sw.plan.nr = nr;
+	plan_switch(sctx_ &sw.plan);
 
-	if (default_sym) {
-		labelsym = new_labelsym(sctx_ default_sym);
-		insn(sctx_ "jmp", labelsym, NULL, "default");
+	sw.switch_end = sw.plan.def ? 0 : new_label(sctx);
+	if (is_signed) {
+		sw.jlt = "jl";
+		sw.jle = "jle";
 	} else {
-		label = new_storage(sctx_ STOR_LABEL);
-		label->flags |= STOR_WANTS_FREE;
-		label->label = switch_end = new_label(sctx);
-		insn(sctx_ "jmp", label, NULL, "goto end of switch");
+		sw.jlt = "jb";
+		sw.jle = "jbe";
 	}
+	if (sw.plan.table)
+		emit_switch_table(sctx_ &sw);
+	else
+		emit_switch_tree(sctx_ &sw, 0, sw.plan.nr);
+	free_switch_plan(sctx_ &sw.plan);
 
 	x86_statement(sctx_ stmt->switch_statement);
 
 	if (stmt->switch_break->used)
 		emit_labelsym(sctx_ stmt->switch_break, NULL);
 
-	if (switch_end)
-		emit_label(sctx_ switch_end, NULL);
+	if (sw.switch_end)
+		emit_label(sctx_ sw.switch_end, NULL);
 }
 
 static void x86_struct_member(SCTX_ struct symbol *sym)
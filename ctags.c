@@ -3,6 +3,17 @@
  *
  * Ctags generates tags from preprocessing results.
  *
+ *	ctags [-u] [-r index] [-f tagfile] [-j N] [sparse options] files...
+ *
+ * Every file is tagged on its own and its sorted tags are merged into
+ * "tags", or the tagfile of -f ("-" is the standard output), so a
+ * header seen by many files is tagged once. With -u what each file
+ * gave is kept in "tags.units" along with the files it read, and only
+ * the files where one of them changed are checked again; a file that
+ * isn't given any more is dropped from it, and from the tags. -r takes
+ * the sections to start from out of another index, without writing it.
+ * With -j every file is checked in a process of its own, N at a time.
+ *
  * Copyright (C) 2006 Christopher Li
  *
  * Licensed under the Open Software License version 1.1
@@ -12,78 +23,95 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/wait.h>
 
 #include "parse.h"
 #include "scope.h"
 #include "token.h"
+#include "units.h"
+
+#define UNITS "tags.units"
 
 static struct symbol_list *taglist = NULL;
 
 static void examine_symbol(SCTX_ struct symbol *sym);
 
-#define MAX(_x,_y) ((_x) > (_y) ? (_x) : (_y))
-
-static int cmp_sym(SCTX_ const void *m, const void *n)
+/* a tag line; tag lines compare as strings up to the newline */
+static char *tag_line(SCTX_ struct symbol *sym)
 {
-	const struct ident *a = ((const struct symbol *)m)->ident;
-	const struct ident *b = ((const struct symbol *)n)->ident;
-	int ret = strncmp(a->name, b->name, MAX(a->len, b->len));
-	if (!ret) {
-		const struct position a_pos = ((const struct symbol *)m)->pos->pos;
-		const struct position b_pos = ((const struct symbol *)n)->pos->pos;
+	const char *name = show_ident(sctx_ sym->ident);
+	const char *file = stream_name(sctx_ sym->pos->pos.stream);
+	char *line = malloc(strlen(name) + strlen(file) + 48);
+
+	sprintf(line, "%s\t%s\t%d;\"\t%c\tfile:\n", name, file, sym->pos->pos.line, (int)sym->kind);
+	return line;
+}
 
-		ret = strcmp(stream_name(sctx_ a_pos.stream),
-		             stream_name(sctx_ b_pos.stream));
-		if (!ret)
-			return a_pos.line < b_pos.line;
+static int linecmp(const char *a, const char *b)
+{
+	while (*a == *b && *a != '\n') {
+		a++;
+		b++;
 	}
-	return ret;
+	return (unsigned char)*a - (unsigned char)*b;
 }
 
-static void show_tag_header(SCTX_ FILE *fp)
+/* one tag for a name at a place, whatever its kind */
+static int same_tag(const char *a, const char *b)
+{
+	const char *end = strstr(a, ";\"");
+
+	return !strncmp(a, b, end - a + 2);
+}
+
+/*
+ * Tags sort as lines, but the typedef comes first of the tags for a
+ * name at a place, so that it is the one kept for the anonymous
+ * struct it names.
+ */
+static int tagcmp(const char *a, const char *b)
+{
+	int n = strstr(a, ";\"") - a + 3;
+
+	if (!same_tag(a, b) || a[n] == b[n])
+		return linecmp(a, b);
+	return a[n] == 't' ? -1 : b[n] == 't' ? 1 : linecmp(a, b);
+}
+
+static int cmp_line(const void *m, const void *n)
+{
+	return tagcmp(*(char * const *)m, *(char * const *)n);
+}
+
+static void show_tag_header(FILE *fp)
 {
 	fprintf(fp, "!_TAG_FILE_FORMAT\t2\t/extended format; --format=1 will not append ;\" to lines/\n");
-	fprintf(fp, "!_TAG_FILE_SORTED\t0\t/0=unsorted, 1=sorted, 2=foldcase/\n");
+	fprintf(fp, "!_TAG_FILE_SORTED\t1\t/0=unsorted, 1=sorted, 2=foldcase/\n");
 	fprintf(fp, "!_TAG_PROGRAM_AUTHOR\tChristopher Li\t/sparse@chrisli.org/\n");
 	fprintf(fp, "!_TAG_PROGRAM_NAME\tSparse Ctags\t//\n");
 	fprintf(fp, "!_TAG_PROGRAM_URL\thttp://www.kernel.org/pub/software/devel/sparse/\t/official site/\n");
 	fprintf(fp, "!_TAG_PROGRAM_VERSION\t0.01\t//\n");
 }
 
-static inline void show_symbol_tag(SCTX_ FILE *fp, struct symbol *sym)
-{
-	fprintf(fp, "%s\t%s\t%d;\"\t%c\tfile:\n", show_ident(sctx_ sym->ident),
-	       stream_name(sctx_ sym->pos->pos.stream), sym->pos->pos.line, (int)sym->kind);
-}
-
-static void show_tags(SCTX_ struct symbol_list *list)
+/* the tags gathered so far, sorted and each line once */
+static void show_tags(SCTX_ FILE *fp)
 {
+	int nr = symbol_list_size(sctx_ taglist), i = 0;
+	char **lines = malloc((nr + 1) * sizeof(char *));
 	struct symbol *sym;
-	struct ident *ident = NULL;
-	struct position pos = {};
-	static const char *filename;
-	FILE *fp;
-
-	if (!list)
-		return;
-
-	fp = fopen("tags", "w");
-	if (!fp) {
-		perror("open tags file");
-		return;
-	}
-	show_tag_header(sctx_ fp);
-	FOR_EACH_PTR(list, sym) {
-		if (ident == sym->ident && pos.line == sym->pos->pos.line &&
-		    !strcmp(filename, stream_name(sctx_ sym->pos->pos.stream)))
-			continue;
 
-		show_symbol_tag(sctx_ fp, sym);
-		ident = sym->ident;
-		pos = sym->pos->pos;
-		filename = stream_name(sctx_ sym->pos->pos.stream);
+	FOR_EACH_PTR(taglist, sym) {
+		lines[i++] = tag_line(sctx_ sym);
 	} END_FOR_EACH_PTR(sym);
-	fclose(fp);
+	qsort(lines, nr, sizeof(char *), cmp_line);
+	for (i = 0; i < nr; i++) {
+		if (!i || !same_tag(lines[i - 1], lines[i]))
+			fputs(lines[i], fp);
+	}
+	for (i = 0; i < nr; i++)
+		free(lines[i]);
+	free(lines);
+	free_ptr_list(&taglist);
 }
 
 static inline void add_tag(SCTX_ struct symbol *sym)
@@ -195,19 +223,223 @@ static inline void examine_symbol_list(SCTX_ struct symbol_list *list)
 	} END_FOR_EACH_PTR(sym);
 }
 
+/******** units ********/
+
+/*
+ * What a file contributes to the tags, as kept in tags.units for -u:
+ * the head of units.h, then its sorted tag lines.
+ */
+static struct unit_index units;
+static int globals;
+
+static void unit_section(SCTX_ FILE *f, char *file)
+{
+	int first = sctxp input_stream_nr;
+
+	sparse(sctx_ file);
+	show_unit_inputs(sctx_ f, file, first);
+	examine_symbol_list(sctx_ sctxp file_scope->symbols);
+	examine_symbol_list(sctx_ sctxp global_scope->symbols);
+	show_tags(sctx_ f);
+	fprintf(f, "end\n");
+	trim_global_scope(sctx_ globals);
+}
+
+static char *part_name(int pid)
+{
+	char *name = malloc(32);
+
+	sprintf(name, "tags.%d", pid);
+	return name;
+}
+
+/* one process per file, 'jobs' at a time; returns how many failed */
+static int tags_parallel(SCTX_ char **files, int nr, int jobs)
+{
+	int running = 0, failed = 0, i, status, pid;
+
+	fflush(NULL);
+	for (i = 0; i < nr || running; i++) {
+		if (running == jobs || i >= nr) {
+			pid = wait(&status);
+			if (pid < 0)
+				break;
+			running--;
+			if (WIFEXITED(status) && !WEXITSTATUS(status)) {
+				char *name = part_name(pid);
+
+				read_unit_index(&units, name);
+				unlink(name);
+				free(name);
+			} else {
+				failed++;
+			}
+			if (i >= nr)
+				continue;
+		}
+		pid = fork();
+		if (!pid) {
+			char *name = part_name(getpid());
+			FILE *f = fopen(name, "w");
+
+			if (!f)
+				_exit(1);
+			unit_section(sctx_ f, files[i]);
+			_exit(fclose(f) != 0);
+		}
+		if (pid < 0) {
+			perror("fork");
+			failed++;
+		} else {
+			running++;
+		}
+	}
+	return failed;
+}
+
+/******** merging ********/
+
+/* the tag line at or after p, NULL at the end of the section */
+static const char *next_tag(const char *p)
+{
+	while (p && (!strncmp(p, "unit ", 5) || !strncmp(p, "input ", 6))) {
+		p = strchr(p, '\n');
+		if (p)
+			p++;
+	}
+	if (!p || !*p || !strcmp(p, "end\n"))
+		return NULL;
+	return p;
+}
+
+static void sift_down(const char **heap, int nr, int i)
+{
+	for (;;) {
+		int min = i, l = 2 * i + 1, r = l + 1;
+		const char *tmp;
+
+		if (l < nr && tagcmp(heap[l], heap[min]) < 0)
+			min = l;
+		if (r < nr && tagcmp(heap[r], heap[min]) < 0)
+			min = r;
+		if (min == i)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
+	}
+}
+
+/* k-way merge of the sorted sections, a line seen in many units once */
+static int write_tags(const char *name, const char *initial)
+{
+	const char **heap = malloc((units.nr + 1) * sizeof(char *));
+	const char *last = NULL;
+	char tmp[4096];
+	int nr = 0, i;
+	FILE *fp;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", name);
+	fp = strcmp(name, "-") ? fopen(tmp, "w") : stdout;
+	if (!fp) {
+		perror("open tags file");
+		return -1;
+	}
+	show_tag_header(fp);
+	if ((heap[nr] = next_tag(initial)) != NULL)
+		nr++;
+	for (i = 0; i < units.nr; i++)
+		if ((heap[nr] = next_tag(units.sections[i].text)) != NULL)
+			nr++;
+	for (i = nr / 2 - 1; i >= 0; i--)
+		sift_down(heap, nr, i);
+	while (nr) {
+		const char *line = heap[0], *end = strchr(line, '\n');
+
+		if (!last || !same_tag(last, line))
+			fwrite(line, 1, end - line + 1, fp);
+		last = line;
+		heap[0] = next_tag(end + 1);
+		if (!heap[0])
+			heap[0] = heap[--nr];
+		sift_down(heap, nr, 0);
+	}
+	free(heap);
+	if (fp == stdout)
+		return fflush(fp) ? -1 : 0;
+	if (fclose(fp) || rename(tmp, name)) {
+		perror(name);
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	struct string_list *filelist = NULL;
-	char *file;
+	char **files = NULL, *file, *initial;
+	const char *tags = "tags", *index = NULL;
+	int i, j, nr = 0, jobs = 1, update = 0, failed = 0;
+	size_t len;
+	FILE *f;
 	SPARSE_CTX_INIT;
 
+	for (i = j = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-u"))
+			update = 1;
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			index = argv[++i];
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			tags = argv[++i];
+		else if (!strncmp(argv[i], "-j", 2) && (argv[i][2] || i + 1 < argc))
+			jobs = parse_jobs(sctx_ argv[i][2] ? argv[i] + 2 : argv[++i]);
+		else
+			argv[j++] = argv[i];
+	}
+	argv[j] = NULL;
+	argc = j;
+
+	/* the builtins are tagged here, once, not in every unit */
+	f = open_memstream(&initial, &len);
 	examine_symbol_list(sctx_ sparse_initialize(sctx_ argc, argv, &filelist));
+	examine_symbol_list(sctx_ sctxp global_scope->symbols);
+	show_tags(sctx_ f);
+	fclose(f);
+	globals = symbol_list_size(sctx_ sctxp global_scope->symbols);
+
+	if (update && !index)
+		index = UNITS;
+	if (index) {
+		read_unit_index(&units, index);
+		keep_units(sctx_ &units, filelist);
+	}
 	FOR_EACH_PTR_NOTAG(filelist, file) {
-		sparse(sctx_ file);
-		examine_symbol_list(sctx_ sctxp file_scope->symbols);
+		struct unit_section *s = find_unit(&units, file);
+
+		if (index && s && unit_is_current(s->text))
+			continue;
+		files = realloc(files, (nr + 1) * sizeof(char *));
+		files[nr++] = file;
 	} END_FOR_EACH_PTR_NOTAG(file);
-	examine_symbol_list(sctx_ sctxp global_scope->symbols);
-	sort_list(sctx_ (struct ptr_list **)&taglist, cmp_sym);
-	show_tags(sctx_ taglist);
-	return 0;
+
+	if (jobs > 1) {
+		failed = tags_parallel(sctx_ files, nr, jobs);
+	} else {
+		for (i = 0; i < nr; i++) {
+			char *text;
+
+			f = open_memstream(&text, &len);
+			unit_section(sctx_ f, files[i]);
+			fclose(f);
+			set_unit(&units, files[i], text);
+		}
+	}
+
+	if (update && write_unit_index(&units, UNITS))
+		perror(UNITS);
+	if (write_tags(tags, initial))
+		return 1;
+	return failed != 0;
 }
@@ -156,6 +156,9 @@ struct sparse_ctx *sparse_ctx_init(struct sparse_ctx *ctx) {
 	/* ptrlist.c */
 	__ALLOCATOR_INIT(struct ptr_list, "ptr list", ptrlist, 0);
 
+	/* tokenize.c */
+	__ALLOCATOR_INIT(struct token, "cached tokens", cached_token, 0);
+
 	/* storage.c */
 	ALLOCATOR_INIT(storage, "storages", 0);
 	ALLOCATOR_INIT(storage_hash, "storage hash", 0);
@@ -165,3 +168,73 @@ struct sparse_ctx *sparse_ctx_init(struct sparse_ctx *ctx) {
 
 	return ctx;
 }
+
+void sparse_ctx_for_each_allocator(struct sparse_ctx *ctx,
+		void (*fn)(struct sparse_ctx *, struct allocator_struct *, void *), void *data)
+{
+	struct allocator_struct *all[] = {
+		&ctx->pseudo_user_allocator, &ctx->asm_rules_allocator,
+		&ctx->asm_constraint_allocator, &ctx->ident_allocator,
+		&ctx->token_allocator, &ctx->pushdown_stack_op_allocator,
+		&ctx->cons_allocator, &ctx->expansion_allocator,
+		&ctx->sym_context_allocator, &ctx->symbol_allocator,
+		&ctx->expression_allocator, &ctx->statement_allocator,
+		&ctx->string_allocator, &ctx->CString_allocator,
+		&ctx->scope_allocator, &ctx->bytes_allocator,
+		&ctx->basic_block_allocator, &ctx->entrypoint_allocator,
+		&ctx->instruction_allocator, &ctx->multijmp_allocator,
+		&ctx->pseudo_allocator, &ctx->ptrlist_allocator,
+		&ctx->cached_token_allocator,
+		&ctx->storage_allocator, &ctx->storage_hash_allocator,
+		&ctx->llfunc_allocator,
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(all); i++)
+		fn(ctx, all[i], data);
+}
+
+/* CStrings keep their text in malloc()ed memory */
+static void free_cstring(struct sparse_ctx *_sctx, void *cstr, void *data)
+{
+	cstr_free(sctx_ cstr);
+}
+
+static void destroy_allocator(struct sparse_ctx *_sctx, struct allocator_struct *desc, void *data)
+{
+	destroy_allocations(sctx_ desc);
+}
+
+/*
+ * Release everything sparse_ctx_init() and the passes after it
+ * allocated. The context struct itself belongs to the caller.
+ */
+void sparse_ctx_free(struct sparse_ctx *ctx)
+{
+	struct sparse_ctx *_sctx = ctx;
+	int i;
+
+	for_each_allocation(sctx_ &ctx->CString_allocator, sizeof(CString), free_cstring, NULL);
+	for (i = 0; i < ctx->input_stream_nr; i++) {
+		const char *path = ctx->input_streams[i].path;
+		if (path && *path)
+			free((char *)path);
+	}
+	free(ctx->input_streams);
+	free_member_indexes(sctx);
+	free(ctx->keyword_table);
+	free(ctx->typenames);
+	free(ctx->string_pool);
+	ctx->tok_stk = NULL;
+	while (ctx->scratch) {
+		struct scratch_chunk *c = ctx->scratch;
+		ctx->scratch = c->prev;
+		free(c);
+	}
+	while (ctx->scratch_spare) {
+		struct scratch_chunk *c = ctx->scratch_spare;
+		ctx->scratch_spare = c->prev;
+		free(c);
+	}
+	sparse_ctx_for_each_allocator(ctx, destroy_allocator, NULL);
+}
@@ -89,6 +89,8 @@ struct sparse_ctx {
 	/*static */ struct pushdown_stack_op *cur_stack_op /* = 0 */;
 
 	struct token_stack *tok_stk;
+	struct scratch_chunk *scratch, *scratch_spare;
+	/*static*/ void (*pp_emit)(SCTX_ struct token *) /* = NULL */;
 	const char *includepath[INCLUDEPATHS+1]/* = {
 	"",
 	"/usr/include",
@@ -110,6 +112,11 @@ struct sparse_ctx {
 	struct token eof_token_entry;
 	/*static */struct ident *hash_table[IDENT_HASH_SIZE];
 	/*static */ int ident_hit, ident_miss, idents;
+	/*static */ struct string **string_pool;
+	/*static */ unsigned int string_pool_size, string_pool_nr;
+	/*static */ int string_hit, string_miss;
+	int incremental;
+	int first_tu_stream, unit_nr;
 
 	/* dissect.c */
 	struct reporter *reporter;
@@ -152,9 +159,16 @@ struct sparse_ctx {
 	int gcc_minor /*= __GNUC_MINOR__*/;
 	int gcc_patchlevel /*= __GNUC_PATCHLEVEL__*/;
 	struct token *pp_tokenlist /*= NULL*/;
+	/*static*/ int pp_printed /*= 0*/;
 	/*static*/ const char *gcc_base_dir /*= GCC_BASE*/;
 	/*static*/ int max_warnings/* = 100*/;
 	/*static*/ int show_info/* = 1*/;
+	/*static*/ int errors/* = 0*/;
+	/*static*/ int too_many_errors/* = 0*/;
+	FILE *diag_file /* = NULL */;
+	long long diag_order /* = 0 */;
+	int diag_once /* = 0 */;
+	/*static*/ void (*die_hook)(SCTX) /* = NULL */;	/* instead of exit() on fatal errors */
 	
 	/*static*/ struct token *pre_buffer_begin/* = NULL*/;
 	/*static*/ struct token *pre_buffer_end/* = NULL*/;
@@ -188,6 +202,8 @@ struct sparse_ctx {
 	int dbg_dead /*= 0*/;
 	
 	int preprocess_only;
+	const char *server_socket;
+	int jobs;
 
 	int arch_m64/* = ARCH_M64_DEFAULT*/;
 	int arch_msize_long /*= 0*/;
@@ -230,10 +246,13 @@ struct sparse_ctx {
 	
 	/*expand.c*/
 	/*static*/ int conservative;
+	/*static*/ struct symbol *expanding_fn;
 	
 	/*linearize.c*/
 	/*static*/ struct position current_pos;
         struct pseudo void_pseudo /* = {}*/;
+#define MAX_VAL_HASH 64
+	/*static*/ struct pseudo_list *value_pseudos[MAX_VAL_HASH];
 
 	/* cse.c */
 	/*static */struct instruction_list *insn_hash_table[INSN_HASH_SIZE];
@@ -265,6 +284,7 @@ struct sparse_ctx {
 	struct symbol	zero_int;
 	struct symbol_list *translation_unit_used_list;
 	/*static*/ struct symbol_list *restr, *fouled;
+	/*static*/ struct member_index *member_indexes;
 	struct symbol *current_fn;
   
 #undef  __IDENT
@@ -307,6 +327,9 @@ struct sparse_ctx {
 
 	/* ptrlist.c */
 	ALLOCATOR_DEF(ptrlist, "ptr list",0);
+
+	/* tokenize.c */
+	ALLOCATOR_DEF(cached_token, "cached tokens", 0);
 	
 	/* storage.c */
 	ALLOCATOR_DEF(storage, "storages", 0);
@@ -318,6 +341,7 @@ struct sparse_ctx {
 	/* perl/sparse.xs */
 	struct string_list *filelist;
 	struct symbol_list *symlist;
+	char **argv;
 	
   
 };
@@ -328,4 +352,8 @@ extern void sparse_ctx_init_show_parse(struct sparse_ctx *);
 extern void sparse_ctx_init_scope(struct sparse_ctx *);
 extern void sparse_ctx_init_symbols(struct sparse_ctx *);
 
+extern void sparse_ctx_for_each_allocator(struct sparse_ctx *,
+		void (*fn)(struct sparse_ctx *, struct allocator_struct *, void *), void *data);
+extern void sparse_ctx_free(struct sparse_ctx *);
+
 #endif
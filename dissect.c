@@ -247,22 +247,12 @@ static struct symbol *__lookup_member(SCTX_ struct symbol *type, struct ident *n
 	struct symbol *node;
 	int addr = 0;
 
+	if (name)
+		return find_member(sctx_ type, name, NULL, p_addr);
+
 	FOR_EACH_PTR(type->symbol_list, node)
-		if (!name) {
-			if (addr == *p_addr)
-				return node;
-		}
-		else if (node->ident == NULL) {
-			node = __lookup_member(sctx_ node->ctype.base_type, name, NULL);
-			if (node)
-				goto found;
-		}
-		else if (node->ident == name) {
-found:
-			if (p_addr)
-				*p_addr = addr;
+		if (addr == *p_addr)
 			return node;
-		}
 		addr++;
 	END_FOR_EACH_PTR(node);
 
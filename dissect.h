@@ -57,6 +57,8 @@ extern struct reporter *reporter;
 
 extern void dissect(SCTX_ struct symbol_list *, struct reporter *);
 extern int dissect_arr(SCTX_ int argc, char **argv);
+extern char dissect_storage(SCTX_ struct symbol *sym);
+extern const char *dissect_show_mode(SCTX_ unsigned mode);
 
 #define	MK_IDENT(s)	({				\
 	static struct {					\
@@ -731,7 +731,7 @@ const char *type_difference(SCTX_ struct ctype *c1, struct ctype *c2,
 							  &arg2->ctype,
 							  MOD_IGN, MOD_IGN);
 				if (diffstr) {
-					static char argdiff[80];
+					static TLS_ATTR char argdiff[80];
 					sprintf(argdiff, "incompatible argument %d (%s)", i, diffstr);
 					return argdiff;
 				}
@@ -1817,40 +1817,6 @@ static struct symbol *evaluate_preop(SCTX_ struct expression *expr)
 	return &sctxp bool_ctype;
 }
 
-static struct symbol *find_identifier(SCTX_ struct ident *ident, struct symbol_list *_list, int *offset)
-{
-	struct ptr_list *head = (struct ptr_list *)_list;
-	struct ptr_list *list = head;
-
-	if (!head)
-		return NULL;
-	do {
-		int i;
-		for (i = 0; i < list->nr; i++) {
-			struct symbol *sym = (struct symbol *) list->list[i];
-			if (sym->ident) {
-				if (sym->ident != ident)
-					continue;
-				*offset = sym->offset;
-				return sym;
-			} else {
-				struct symbol *ctype = sym->ctype.base_type;
-				struct symbol *sub;
-				if (!ctype)
-					continue;
-				if (ctype->type != SYM_UNION && ctype->type != SYM_STRUCT)
-					continue;
-				sub = find_identifier(sctx_ ident, ctype->symbol_list, offset);
-				if (!sub)
-					continue;
-				*offset += sym->offset;
-				return sub;
-			}	
-		}
-	} while ((list = list->next) != head);
-	return NULL;
-}
-
 static struct expression *evaluate_offset(SCTX_ struct expression *expr, unsigned long offset)
 {
 	struct expression *add;
@@ -1910,7 +1876,7 @@ static struct symbol *evaluate_member_dereference(SCTX_ struct expression *expr)
 		return NULL;
 	}
 	offset = 0;
-	member = find_identifier(sctx_ ident, ctype->symbol_list, &offset);
+	member = find_member(sctx_ ctype, ident, &offset, NULL);
 	if (!member) {
 		const char *type = ctype->type == SYM_STRUCT ? "struct" : "union";
 		const char *name = "<unnamed>";
@@ -2140,7 +2106,7 @@ static int evaluate_arguments(SCTX_ struct symbol *f, struct symbol *fn, struct
 					degenerate(sctx_ expr);
 			}
 		} else if (!target->forced_arg){
-			static char where[30];
+			static TLS_ATTR char where[30];
 			examine_symbol_type(sctx_ target);
 			sprintf(where, "argument %d", i);
 			compatible_assignment_types(sctx_ expr, target, p, where);
@@ -2153,17 +2119,6 @@ static int evaluate_arguments(SCTX_ struct symbol *f, struct symbol *fn, struct
 	return 1;
 }
 
-static struct symbol *find_struct_ident(SCTX_ struct symbol *ctype, struct ident *ident)
-{
-	struct symbol *sym;
-
-	FOR_EACH_PTR(ctype->symbol_list, sym) {
-		if (sym->ident == ident)
-			return sym;
-	} END_FOR_EACH_PTR(sym);
-	return NULL;
-}
-
 static void convert_index(SCTX_ struct expression *e)
 {
 	struct expression *child = e->idx_expression;
@@ -2276,7 +2231,7 @@ static struct expression *check_designators(SCTX_ struct expression *e,
 				err = "field name not in struct or union";
 				break;
 			}
-			ctype = find_struct_ident(sctx_ ctype, e->expr_ident);
+			ctype = find_direct_member(sctx_ ctype, e->expr_ident);
 			if (!ctype) {
 				err = "unknown field name in";
 				break;
@@ -2855,7 +2810,7 @@ static struct symbol *evaluate_offsetof(SCTX_ struct expression *expr)
 			return NULL;
 		}
 
-		field = find_identifier(sctx_ expr->ident, ctype->symbol_list, &offset);
+		field = find_member(sctx_ ctype, expr->ident, &offset, NULL);
 		if (!field) {
 			expression_error(sctx_ expr, "unknown member");
 			return NULL;
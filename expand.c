@@ -36,6 +36,7 @@ static int expand_expression(SCTX_ struct expression *);
 static int expand_statement(SCTX_ struct statement *);
 #ifndef DO_CTX
 static int conservative;
+static struct symbol *expanding_fn;	/* whose body, or copy of it */
 #endif
 
 static int expand_symbol_expression(SCTX_ struct expression *expr)
@@ -150,7 +151,10 @@ Float:
 
 static int check_shift_count(SCTX_ struct expression *expr, struct symbol *ctype, unsigned int count)
 {
+	/* the count is fixed below, the copies inlined after this don't see it */
+	sctxp diag_once = 1;
 	warning(sctx_ expr->pos->pos, "shift too big (%u) for type %s", count, show_typename(sctx_ ctype));
+	sctxp diag_once = 0;
 	count &= ctype->bit_size-1;
 	return count;
 }
@@ -1034,6 +1038,154 @@ static void expand_const_expression(SCTX_ struct expression *expr, const char *w
 	}
 }
 
+struct case_range {
+	long long begin, end;
+	int nr;			/* in the source */
+	struct symbol *sym;
+};
+
+/* a case value converted to the type of the switch, in its order */
+static long long case_value(SCTX_ struct expression *expr, struct symbol *type)
+{
+	unsigned long long value = get_longlong(sctx_ expr);
+	int bits = type->bit_size;
+
+	if (bits < 64) {
+		unsigned long long mask = (1ULL << bits) - 1;
+
+		value &= mask;
+		if (!(type->ctype.modifiers & MOD_UNSIGNED) && (value >> (bits - 1)))
+			value |= ~mask;
+	} else if (type->ctype.modifiers & MOD_UNSIGNED) {
+		value ^= 1ULL << 63;
+	}
+	return value;
+}
+
+static int case_range_cmp(const void *_a, const void *_b)
+{
+	const struct case_range *a = _a, *b = _b;
+
+	if (a->begin != b->begin)
+		return a->begin < b->begin ? -1 : 1;
+	if (a->end != b->end)
+		return a->end < b->end ? -1 : 1;
+	return a->nr - b->nr;
+}
+
+/* a case that overlaps one before it in the source */
+struct case_overlap {
+	struct case_range *later, *first;
+};
+
+static int case_overlap_cmp(const void *_a, const void *_b)
+{
+	const struct case_overlap *a = _a, *b = _b;
+
+	if (a->later != b->later)
+		return a->later->nr - b->later->nr;
+	return a->first->nr - b->first->nr;
+}
+
+static void case_overlap(SCTX_ struct case_overlap *o)
+{
+	struct statement *later = o->later->sym->stmt, *first = o->first->sym->stmt;
+
+	if (o->later->begin == o->later->end && o->first->begin == o->first->end)
+		sparse_error(sctx_ later->case_expression->pos->pos, "duplicate case value");
+	else
+		sparse_error(sctx_ later->case_expression->pos->pos, "overlapping case ranges");
+	info(sctx_ first->case_expression->pos->pos, "previously used here");
+}
+
+/*
+ * Sort the cases of a switch by value, with the default, empty ranges
+ * and anything that isn't a constant after them, and diagnose the ones
+ * that overlap, once per function however often it is inlined. The
+ * sorted list saves linearize_switch() the sorting of
+ * its multijmps.
+ */
+static void expand_switch_cases(SCTX_ struct statement *stmt)
+{
+	struct symbol *type = stmt->switch_expression->ctype;
+	struct symbol_list *list = stmt->switch_case->symbol_list;
+	struct case_range *r, *reach = NULL;
+	struct case_overlap *overlap;
+	struct symbol **rest, *sym;
+	int nr = 0, nr_rest = 0, nr_overlap = 0, i;
+	int quiet = sctxp expanding_fn && sctxp expanding_fn->cases_checked;
+
+	if (type && type->type == SYM_NODE)
+		type = type->ctype.base_type;
+	if (!type || type->bit_size <= 0 || !list)
+		return;
+	/* the controlling expression is promoted */
+	if (type->bit_size < sctxp bits_in_int)
+		type = &sctxp int_ctype;
+
+	i = symbol_list_size(sctx_ list);
+	r = malloc(i * sizeof(*r));
+	rest = malloc(i * sizeof(*rest));
+	overlap = malloc(i * sizeof(*overlap));
+	sctxp diag_once = 1;
+	i = 0;
+	FOR_EACH_PTR(list, sym) {
+		struct expression *expr = sym->stmt->case_expression;
+		struct expression *to = sym->stmt->case_to;
+
+		i++;
+		if (!expr || expr->type != EXPR_VALUE || !expr->ctype ||
+		    (to && (to->type != EXPR_VALUE || !to->ctype))) {
+			rest[nr_rest++] = sym;
+			continue;
+		}
+		r[nr].begin = r[nr].end = case_value(sctx_ expr, type);
+		if (to) {
+			long long end = case_value(sctx_ to, type);
+
+			/* matches nothing, as in the back ends */
+			if (end < r[nr].begin) {
+				if (!quiet)
+					warning(sctx_ to->pos->pos, "empty case range");
+				rest[nr_rest++] = sym;
+				continue;
+			}
+			r[nr].end = end;
+		}
+		r[nr].nr = i;
+		r[nr].sym = sym;
+		nr++;
+	} END_FOR_EACH_PTR(sym);
+
+	qsort(r, nr, sizeof(*r), case_range_cmp);
+	for (i = 0; i < nr; i++) {
+		if (reach && r[i].begin <= reach->end) {
+			struct case_overlap *o = overlap + nr_overlap++;
+
+			o->later = r[i].nr > reach->nr ? r + i : reach;
+			o->first = r[i].nr > reach->nr ? reach : r + i;
+		}
+		if (!reach || r[i].end > reach->end)
+			reach = r + i;
+	}
+	/* in the order of the source, once per case and function */
+	qsort(overlap, nr_overlap, sizeof(*overlap), case_overlap_cmp);
+	for (i = 0; i < nr_overlap && !quiet; i++) {
+		if (!i || overlap[i].later != overlap[i - 1].later)
+			case_overlap(sctx_ overlap + i);
+	}
+	sctxp diag_once = 0;
+
+	i = 0;
+	FOR_EACH_PTR(list, sym) {
+		REPLACE_CURRENT_PTR(sym, i < nr ? r[i].sym : rest[i - nr]);
+		i++;
+	} END_FOR_EACH_PTR(sym);
+	free(r);
+	free(rest);
+	free(overlap);
+}
+
 int expand_symbol(SCTX_ struct symbol *sym)
 {
 	int retval;
@@ -1047,9 +1199,13 @@ int expand_symbol(SCTX_ struct symbol *sym)
 
 	retval = expand_expression(sctx_ sym->initializer);
 	/* expand the body of the symbol */
-	if (base_type->type == SYM_FN) {
-		if (base_type->stmt)
-			expand_statement(sctx_ base_type->stmt);
+	if (base_type->type == SYM_FN && base_type->stmt) {
+		struct symbol *fn = sctxp expanding_fn;
+
+		sctxp expanding_fn = base_type;
+		expand_statement(sctx_ base_type->stmt);
+		base_type->cases_checked = 1;
+		sctxp expanding_fn = fn;
 	}
 	return retval;
 }
@@ -1102,9 +1258,12 @@ static int expand_if_statement(SCTX_ struct statement *stmt)
  */
 static int expand_compound(SCTX_ struct statement *stmt)
 {
+	struct symbol *fn = sctxp expanding_fn;
 	struct statement *s, *last;
 	int cost, statements;
 
+	if (stmt->inline_fn)
+		sctxp expanding_fn = stmt->inline_fn->ctype.base_type;
 	if (stmt->ret)
 		expand_symbol(sctx_ stmt->ret);
 
@@ -1116,6 +1275,9 @@ static int expand_compound(SCTX_ struct statement *stmt)
 		last = s;
 		cost += expand_statement(sctx_ s);
 	} END_FOR_EACH_PTR(s);
+	if (stmt->inline_fn)
+		sctxp expanding_fn->cases_checked = 1;
+	sctxp expanding_fn = fn;
 
 	if (statements == 1 && !stmt->ret)
 		*stmt = *last;
@@ -1161,6 +1323,8 @@ static int expand_statement(SCTX_ struct statement *stmt)
 	case STMT_SWITCH:
 		expand_expression(sctx_ stmt->switch_expression);
 		expand_statement(sctx_ stmt->switch_statement);
+		if (stmt->switch_expression)
+			expand_switch_cases(sctx_ stmt);
 		return SIDE_EFFECTS;
 
 	case STMT_CASE:
@@ -96,10 +96,7 @@ static struct symbol *handle_func(SCTX_ struct token *token)
 	decl->namespace = NS_SYMBOL;
 
 	len = sctxp current_fn->ident->len;
-	string = __alloc_string(sctx_ len + 1);
-	memcpy(string->data, sctxp current_fn->ident->name, len);
-	string->data[len] = 0;
-	string->length = len + 1;
+	string = intern_string(sctx_ sctxp current_fn->ident->name, len);
 
 	decl->initializer = alloc_expression(sctx_ token, EXPR_STRING);
 	decl->initializer->string = string;
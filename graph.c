@@ -13,6 +13,7 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/wait.h>
 
 #include "lib.h"
 #include "allocate.h"
@@ -22,6 +23,12 @@
 #include "expression.h"
 #include "linearize.h"
 
+/* set for the workers of -j, so that their node names do not clash */
+static char prefix[16];
+
+/* -o -: the CSV goes to the standard output, the graph nowhere */
+static FILE *csv_stdout;
+
 
 /* Draw the subgraph for a given entrypoint. Includes details of loads
  * and stores for globals, and marks return bbs */
@@ -35,7 +42,7 @@ static void graph_ep(SCTX_ struct entrypoint *ep)
 	fname = show_ident(sctx_ ep->name->ident);
 	sname = stream_name(sctx_ ep->entry->bb->pos->pos.stream);
 
-	printf("subgraph cluster%p {\n"
+	printf("subgraph cluster%s%p {\n"
 	       "    color=blue;\n"
 	       "    label=<<TABLE BORDER=\"0\" CELLBORDER=\"0\">\n"
 	       "             <TR><TD>%s</TD></TR>\n"
@@ -43,8 +50,8 @@ static void graph_ep(SCTX_ struct entrypoint *ep)
 	       "           </TABLE>>;\n"
 	       "    file=\"%s\";\n"
 	       "    fun=\"%s\";\n"
-	       "    ep=bb%p;\n",
-	       ep, sname, fname, sname, fname, ep->entry->bb);
+	       "    ep=bb%s%p;\n",
+	       prefix, ep, sname, fname, sname, fname, prefix, ep->entry->bb);
 
 	FOR_EACH_PTR(ep->bbs, bb) {
 		struct basic_block *child;
@@ -52,8 +59,8 @@ static void graph_ep(SCTX_ struct entrypoint *ep)
 		const char * s = ", ls=\"[";
 
 		/* Node for the bb */
-		printf("    bb%p [shape=ellipse,label=%d,line=%d,col=%d",
-		       bb, bb->pos->pos.line, bb->pos->pos.line, bb->pos->pos.pos);
+		printf("    bb%s%p [shape=ellipse,label=%d,line=%d,col=%d",
+		       prefix, bb, bb->pos->pos.line, bb->pos->pos.line, bb->pos->pos.pos);
 
 
 		/* List loads and stores */
@@ -87,7 +94,7 @@ static void graph_ep(SCTX_ struct entrypoint *ep)
 
 		/* Edges between bbs; lower weight for upward edges */
 		FOR_EACH_PTR(bb->children, child) {
-			printf("    bb%p -> bb%p [op=br, %s];\n", bb, child,
+			printf("    bb%s%p -> bb%s%p [op=br, %s];\n", prefix, bb, prefix, child,
 			       (bb->pos->pos.line > child->pos->pos.line) ? "weight=5" : "weight=10");
 		} END_FOR_EACH_PTR(child);
 	} END_FOR_EACH_PTR(bb);
@@ -127,14 +134,14 @@ static void graph_calls(SCTX_ struct entrypoint *ep, int internal)
 					}
 
 					if (sym)
-						printf("bb%p -> bb%p"
+						printf("bb%s%p -> bb%s%p"
 						       "[label=%d,line=%d,col=%d,op=call,style=bold,weight=30];\n",
-						       bb, sym->ep->entry->bb,
+						       prefix, bb, prefix, sym->ep->entry->bb,
 						       insn->pos.line, insn->pos.line, insn->pos.pos);
 					else
-						printf("bb%p -> \"%s\" "
+						printf("bb%s%p -> \"%s\" "
 						       "[label=%d,line=%d,col=%d,op=extern,style=dashed];\n",
-						       bb, show_pseudo(sctx_ insn->func),
+						       prefix, bb, show_pseudo(sctx_ insn->func),
 						       insn->pos.line, insn->pos.line, insn->pos.pos);
 				}
 			}
@@ -142,45 +149,462 @@ static void graph_calls(SCTX_ struct entrypoint *ep, int internal)
 	} END_FOR_EACH_PTR(bb);
 }
 
+/*
+ * The project call graph: the functions defined in every unit and the
+ * direct calls they make, linked across units by name once all units
+ * are done. The workers of -j hand theirs over in a file each:
+ *
+ *	d <name> <static> <line> <entry node> <file>
+ *	c <caller> <extern> <callee> <line> <col> <calling node>
+ *
+ * fields separated by tabs, <caller> counting the 'd' lines from 0.
+ */
+struct fn_def {
+	char *name, *file, *entry;
+	int line, is_static, unit;
+};
+
+struct fn_call {
+	int caller;		/* in defs[] */
+	int is_extern;
+	char *callee, *node;
+	int line, col;
+};
+
+static struct fn_def *defs;
+static struct fn_call *calls;
+static int nr_defs, nr_calls, alloc_defs, alloc_calls;
+
+static void add_def(const char *name, const char *file, int line, int is_static,
+		    const char *entry, int unit)
+{
+	struct fn_def *d;
+
+	if (nr_defs == alloc_defs) {
+		alloc_defs = alloc_defs ? alloc_defs * 2 : 256;
+		defs = realloc(defs, alloc_defs * sizeof(*defs));
+	}
+	d = defs + nr_defs++;
+	d->name = strdup(name);
+	d->file = strdup(file);
+	d->entry = strdup(entry);
+	d->line = line;
+	d->is_static = is_static;
+	d->unit = unit;
+}
+
+static void add_call(int caller, int is_extern, const char *callee, int line, int col,
+		     const char *node)
+{
+	struct fn_call *c;
+
+	if (nr_calls == alloc_calls) {
+		alloc_calls = alloc_calls ? alloc_calls * 2 : 1024;
+		calls = realloc(calls, alloc_calls * sizeof(*calls));
+	}
+	c = calls + nr_calls++;
+	c->caller = caller;
+	c->is_extern = is_extern;
+	c->callee = strdup(callee);
+	c->node = strdup(node);
+	c->line = line;
+	c->col = col;
+}
+
+static void record_unit(SCTX_ struct symbol_list *fsyms, int unit)
+{
+	struct symbol *sym;
+	char node[64];
+
+	FOR_EACH_PTR(fsyms, sym) {
+		struct entrypoint *ep = sym->ep;
+		struct basic_block *bb;
+		struct instruction *insn;
+		int caller = nr_defs;
+
+		if (!ep)
+			continue;
+		snprintf(node, sizeof(node), "bb%s%p", prefix, ep->entry->bb);
+		add_def(show_ident(sctx_ sym->ident), stream_name(sctx_ sym->pos->pos.stream),
+			sym->pos->pos.line, !!(sym->ctype.modifiers & MOD_STATIC), node, unit);
+
+		FOR_EACH_PTR(ep->bbs, bb) {
+			if (!bb)
+				continue;
+			FOR_EACH_PTR(bb->insns, insn) {
+				if (insn->opcode != OP_CALL || insn->func->type != PSEUDO_SYM)
+					continue;
+				snprintf(node, sizeof(node), "bb%s%p", prefix, bb);
+				add_call(caller, !!(insn->func->sym->ctype.modifiers & MOD_EXTERN),
+					 show_ident(sctx_ insn->func->sym->ident),
+					 insn->pos.line, insn->pos.pos, node);
+			} END_FOR_EACH_PTR(insn);
+		} END_FOR_EACH_PTR(bb);
+	} END_FOR_EACH_PTR(sym);
+}
+
+static int write_records(const char *name)
+{
+	FILE *f = fopen(name, "w");
+	int i;
+
+	if (!f)
+		return 1;
+	for (i = 0; i < nr_defs; i++)
+		fprintf(f, "d\t%s\t%d\t%d\t%s\t%s\n", defs[i].name, defs[i].is_static,
+			defs[i].line, defs[i].entry, defs[i].file);
+	for (i = 0; i < nr_calls; i++)
+		fprintf(f, "c\t%d\t%d\t%s\t%d\t%d\t%s\n", calls[i].caller, calls[i].is_extern,
+			calls[i].callee, calls[i].line, calls[i].col, calls[i].node);
+	return ferror(f) | fclose(f);
+}
+
+static int read_records(const char *name, int unit)
+{
+	FILE *f = fopen(name, "r");
+	int first = nr_defs, a, b, c;
+	char *line = NULL, *field[7];
+	size_t alloc = 0;
+	ssize_t n;
+
+	if (!f)
+		return 1;
+	while ((n = getline(&line, &alloc, f)) > 0) {
+		char *p = line;
+		int nr = 0;
+
+		if (line[n - 1] == '\n')
+			line[n - 1] = 0;
+		while (nr < 7 && (field[nr] = strsep(&p, "\t")))
+			nr++;
+		if (nr == 6 && *field[0] == 'd') {
+			a = atoi(field[2]);
+			b = atoi(field[3]);
+			add_def(field[1], field[5], b, a, field[4], unit);
+		} else if (nr == 7 && *field[0] == 'c') {
+			a = atoi(field[1]);
+			b = atoi(field[2]);
+			c = atoi(field[4]);
+			add_call(first + a, b, field[3], c, atoi(field[5]), field[6]);
+		}
+	}
+	free(line);
+	fclose(f);
+	return 0;
+}
+
+static int cmp_def(const void *a, const void *b)
+{
+	const struct fn_def *x = *(const struct fn_def * const *)a;
+	const struct fn_def *y = *(const struct fn_def * const *)b;
+	int r = strcmp(x->name, y->name);
+
+	if (r)
+		return r;
+	return x - y < 0 ? -1 : x != y;
+}
+
+static struct fn_def **by_name;
+
+/* the definition a call reaches: one in the caller's unit, else a global one */
+static struct fn_def *resolve(struct fn_call *call)
+{
+	struct fn_def key = { .name = call->callee }, *k = &key, *global = NULL;
+	int lo = 0, hi = nr_defs, unit = defs[call->caller].unit;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (strcmp(by_name[mid]->name, k->name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < nr_defs && !strcmp(by_name[lo]->name, k->name); lo++) {
+		if (by_name[lo]->unit == unit)
+			return by_name[lo];
+		if (!by_name[lo]->is_static && !global)
+			global = by_name[lo];
+	}
+	return global;
+}
+
+static void link_calls(void)
+{
+	int i;
+
+	by_name = malloc((nr_defs + 1) * sizeof(*by_name));
+	for (i = 0; i < nr_defs; i++)
+		by_name[i] = defs + i;
+	qsort(by_name, nr_defs, sizeof(*by_name), cmp_def);
+}
+
+/* the inter-file edges of the dot output, as graph_calls() draws them */
+static void graph_extern_calls(void)
+{
+	int i;
+
+	for (i = 0; i < nr_calls; i++) {
+		struct fn_call *c = calls + i;
+		struct fn_def *d;
+
+		if (!c->is_extern)
+			continue;
+		d = resolve(c);
+		if (d)
+			printf("%s -> %s"
+			       "[label=%d,line=%d,col=%d,op=call,style=bold,weight=30];\n",
+			       c->node, d->entry, c->line, c->line, c->col);
+		else
+			printf("%s -> \"%s\" "
+			       "[label=%d,line=%d,col=%d,op=extern,style=dashed];\n",
+			       c->node, c->callee, c->line, c->line, c->col);
+	}
+}
+
+struct edge {
+	int caller;
+	struct fn_def *callee;
+	const char *name;	/* when there is no definition */
+	int count;
+};
+
+static int cmp_edge(const void *a, const void *b)
+{
+	const struct edge *x = a, *y = b;
+
+	if (x->caller != y->caller)
+		return x->caller < y->caller ? -1 : 1;
+	if (x->callee != y->callee)
+		return !x->callee ? 1 : !y->callee ? -1 : x->callee < y->callee ? -1 : 1;
+	return x->callee ? 0 : strcmp(x->name, y->name);
+}
+
+static void csv_field(FILE *f, const char *s)
+{
+	if (!strpbrk(s, ",\"\n")) {
+		fputs(s, f);
+		return;
+	}
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"')
+			fputc('"', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+/* one line per caller and callee, with the number of call sites */
+static int write_csv(const char *name)
+{
+	struct edge *edges = malloc((nr_calls + 1) * sizeof(*edges));
+	FILE *f = strcmp(name, "-") ? fopen(name, "w") : csv_stdout;
+	int i, n;
+
+	if (!f)
+		return 1;
+	for (i = 0; i < nr_calls; i++) {
+		edges[i].caller = calls[i].caller;
+		edges[i].callee = resolve(calls + i);
+		edges[i].name = calls[i].callee;
+		edges[i].count = 1;
+	}
+	qsort(edges, nr_calls, sizeof(*edges), cmp_edge);
+	for (i = n = 0; i < nr_calls; i++) {
+		if (n && !cmp_edge(edges + n - 1, edges + i))
+			edges[n - 1].count++;
+		else
+			edges[n++] = edges[i];
+	}
+
+	fprintf(f, "caller,caller_file,caller_line,callee,callee_file,callee_line,calls\n");
+	for (i = 0; i < n; i++) {
+		struct fn_def *caller = defs + edges[i].caller, *callee = edges[i].callee;
+
+		csv_field(f, caller->name);
+		fputc(',', f);
+		csv_field(f, caller->file);
+		fprintf(f, ",%d,", caller->line);
+		csv_field(f, callee ? callee->name : edges[i].name);
+		fputc(',', f);
+		csv_field(f, callee ? callee->file : "");
+		fprintf(f, ",%d,%d\n", callee ? callee->line : 0, edges[i].count);
+	}
+	free(edges);
+	return ferror(f) | fclose(f);
+}
+
+static struct symbol_list *graph_file(SCTX_ char *file)
+{
+	struct symbol_list *fsyms;
+	struct symbol *sym;
+
+	fsyms = sparse(sctx_ file);
+	FOR_EACH_PTR(fsyms, sym) {
+		expand_symbol(sctx_ sym);
+		linearize_symbol(sctx_ sym);
+	} END_FOR_EACH_PTR(sym);
+
+	FOR_EACH_PTR(fsyms, sym) {
+		if (sym->ep) {
+			graph_ep(sctx_ sym->ep);
+			graph_calls(sctx_ sym->ep, 1);
+		}
+	} END_FOR_EACH_PTR_NOTAG(sym);
+	return fsyms;
+}
+
+static char *part_name(const char *dir, int unit, const char *ext)
+{
+	char *name = malloc(strlen(dir) + 32);
+
+	sprintf(name, "%s/%d.%s", dir, unit, ext);
+	return name;
+}
+
+/*
+ * Every file is done by a process of its own, 'jobs' at a time. The
+ * parts are put together in the order of the files once all are done.
+ */
+static int graph_parallel(SCTX_ struct string_list *filelist, int jobs)
+{
+	char dir[] = "/tmp/graphXXXXXX", *file, *name, buf[8192];
+	int nr = ptr_list_size(sctx_ (struct ptr_list *)filelist);
+	int *status = calloc(nr, sizeof(int)), *pids = calloc(nr, sizeof(int));
+	int unit = 0, running = 0, i, ret = 0;
+	size_t len;
+	FILE *f;
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	fflush(NULL);
+	FOR_EACH_PTR_NOTAG(filelist, file) {
+		int pid, st;
+
+		if (running == jobs) {
+			pid = wait(&st);
+			for (i = 0; i < unit && pids[i] != pid; i++)
+				;
+			if (i < unit)
+				status[i] = st;
+			running--;
+		}
+		pid = fork();
+		if (!pid) {
+			snprintf(prefix, sizeof(prefix), "%d_", unit);
+			name = part_name(dir, unit, "dot");
+			if (!freopen(name, "w", stdout))
+				_exit(1);
+			record_unit(sctx_ graph_file(sctx_ file), unit);
+			if (fflush(stdout))
+				_exit(1);
+			_exit(write_records(part_name(dir, unit, "calls")));
+		}
+		if (pid < 0) {
+			perror("fork");
+			status[unit] = -1;
+		} else {
+			pids[unit] = pid;
+			running++;
+		}
+		unit++;
+	} END_FOR_EACH_PTR_NOTAG(file);
+	while (running > 0) {
+		int st, pid = wait(&st);
+
+		if (pid < 0)
+			break;
+		for (i = 0; i < unit && pids[i] != pid; i++)
+			;
+		if (i < unit)
+			status[i] = st;
+		running--;
+	}
+
+	i = 0;
+	FOR_EACH_PTR_NOTAG(filelist, file) {
+		char *calls = part_name(dir, i, "calls");
+
+		name = part_name(dir, i, "dot");
+		if (status[i] || read_records(calls, i)) {
+			fprintf(stderr, "graph: %s failed\n", file);
+			ret = 1;
+		} else if ((f = fopen(name, "r"))) {
+			while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+				fwrite(buf, 1, len, stdout);
+			fclose(f);
+		}
+		unlink(name);
+		unlink(calls);
+		free(name);
+		free(calls);
+		i++;
+	} END_FOR_EACH_PTR_NOTAG(file);
+	rmdir(dir);
+	free(status);
+	free(pids);
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	struct string_list *filelist = NULL;
 	char *file;
 	struct symbol *sym;
 	struct symbol_list *fsyms, *all_syms=NULL;
+	const char *csv = NULL;
+	int i, j, jobs = 1, unit = 0, ret = 0;
 	SPARSE_CTX_INIT;
 
+	for (i = j = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			csv = argv[++i];
+		else if (!strncmp(argv[i], "-j", 2) && (argv[i][2] || i + 1 < argc))
+			jobs = parse_jobs(sctx_ argv[i][2] ? argv[i] + 2 : argv[++i]);
+		else
+			argv[j++] = argv[i];
+	}
+	argv[j] = NULL;
+	argc = j;
+
+	if (csv && !strcmp(csv, "-")) {
+		csv_stdout = fdopen(dup(1), "w");
+		if (!csv_stdout || !freopen("/dev/null", "w", stdout))
+			sparse_die(sctx_ "can't write the call graph to the standard output");
+	}
+
 	printf("digraph call_graph {\n");
 	fsyms = sparse_initialize(sctx_ argc, argv, &filelist);
 	concat_symbol_list(sctx_ fsyms, &all_syms);
 
-	/* Linearize all symbols, graph internal basic block
-	 * structures and intra-file calls */
-	FOR_EACH_PTR_NOTAG(filelist, file) {
-
-		fsyms = sparse(sctx_ file);
-		concat_symbol_list(sctx_ fsyms, &all_syms);
-
-		FOR_EACH_PTR(fsyms, sym) {
-			expand_symbol(sctx_ sym);
-			linearize_symbol(sctx_ sym);
-		} END_FOR_EACH_PTR(sym);
+	if (jobs > 1) {
+		ret = graph_parallel(sctx_ filelist, jobs);
+		link_calls();
+		graph_extern_calls();
+	} else {
+		/* Linearize all symbols, graph internal basic block
+		 * structures and intra-file calls */
+		FOR_EACH_PTR_NOTAG(filelist, file) {
+			fsyms = graph_file(sctx_ file);
+			concat_symbol_list(sctx_ fsyms, &all_syms);
+			if (csv)
+				record_unit(sctx_ fsyms, unit++);
+		} END_FOR_EACH_PTR_NOTAG(file);
 
-		FOR_EACH_PTR(fsyms, sym) {
-			if (sym->ep) {
-				graph_ep(sctx_ sym->ep);
-				graph_calls(sctx_ sym->ep, 1);
-			}
+		/* Graph inter-file calls */
+		FOR_EACH_PTR(all_syms, sym) {
+			if (sym->ep)
+				graph_calls(sctx_ sym->ep, 0);
 		} END_FOR_EACH_PTR_NOTAG(sym);
-
-	} END_FOR_EACH_PTR_NOTAG(file);
-
-	/* Graph inter-file calls */
-	FOR_EACH_PTR(all_syms, sym) {
-		if (sym->ep)
-			graph_calls(sctx_ sym->ep, 0);
-	} END_FOR_EACH_PTR_NOTAG(sym);
+		link_calls();
+	}
 
 	printf("}\n");
-	return 0;
+	if (csv && write_csv(csv)) {
+		fprintf(stderr, "%s: can't write the call graph\n", csv);
+		ret = 1;
+	}
+	return ret;
 }
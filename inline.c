@@ -56,6 +56,8 @@ static struct symbol_list *copy_symbol_list(SCTX_ struct symbol_list *src)
 	return dst;
 }
 
+static struct statement *copy_one_statement(SCTX_ struct statement *stmt);
+
 static struct expression * copy_expression(SCTX_ struct expression *expr)
 {
 	if (!expr)
@@ -95,6 +97,8 @@ static struct expression * copy_expression(SCTX_ struct expression *expr)
 
 	case EXPR_SLICE: {
 		struct expression *base = copy_expression(sctx_ expr->base);
+		if (base == expr->base)
+			break;
 		expr = dup_expression(sctx_ expr);
 		expr->base = base;
 		break;
@@ -175,8 +179,9 @@ static struct expression * copy_expression(SCTX_ struct expression *expr)
 
 	/* Statement expression */
 	case EXPR_STATEMENT: {
-		struct statement *stmt = alloc_statement(sctx_ expr->tok, STMT_COMPOUND);
-		copy_statement(sctx_ expr->statement, stmt);
+		struct statement *stmt = copy_one_statement(sctx_ expr->statement);
+		if (stmt == expr->statement)
+			break;
 		expr = dup_expression(sctx_ expr);
 		expr->statement = stmt;
 		break;
@@ -308,6 +313,30 @@ static void unset_replace_list(SCTX_ struct symbol_list *list)
 	} END_FOR_EACH_PTR(sym);
 }
 
+/*
+ * Copy a statement list, but hand back the original list
+ * if none of the statements needed replacing: blocks that
+ * don't touch any argument or local of the inline function
+ * are shared between all the inlined copies.
+ */
+static struct statement_list *copy_statement_list(SCTX_ struct statement_list *src)
+{
+	struct statement_list *dst = NULL;
+	struct statement *stmt;
+	int changed = 0;
+
+	FOR_EACH_PTR(src, stmt) {
+		struct statement *newstmt = copy_one_statement(sctx_ stmt);
+		if (newstmt != stmt)
+			changed = 1;
+		add_statement(sctx_ &dst, newstmt);
+	} END_FOR_EACH_PTR(stmt);
+	if (changed)
+		return dst;
+	free_ptr_list(&dst);
+	return src;
+}
+
 static struct statement *copy_one_statement(SCTX_ struct statement *stmt)
 {
 	if (!stmt)
@@ -346,9 +375,15 @@ static struct statement *copy_one_statement(SCTX_ struct statement *stmt)
 		break;
 	}
 	case STMT_COMPOUND: {
-		struct statement *new = alloc_statement(sctx_ stmt->tok, STMT_COMPOUND);
-		copy_statement(sctx_ stmt, new);
-		stmt = new;
+		struct statement_list *stmts = copy_statement_list(sctx_ stmt->stmts);
+		struct statement *args = copy_one_statement(sctx_ stmt->args);
+		struct symbol *ret = copy_symbol(sctx_ stmt->pos->pos, stmt->ret);
+		if (stmts == stmt->stmts && args == stmt->args && ret == stmt->ret)
+			break;
+		stmt = dup_statement(sctx_ stmt);
+		stmt->stmts = stmts;
+		stmt->args = args;
+		stmt->ret = ret;
 		break;
 	}
 	case STMT_IF: {
@@ -55,7 +55,7 @@ struct token *skip_to(SCTX_ struct token *token, int op)
 struct token *expect(SCTX_ struct token *token, int op, const char *where)
 {
 	if (!match_op(token, op)) {
-		static struct token bad_token;
+		static TLS_ATTR struct token bad_token;
 		if (token != &bad_token) {
 			bad_token.next = token;
 			sparse_error(sctx_ token->pos, "Expected %s %s", show_special(sctx_ op), where);
@@ -85,31 +85,109 @@ unsigned int hexval(SCTX_ unsigned int c)
 	return retval;
 }
 
-static void do_warn(SCTX_ const char *type, struct position pos, const char * fmt, va_list args)
+static const char *diag_type[] = {
+	[DIAG_INFO] = "",
+	[DIAG_WARNING] = "warning: ",
+	[DIAG_ERROR] = "error: ",
+};
+
+static void do_warn(SCTX_ int kind, struct position pos, const char * fmt, va_list args)
 {
-	static char buffer[512];
+	static TLS_ATTR char buffer[512];
 	const char *name;
 
 	vsprintf(buffer, fmt, args);	
 	name = stream_name(sctx_ pos.stream);
 		
+	if (sctxp diag_file) {
+		static TLS_ATTR char line[1024];
+		struct diagnostic d = { pos, kind, 0, sctxp diag_order, sctxp diag_once };
+
+		d.len = snprintf(line, sizeof(line), "%s:%d:%d: %s%s",
+			name, pos.line, pos.pos, diag_type[kind], buffer);
+		if (d.len >= (int)sizeof(line))
+			d.len = sizeof(line) - 1;
+		fwrite(&d, sizeof(d), 1, sctxp diag_file);
+		fwrite(line, d.len, 1, sctxp diag_file);
+		return;
+	}
 	fprintf(stderr, "%s:%d:%d: %s%s\n",
-		name, pos.line, pos.pos, type, buffer);
+		name, pos.line, pos.pos, diag_type[kind], buffer);
 }
 
 #ifndef DO_CTX
+static int pp_printed = 0;
 static int max_warnings = 100;
 static int show_info = 1;
+static int errors = 0;
+static int too_many_errors = 0;
+static FILE *diag_file = NULL;
+static long long diag_order = 0;
+static int diag_once = 0;
+static void (*die_hook)(void) = NULL;
 #endif
 
+/*
+ * Whether a diagnostic is shown: warnings stop after max_warnings and
+ * after the first error, errors after 100. *fmt may become the message
+ * that says so. Whatever goes to diag_file is only limited when it is
+ * shown, see show_diagnostic().
+ */
+static int diag_shown(SCTX_ int kind, const char **fmt)
+{
+	switch (kind) {
+	case DIAG_INFO:
+		return sctxp show_info;
+
+	case DIAG_WARNING:
+		if (!sctxp max_warnings) {
+			sctxp show_info = 0;
+			return 0;
+		}
+		if (!--sctxp max_warnings) {
+			sctxp show_info = 0;
+			*fmt = "too many warnings";
+		}
+		return 1;
+
+	default:
+		sctxp die_if_error = 1;
+		sctxp show_info = 1;
+		/* Shut up warnings after an error */
+		sctxp max_warnings = 0;
+		if (sctxp errors > 100) {
+			sctxp show_info = 0;
+			if (sctxp too_many_errors)
+				return 0;
+			*fmt = "too many errors";
+			sctxp too_many_errors = 1;
+		}
+		sctxp errors++;
+		return 1;
+	}
+}
+
+void show_diagnostic(SCTX_ const struct diagnostic *d, const char *text)
+{
+	const char *fmt = NULL;
+
+	if (!diag_shown(sctx_ d->kind, &fmt))
+		return;
+	if (fmt)
+		fprintf(stderr, "%s:%d:%d: %s%s\n", stream_name(sctx_ d->pos.stream),
+			d->pos.line, d->pos.pos, diag_type[d->kind], fmt);
+	else
+		fprintf(stderr, "%.*s\n", d->len, text);
+}
+
 void info(SCTX_ struct position pos, const char * fmt, ...)
 {
 	va_list args;
 
-	if (!sctxp show_info)
+	if (!sctxp diag_file && !diag_shown(sctx_ DIAG_INFO, &fmt))
 		return;
 	va_start(args, fmt);
-	do_warn(sctx_ "", pos, fmt, args);
+	do_warn(sctx_ DIAG_INFO, pos, fmt, args);
 	va_end(args);
 }
 
@@ -117,39 +195,18 @@ void warning(SCTX_ struct position pos, const char * fmt, ...)
 {
 	va_list args;
 
-	if (!sctxp max_warnings) {
-		sctxp show_info = 0;
+	if (!sctxp diag_file && !diag_shown(sctx_ DIAG_WARNING, &fmt))
 		return;
-	}
-
-	if (!--sctxp max_warnings) {
-		sctxp show_info = 0;
-		fmt = "too many warnings";
-	}
-
 	va_start(args, fmt);
-	do_warn(sctx_ "warning: ", pos, fmt, args);
+	do_warn(sctx_ DIAG_WARNING, pos, fmt, args);
 	va_end(args);
 }	
 
 static void do_error(SCTX_ struct position pos, const char * fmt, va_list args)
 {
-	static int errors = 0;
-        sctxp die_if_error = 1;
-	sctxp show_info = 1;
-	/* Shut up warnings after an error */
-	sctxp max_warnings = 0;
-	if (errors > 100) {
-		static int once = 0;
-		sctxp show_info = 0;
-		if (once)
-			return;
-		fmt = "too many errors";
-		once = 1;
-	}
-
-	do_warn(sctx_ "error: ", pos, fmt, args);
-	errors++;
+	if (!sctxp diag_file && !diag_shown(sctx_ DIAG_ERROR, &fmt))
+		return;
+	do_warn(sctx_ DIAG_ERROR, pos, fmt, args);
 }	
 
 void sparse_error(SCTX_ struct position pos, const char * fmt, ...)
@@ -172,22 +229,29 @@ void expression_error(SCTX_ struct expression *expr, const char *fmt, ...)
 void error_die(SCTX_ struct position pos, const char * fmt, ...) 
 {
 	va_list args;
+
+	/* right away, a fatal error doesn't wait for the -j replay */
+	sctxp diag_file = NULL;
 	va_start(args, fmt);
-	do_warn(sctx_ "error: ", pos, fmt, args);
+	do_warn(sctx_ DIAG_ERROR, pos, fmt, args);
 	va_end(args);
+	if (sctxp die_hook)
+		sctxp die_hook(sctx);
 	exit(1);
 }
 
 void sparse_die(SCTX_ const char *fmt, ...) 
 {
 	va_list args;
-	static char buffer[512];
+	static TLS_ATTR char buffer[512];
 
 	va_start(args, fmt);
 	vsnprintf(buffer, sizeof(buffer), fmt, args);
 	va_end(args);
 
 	fprintf(stderr, "%s\n", buffer);
+	if (sctxp die_hook)
+		sctxp die_hook(sctx);
 	exit(1);
 }
 
@@ -224,6 +288,7 @@ int dbg_entry = 0;
 int dbg_dead = 0;
 
 int preprocess_only;
+int jobs;
 
 enum standard_enum standard = STANDARD_GNU89;
 
@@ -591,9 +656,13 @@ static char **handle_switch_f(SCTX_ char *arg, char **next)
 	/* handle switches w/ arguments above, boolean and only boolean below */
 
 	if (!strncmp(arg, "no-", 3)) {
+		if (!strcmp(arg + 3, "incremental"))
+			sctxp incremental = 0;
 		arg += 3;
 	}
 	/* handle switch here.. */
+	if (!strcmp(arg, "incremental"))
+		sctxp incremental = 1;
 	return next;
 }
 
@@ -605,6 +674,26 @@ static char **handle_switch_G(SCTX_ char *arg, char **next)
 		return next;     // "-G0" or (bogus) terminal "-G"
 }
 
+/* the N of -j N, for sparse and the tools that fork or run threads */
+int parse_jobs(SCTX_ const char *arg)
+{
+	char *end;
+	long n;
+
+	if (!arg)
+		sparse_die(sctx_ "missing argument for -j option");
+	n = strtol(arg, &end, 10);
+	if (end == arg || *end || n < 1 || n > MAX_JOBS)
+		sparse_die(sctx_ "bad argument for -j option: '%s', 1 to %d", arg, MAX_JOBS);
+	return n;
+}
+
+static char **handle_switch_j(SCTX_ char *arg, char **next)
+{
+	sctxp jobs = parse_jobs(sctx_ arg[1] ? arg + 1 : *++next);
+	return next;
+}
+
 static char **handle_switch_a(SCTX_ char *arg, char **next)
 {
 	if (!strcmp (arg, "ansi"))
@@ -665,6 +754,16 @@ static char **handle_version(SCTX_ char *arg, char **next)
 	exit(0);
 }
 
+static char **handle_server(SCTX_ char *arg, char **next)
+{
+	sctxp server_socket = *++next;
+	if (!sctxp server_socket)
+		sparse_die(sctx_ "missing argument for --server option");
+	/* a server sees the same headers over and over */
+	sctxp incremental = 1;
+	return next;
+}
+
 struct switches {
 	const char *name;
 	char **(*fn)(SCTX_ char *, char **);
@@ -674,6 +773,7 @@ static char **handle_long_options(SCTX_ char *arg, char **next)
 {
 	static struct switches cmd[] = {
 		{ "version", handle_version },
+		{ "server", handle_server },
 		{ NULL, NULL }
 	};
 	struct switches *s = cmd;
@@ -710,6 +810,7 @@ static char **handle_switch(SCTX_ char *arg, char **next)
 	case 'O': return handle_switch_O(sctx_ arg, next);
 	case 'f': return handle_switch_f(sctx_ arg, next);
 	case 'G': return handle_switch_G(sctx_ arg, next);
+	case 'j': return handle_switch_j(sctx_ arg, next);
 	case 'a': return handle_switch_a(sctx_ arg, next);
 	case 's': return handle_switch_s(sctx_ arg, next);
 	case '-': return handle_long_options(sctx_ arg + 1, next);
@@ -903,34 +1004,58 @@ void create_builtin_stream(SCTX)
 	add_pre_buffer(sctx_ sctxp stream_sb->id, "#weak_define __SIZEOF_POINTER__ " SPARSE_STRINGIFY(__SIZEOF_POINTER__) "\n");
 }
 
+/* print the whitespace -E puts in front of 'token' */
+static void show_separator(SCTX_ struct token *token)
+{
+	int prec = 1;
+	const char *separator = "";
+
+	if (token->pos.whitespace)
+		separator = " ";
+	if (token->pos.newline) {
+		separator = "\n\t\t\t\t\t";
+		prec = token->pos.pos;
+		if (prec > 4)
+			prec = 4;
+	}
+	printf("%.*s", prec, separator);
+}
+
+static void emit_token(SCTX_ struct token *token)
+{
+	if (sctxp pp_printed)
+		show_separator(sctx_ token);
+	printf("%s", show_token(sctx_ token));
+	sctxp pp_printed = 1;
+}
+
 static struct symbol_list *sparse_tokenstream(SCTX_ struct expansion *e)
 {
 	struct token *token;
-	// Preprocess the stream
-	token = preprocess(sctx_ e);
 
-	sctxp pp_tokenlist = token;
+	// -E prints the tokens while they are being preprocessed
 	if (sctxp preprocess_only) {
-	        while (!eof_token(token)) {
-			int prec = 1;
-			struct token *next = token->next;
-			const char *separator = "";
-			if (next->pos.whitespace)
-				separator = " ";
-			if (next->pos.newline) {
-				separator = "\n\t\t\t\t\t";
-				prec = next->pos.pos;
-				if (prec > 4)
-					prec = 4;
-			}
-			printf("%s%.*s", show_token(sctx_ token), prec, separator);
-			token = next;
-		}
+		sctxp pp_printed = 0;
+		sctxp pp_emit = emit_token;
+		/* nothing keeps what -E is done with, see pp_traced() */
+		sctxp token_allocator.nofree = 0;
+		sctxp expansion_allocator.nofree = 0;
+		token = preprocess(sctx_ e);
+		sctxp token_allocator.nofree = 1;
+		sctxp expansion_allocator.nofree = 1;
+		sctxp pp_emit = NULL;
+		sctxp pp_tokenlist = token;
+		if (sctxp pp_printed)
+			show_separator(sctx_ token);
 		putchar('\n');
 
 		return NULL;
 	}
 
+	// Preprocess the stream
+	token = preprocess(sctx_ e);
+	sctxp pp_tokenlist = token;
+
 	// Parse the resulting C code
 	while (!eof_token(token))
 		token = external_declaration(sctx_ token, &sctxp translation_unit_used_list);
@@ -1009,7 +1134,7 @@ struct symbol_list *sparse_initialize(SCTX_ int argc, char **argv, struct string
 	handle_arch_finalize(sctx);
 
 	list = NULL;
-	if (!ptr_list_empty(filelist)) {
+	if (!ptr_list_empty(filelist) || sctxp server_socket) {
 		// Initialize type system
 		init_ctype(sctx);
 
@@ -1036,6 +1161,10 @@ struct symbol_list * sparse_keep_tokens(SCTX_ char *filename)
 	/* Clear previous symbol list */
 	sctxp translation_unit_used_list = NULL;
 
+	/* Streams of earlier files may be recycled by -fincremental */
+	sctxp first_tu_stream = sctxp input_stream_nr;
+	sctxp unit_nr++;
+
 	new_file_scope(sctx );
 	res = sparse_file(sctx_ filename);
 
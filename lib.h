@@ -2,6 +2,7 @@
 #define LIB_H
 
 #include "ctx_def.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
 
@@ -46,6 +47,21 @@ struct position {
 		     noexpand:1;
 };
 
+enum diag_kind {
+	DIAG_INFO,
+	DIAG_WARNING,
+	DIAG_ERROR,
+};
+
+/* a record of diag_file: do_warn() writes the line there, not to stderr */
+struct diagnostic {
+	struct position pos;
+	int kind;
+	int len;		/* the text follows, no '\0' */
+	long long order;	/* diag_order when it was written */
+	int once;		/* diag_once: once per function, not per copy */
+};
+
 struct ident;
 struct token;
 struct symbol;
@@ -74,10 +90,12 @@ struct token *expect(SCTX_ struct token *, int, const char *);
 #define FORMAT_ATTR(pos) __attribute__ ((__format__ (__printf__, pos, pos+1)))
 #define NORETURN_ATTR __attribute__ ((__noreturn__))
 #define SENTINEL_ATTR __attribute__ ((__sentinel__))
+#define TLS_ATTR __thread	/* scratch buffers, contexts may run in parallel */
 #else
 #define FORMAT_ATTR(pos)
 #define NORETURN_ATTR
 #define SENTINEL_ATTR
+#define TLS_ATTR
 #endif
 extern void sparse_die(SCTX_ const char *, ...);
 extern void info(SCTX_ struct position, const char *, ...) FORMAT_ATTR(2+SCTXCNT);
@@ -85,11 +103,13 @@ extern void warning(SCTX_ struct position, const char *, ...) FORMAT_ATTR(2+SCTX
 extern void sparse_error(SCTX_ struct position, const char *, ...) FORMAT_ATTR(2+SCTXCNT);
 extern void error_die(SCTX_ struct position, const char *, ...);
 extern void expression_error(SCTX_ struct expression *, const char *, ...) FORMAT_ATTR(2+SCTXCNT);
+extern void show_diagnostic(SCTX_ const struct diagnostic *, const char *);
 
 extern void add_pre_buffer(SCTX_ int idx, const char *fmt, ...) FORMAT_ATTR(2+SCTXCNT);
 
 #ifndef DO_CTX
 extern int preprocess_only;
+extern int jobs;
 
 extern int Waddress_space;
 extern int Wbitwise;
@@ -126,6 +146,8 @@ extern int arch_msize_long;
 extern void declare_builtin_functions(SCTX);
 extern void create_builtin_stream(SCTX);
 extern struct symbol_list *sparse_initialize(SCTX_ int argc, char **argv, struct string_list **files);
+#define MAX_JOBS	1024
+extern int parse_jobs(SCTX_ const char *arg);
 extern struct symbol_list *__sparse(SCTX_ char *filename);
 extern struct symbol_list *sparse_keep_tokens(SCTX_ char *filename);
 extern struct symbol_list *sparse(SCTX_ char *filename);
@@ -170,6 +192,11 @@ static inline struct instruction * delete_last_instruction(SCTX_ struct instruct
 	return undo_ptr_list_last(sctx_ (struct ptr_list **)head);
 }
 
+static inline struct symbol * delete_last_symbol(SCTX_ struct symbol_list **head)
+{
+	return delete_ptr_list_last(sctx_ (struct ptr_list **)head);
+}
+
 static inline struct basic_block * delete_last_basic_block(SCTX_ struct basic_block_list **head)
 {
 	return delete_ptr_list_last(sctx_ (struct ptr_list **)head);
@@ -72,10 +72,11 @@ static struct basic_block *alloc_basic_block(SCTX_ struct entrypoint *ep, struct
 	bb->context = -1;
 	bb->pos = pos;
 	bb->ep = ep;
+	bb->nr = ep->bb_nr++;
 	return bb;
 }
 
-static struct multijmp *alloc_multijmp(SCTX_ struct basic_block *target, int begin, int end)
+static struct multijmp *alloc_multijmp(SCTX_ struct basic_block *target, long long begin, long long end)
 {
 	struct multijmp *multijmp = __alloc_multijmp(sctx_ 0);
 	multijmp->target = target;
@@ -92,6 +93,11 @@ static inline int regno(pseudo_t n)
 	return retval;
 }
 
+static inline int bb_nr(struct basic_block *bb)
+{
+	return bb ? bb->nr : -1;
+}
+
 const char *show_pseudo(SCTX_ pseudo_t pseudo)
 {
 	static int n;
@@ -110,7 +116,7 @@ const char *show_pseudo(SCTX_ pseudo_t pseudo)
 		struct expression *expr;
 
 		if (sym->bb_target) {
-			snprintf(buf, 64, ".L%p", sym->bb_target);
+			snprintf(buf, 64, ".L%d", bb_nr(sym->bb_target));
 			break;
 		}
 		if (sym->ident) {
@@ -304,10 +310,10 @@ const char *show_instruction(SCTX_ struct instruction *insn)
 		break;
 	case OP_BR:
 		if (insn->bb_true && insn->bb_false) {
-			buf += sprintf(buf, "%s, .L%p, .L%p", show_pseudo(sctx_ insn->cond), insn->bb_true, insn->bb_false);
+			buf += sprintf(buf, "%s, .L%d, .L%d", show_pseudo(sctx_ insn->cond), bb_nr(insn->bb_true), bb_nr(insn->bb_false));
 			break;
 		}
-		buf += sprintf(buf, ".L%p", insn->bb_true ? insn->bb_true : insn->bb_false);
+		buf += sprintf(buf, ".L%d", bb_nr(insn->bb_true ? insn->bb_true : insn->bb_false));
 		break;
 
 	case OP_SYMADDR: {
@@ -315,7 +321,7 @@ const char *show_instruction(SCTX_ struct instruction *insn)
 		buf += sprintf(buf, "%s <- ", show_pseudo(sctx_ insn->target));
 
 		if (sym->bb_target) {
-			buf += sprintf(buf, ".L%p", sym->bb_target);
+			buf += sprintf(buf, ".L%d", bb_nr(sym->bb_target));
 			break;
 		}
 		if (sym->ident) {
@@ -349,7 +355,7 @@ const char *show_instruction(SCTX_ struct instruction *insn)
 			buf += sprintf(buf, "%s", show_ident(sctx_ expr->symbol->ident));
 			break;
 		case EXPR_LABEL:
-			buf += sprintf(buf, ".L%p", expr->symbol->bb_target);
+			buf += sprintf(buf, ".L%d", bb_nr(expr->symbol->bb_target));
 			break;
 		default:
 			buf += sprintf(buf, "SETVAL EXPR TYPE %d", expr->type);
@@ -361,11 +367,11 @@ const char *show_instruction(SCTX_ struct instruction *insn)
 		buf += sprintf(buf, "%s", show_pseudo(sctx_ insn->target));
 		FOR_EACH_PTR(insn->multijmp_list, jmp) {
 			if (jmp->begin == jmp->end)
-				buf += sprintf(buf, ", %d -> .L%p", jmp->begin, jmp->target);
+				buf += sprintf(buf, ", %lld -> .L%d", jmp->begin, bb_nr(jmp->target));
 			else if (jmp->begin < jmp->end)
-				buf += sprintf(buf, ", %d ... %d -> .L%p", jmp->begin, jmp->end, jmp->target);
+				buf += sprintf(buf, ", %lld ... %lld -> .L%d", jmp->begin, jmp->end, bb_nr(jmp->target));
 			else
-				buf += sprintf(buf, ", default -> .L%p", jmp->target);
+				buf += sprintf(buf, ", default -> .L%d", bb_nr(jmp->target));
 		} END_FOR_EACH_PTR(jmp);
 		break;
 	}
@@ -373,7 +379,7 @@ const char *show_instruction(SCTX_ struct instruction *insn)
 		struct multijmp *jmp;
 		buf += sprintf(buf, "%s", show_pseudo(sctx_ insn->target));
 		FOR_EACH_PTR(insn->multijmp_list, jmp) {
-			buf += sprintf(buf, ", .L%p", jmp->target);
+			buf += sprintf(buf, ", .L%d", bb_nr(jmp->target));
 		} END_FOR_EACH_PTR(jmp);
 		break;
 	}
@@ -474,7 +480,7 @@ void show_bb(SCTX_ struct basic_block *bb)
 {
 	struct instruction *insn;
 
-	printf(".L%p:\n", bb);
+	printf(".L%d:\n", bb_nr(bb));
 	if (sctxp verbose) {
 		pseudo_t needs, defines;
 		printf("%s:%d\n", stream_name(sctx_ bb->pos->pos.stream), bb->pos->pos.line);
@@ -482,7 +488,7 @@ void show_bb(SCTX_ struct basic_block *bb)
 		FOR_EACH_PTR(bb->needs, needs) {
 			struct instruction *def = needs->def;
 			if (def->opcode != OP_PHI) {
-				printf("  **uses %s (from .L%p)**\n", show_pseudo(sctx_ needs), def->bb);
+				printf("  **uses %s (from .L%d)**\n", show_pseudo(sctx_ needs), bb_nr(def->bb));
 			} else {
 				pseudo_t phi;
 				const char *sep = " ";
@@ -490,7 +496,7 @@ void show_bb(SCTX_ struct basic_block *bb)
 				FOR_EACH_PTR(def->phi_list, phi) {
 					if (phi == VOID)
 						continue;
-					printf("%s(%s:.L%p)", sep, show_pseudo(sctx_ phi), phi->def->bb);
+					printf("%s(%s:.L%d)", sep, show_pseudo(sctx_ phi), bb_nr(phi->def->bb));
 					sep = ", ";
 				} END_FOR_EACH_PTR(phi);		
 				printf(")**\n");
@@ -775,12 +781,15 @@ static pseudo_t symbol_pseudo(SCTX_ struct entrypoint *ep, struct symbol *sym)
 	return pseudo;
 }
 
+/*#define MAX_VAL_HASH 64*/
+#ifndef DO_CTX
+static struct pseudo_list *value_pseudos[MAX_VAL_HASH];
+#endif
+
 pseudo_t value_pseudo(SCTX_ long long val)
 {
-#define MAX_VAL_HASH 64
-	static struct pseudo_list *prev[MAX_VAL_HASH];
 	int hash = val & (MAX_VAL_HASH-1);
-	struct pseudo_list **list = prev + hash;
+	struct pseudo_list **list = sctxp value_pseudos + hash;
 	pseudo_t pseudo;
 
 	FOR_EACH_PTR(*list, pseudo) {
@@ -797,6 +806,16 @@ pseudo_t value_pseudo(SCTX_ long long val)
 	return pseudo;
 }
 
+/*
+ * The pseudos all functions share pick up users and list nodes from
+ * each: a long-running process drops them before that memory goes.
+ */
+void forget_shared_pseudos(SCTX)
+{
+	memset(sctxp value_pseudos, 0, sizeof(sctxp value_pseudos));
+	sctxp void_pseudo.users = NULL;
+}
+
 static pseudo_t argument_pseudo(SCTX_ struct entrypoint *ep, int nr)
 {
 	pseudo_t pseudo = __alloc_pseudo(sctx_ 0);
@@ -1837,7 +1856,140 @@ static int multijmp_cmp(SCTX_ const void *_a, const void *_b)
 
 static void sort_switch_cases(SCTX_ struct instruction *insn)
 {
-	sort_list(sctx_ (struct ptr_list **)&insn->multijmp_list, multijmp_cmp);
+	struct multijmp *jmp, *last = NULL;
+
+	/* expand_switch_cases() usually left them in order */
+	FOR_EACH_PTR(insn->multijmp_list, jmp) {
+		if (last && multijmp_cmp(sctx_ last, jmp) > 0) {
+			sort_list(sctx_ (struct ptr_list **)&insn->multijmp_list, multijmp_cmp);
+			return;
+		}
+		last = jmp;
+	} END_FOR_EACH_PTR(jmp);
+}
+
+/* at least this many ranges, filling one in SWITCH_TABLE_DENSITY entries */
+#define SWITCH_TABLE_MIN	4
+#define SWITCH_TABLE_DENSITY	3
+
+static int switch_range_cmp(const void *_a, const void *_b)
+{
+	const struct switch_range *a = _a, *b = _b;
+
+	if (a->begin != b->begin)
+		return a->begin < b->begin ? -1 : 1;
+	if (a->end != b->end)
+		return a->end < b->end ? -1 : 1;
+	return 0;
+}
+
+/*
+ * plan->ranges, plan->nr and plan->def are filled in by the caller,
+ * in any order. The multijmp lists of linearize_switch() come sorted
+ * already, then this is linear.
+ */
+void plan_switch(SCTX_ struct switch_plan *plan)
+{
+	struct switch_range *r = plan->ranges;
+	int i, nr = 0;
+
+	for (i = 1; i < plan->nr; i++) {
+		if (switch_range_cmp(r + i - 1, r + i) > 0) {
+			qsort(r, plan->nr, sizeof(*r), switch_range_cmp);
+			break;
+		}
+	}
+	for (i = 0; i < plan->nr; i++) {
+		struct switch_range cur = r[i];
+
+		if (cur.target == plan->def)
+			continue;
+		if (nr) {
+			struct switch_range *last = r + nr - 1;
+
+			/* duplicates are diagnosed elsewhere, the first one wins */
+			if (cur.begin <= last->end) {
+				if (cur.end <= last->end)
+					continue;
+				cur.begin = last->end + 1;
+			}
+			if (cur.target == last->target && cur.begin == last->end + 1) {
+				last->end = cur.end;
+				continue;
+			}
+		}
+		r[nr++] = cur;
+	}
+	plan->nr = nr;
+	plan->table = nr >= SWITCH_TABLE_MIN &&
+		(unsigned long long)r[nr - 1].end - r[0].begin < (unsigned long long)nr * SWITCH_TABLE_DENSITY;
+}
+
+void plan_multijmp(SCTX_ struct switch_plan *plan, struct instruction *insn)
+{
+	struct multijmp *jmp;
+	int nr = 0;
+
+	plan->ranges = malloc((ptr_list_size(sctx_ (struct ptr_list *)insn->multijmp_list) + 1) * sizeof(struct switch_range));
+	plan->def = NULL;
+	FOR_EACH_PTR(insn->multijmp_list, jmp) {
+		/* the default case */
+		if (jmp->begin > jmp->end) {
+			plan->def = jmp->target;
+			continue;
+		}
+		plan->ranges[nr].begin = jmp->begin;
+		plan->ranges[nr].end = jmp->end;
+		plan->ranges[nr].target = jmp->target;
+		nr++;
+	} END_FOR_EACH_PTR(jmp);
+	plan->nr = nr;
+	plan_switch(sctx_ plan);
+}
+
+/*
+ * A case value or constant condition of a switch as its multijmps
+ * have them: cut to the bits of the controlling expression, sign
+ * extended when that is signed.
+ */
+long long switch_value(struct instruction *insn, long long val)
+{
+	int bits = insn->type ? insn->type->bit_size : 0;
+
+	if (bits > 0 && bits < 64) {
+		unsigned long long mask = (1ULL << bits) - 1;
+
+		val &= mask;
+		if (!(insn->type->ctype.modifiers & MOD_UNSIGNED) && ((unsigned long long)val >> (bits - 1)))
+			val |= ~mask;
+	}
+	return val;
+}
+
+/* where 'val' goes, the default when nothing matches */
+void *switch_target(SCTX_ const struct switch_plan *plan, long long val)
+{
+	const struct switch_range *r = plan->ranges;
+	int lo = 0, hi = plan->nr;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (val < r[mid].begin)
+			hi = mid;
+		else if (val > r[mid].end)
+			lo = mid + 1;
+		else
+			return r[mid].target;
+	}
+	return plan->def;
+}
+
+void free_switch_plan(SCTX_ struct switch_plan *plan)
+{
+	free(plan->ranges);
+	plan->ranges = NULL;
+	plan->nr = 0;
 }
 
 static pseudo_t linearize_declaration(SCTX_ struct entrypoint *ep, struct statement *stmt)
@@ -1892,6 +2044,10 @@ static pseudo_t linearize_switch(SCTX_ struct entrypoint *ep, struct statement *
 		return VOID;
 
 	switch_ins = alloc_instruction(sctx_ OP_SWITCH, 0);
+	/* the type of the condition pseudo, see switch_value() */
+	switch_ins->type = stmt->switch_expression->ctype;
+	if (switch_ins->type && switch_ins->type->type == SYM_NODE)
+		switch_ins->type = switch_ins->type->ctype.base_type;
 	use_pseudo(sctx_ switch_ins, pseudo, &switch_ins->cond);
 	add_one_insn(sctx_ ep, switch_ins);
 	finish_block(sctx_ ep);
@@ -1905,16 +2061,15 @@ static pseudo_t linearize_switch(SCTX_ struct entrypoint *ep, struct statement *
 			default_case = bb_case;
 			continue;
 		} else {
-			int begin, end;
+			long long begin, end;
 
-			begin = end = case_stmt->case_expression->value;
+			begin = end = switch_value(switch_ins, case_stmt->case_expression->value);
 			if (case_stmt->case_to)
-				end = case_stmt->case_to->value;
+				end = switch_value(switch_ins, case_stmt->case_to->value);
+			/* an empty range, only reached by falling into it */
 			if (begin > end)
-				jmp = alloc_multijmp(sctx_ bb_case, end, begin);
-			else
-				jmp = alloc_multijmp(sctx_ bb_case, begin, end);
-
+				continue;
+			jmp = alloc_multijmp(sctx_ bb_case, begin, end);
 		}
 		add_multijmp(sctx_ &switch_ins->multijmp_list, jmp);
 		add_bb(sctx_ &bb_case->parents, active);
@@ -20,7 +20,26 @@ extern struct pseudo void_pseudo;
 
 struct multijmp {
 	struct basic_block *target;
-	int begin, end;
+	long long begin, end;	/* as switch_value() gives them */
+};
+
+/*
+ * How a back end should dispatch a switch: the case ranges sorted,
+ * overlaps removed and neighbours with the same target merged, cases
+ * that go to the default dropped. 'table' says they are dense enough
+ * for a jump table from ranges[0].begin to ranges[nr-1].end, if not a
+ * binary search over the ranges is the way. See plan_switch().
+ */
+struct switch_range {
+	long long begin, end;
+	void *target;
+};
+
+struct switch_plan {
+	struct switch_range *ranges;	/* malloc()ed */
+	int nr;
+	int table;
+	void *def;
 };
 
 struct asm_constraint {
@@ -201,6 +220,7 @@ struct basic_block {
 	struct token *pos;
 	unsigned long generation;
 	int context;
+	int nr;		/* in its entrypoint, for the .L labels */
 	struct entrypoint *ep;
 	struct basic_block_list *parents; /* sources */
 	struct basic_block_list *children; /* destinations */
@@ -302,6 +322,7 @@ struct entrypoint {
 	struct basic_block_list *bbs;
 	struct basic_block *active;
 	struct instruction *entry;
+	int bb_nr;
 };
 
 extern void insert_select(SCTX_ struct basic_block *bb, struct instruction *br, struct instruction *phi, pseudo_t if_true, pseudo_t if_false);
@@ -310,6 +331,13 @@ extern void insert_branch(SCTX_ struct basic_block *bb, struct instruction *br,
 pseudo_t alloc_phi(SCTX_ struct basic_block *source, pseudo_t pseudo, int size);
 pseudo_t alloc_pseudo(SCTX_ struct instruction *def);
 pseudo_t value_pseudo(SCTX_ long long val);
+void forget_shared_pseudos(SCTX);
+
+void plan_switch(SCTX_ struct switch_plan *plan);
+void plan_multijmp(SCTX_ struct switch_plan *plan, struct instruction *insn);
+void *switch_target(SCTX_ const struct switch_plan *plan, long long val);
+long long switch_value(struct instruction *insn, long long val);
+void free_switch_plan(SCTX_ struct switch_plan *plan);
 
 struct entrypoint *linearize_symbol(SCTX_ struct symbol *sym);
 int unssa(SCTX_ struct entrypoint *ep);
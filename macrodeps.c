@@ -0,0 +1,580 @@
+/*
+ * macrodeps - the macro dependency graph of translation units
+ *
+ *	macrodeps [sparse options] files...
+ *	macrodeps -o graph [sparse options] files...
+ *	macrodeps -r graph
+ *
+ * The nodes are macros and top level declarations, an edge X -> Y says
+ * that Y depends on macro X: X was expanded from the body of macro Y,
+ * or while parsing declaration Y. Everything is taken from the
+ * expansion trace in one pass over the expansions of the unit, and
+ * edges are counted once per unit.
+ *
+ * A graph file holds one section per unit, with the files the unit
+ * read. With -o the sections of units whose files did not change are
+ * kept as they are and only the others are recomputed; -r merges all
+ * sections into one deduplicated graph, after the update if both are
+ * given.
+ *
+ *	unit <file>
+ *	input <mtime> <size> <file>	one per file read, mtime in ns
+ *	node m|d <name> <line> <file>	numbered from 0 in each section
+ *	edge <from> <to>...
+ *	end
+ *
+ * Licensed under the Open Software License version 1.1
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "lib.h"
+#include "allocate.h"
+#include "token.h"
+#include "parse.h"
+#include "symbol.h"
+#include "units.h"
+
+/* pointer -> index */
+struct ptr_map {
+	void **key;
+	uint32_t *val;
+	unsigned long size, nr;
+};
+
+static unsigned long map_slot(struct ptr_map *m, void *p)
+{
+	unsigned long h = ((unsigned long)p >> 3) * 0x9E3779B97F4A7C15ull;
+
+	h &= m->size - 1;
+	while (m->key[h] && m->key[h] != p)
+		h = (h + 1) & (m->size - 1);
+	return h;
+}
+
+static int map_get(struct ptr_map *m, void *p, uint32_t *v)
+{
+	unsigned long h;
+
+	if (!m->size)
+		return 0;
+	h = map_slot(m, p);
+	if (!m->key[h])
+		return 0;
+	*v = m->val[h];
+	return 1;
+}
+
+static void map_put(struct ptr_map *m, void *p, uint32_t v)
+{
+	unsigned long h;
+
+	if (2 * (m->nr + 1) > m->size) {
+		struct ptr_map old = *m;
+		unsigned long i;
+
+		m->size = old.size ? old.size * 2 : 1024;
+		m->key = calloc(m->size, sizeof(void *));
+		m->val = malloc(m->size * sizeof(uint32_t));
+		m->nr = 0;
+		for (i = 0; i < old.size; i++)
+			if (old.key[i])
+				map_put(m, old.key[i], old.val[i]);
+		free(old.key);
+		free(old.val);
+	}
+	h = map_slot(m, p);
+	if (!m->key[h])
+		m->nr++;
+	m->key[h] = p;
+	m->val[h] = v;
+}
+
+static void map_free(struct ptr_map *m)
+{
+	free(m->key);
+	free(m->val);
+	memset(m, 0, sizeof(*m));
+}
+
+/* an edge is a key of its own: from + 1 in the high half, to + 1 below */
+#define EDGE(from, to)	((void *)((((uintptr_t)(from) + 1) << 32) | ((uintptr_t)(to) + 1)))
+
+struct node {
+	char kind;
+	char *name;
+	unsigned int line;
+	char *file;
+};
+
+struct graph {
+	struct node *nodes;
+	uint32_t nr_nodes, alloc_nodes;
+	uint64_t *edges;		/* from << 32 | to */
+	uint32_t nr_edges, alloc_edges;
+	struct ptr_map seen;		/* edges */
+};
+
+static uint32_t add_node(struct graph *g, char kind, const char *name, unsigned int line, const char *file)
+{
+	struct node *n;
+
+	if (g->nr_nodes == g->alloc_nodes) {
+		g->alloc_nodes = g->alloc_nodes ? g->alloc_nodes * 2 : 256;
+		g->nodes = realloc(g->nodes, g->alloc_nodes * sizeof(*n));
+	}
+	n = g->nodes + g->nr_nodes;
+	n->kind = kind;
+	n->name = strdup(name);
+	n->line = line;
+	n->file = strdup(file);
+	return g->nr_nodes++;
+}
+
+static void add_edge(struct graph *g, uint32_t from, uint32_t to)
+{
+	uint32_t dummy;
+
+	if (map_get(&g->seen, EDGE(from, to), &dummy))
+		return;
+	map_put(&g->seen, EDGE(from, to), 0);
+	if (g->nr_edges == g->alloc_edges) {
+		g->alloc_edges = g->alloc_edges ? g->alloc_edges * 2 : 1024;
+		g->edges = realloc(g->edges, g->alloc_edges * sizeof(uint64_t));
+	}
+	g->edges[g->nr_edges++] = (uint64_t)from << 32 | to;
+}
+
+static int cmp_edge(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void write_graph(FILE *f, struct graph *g)
+{
+	uint32_t i;
+
+	for (i = 0; i < g->nr_nodes; i++) {
+		struct node *n = g->nodes + i;
+		fprintf(f, "node %c %s %u %s\n", n->kind, n->name, n->line, n->file);
+	}
+	qsort(g->edges, g->nr_edges, sizeof(uint64_t), cmp_edge);
+	for (i = 0; i < g->nr_edges; i++) {
+		uint32_t from = g->edges[i] >> 32;
+
+		if (!i || from != g->edges[i - 1] >> 32)
+			fprintf(f, "%sedge %u", i ? "\n" : "", from);
+		fprintf(f, " %u", (uint32_t)g->edges[i]);
+	}
+	if (g->nr_edges)
+		fprintf(f, "\n");
+}
+
+static void free_graph(struct graph *g)
+{
+	uint32_t i;
+
+	for (i = 0; i < g->nr_nodes; i++) {
+		free(g->nodes[i].name);
+		free(g->nodes[i].file);
+	}
+	free(g->nodes);
+	free(g->edges);
+	map_free(&g->seen);
+	memset(g, 0, sizeof(*g));
+}
+
+/******** one unit ********/
+
+struct unit_deps {
+	struct graph g;
+	struct ptr_map nodes;		/* symbol -> node */
+	struct ptr_map caller;		/* token -> macro whose result holds it */
+	struct ptr_map decl;		/* pos/endpos token -> declaration */
+	struct symbol **syms;		/* the top level symbols */
+	struct token **toks;		/* the parsed tokens, sorted by position */
+	uint32_t *tok_decl;		/* their symbols */
+	uint32_t nr_toks;
+	unsigned long skip;		/* expansions of earlier units */
+};
+
+static uint32_t sym_node(SCTX_ struct unit_deps *u, struct symbol *sym, char kind)
+{
+	uint32_t n;
+
+	if (!map_get(&u->nodes, sym, &n)) {
+		n = add_node(&u->g, kind, show_ident(sctx_ sym->ident), sym->pos->pos.line,
+			     stream_name(sctx_ sym->pos->pos.stream));
+		map_put(&u->nodes, sym, n);
+	}
+	return n;
+}
+
+/*
+ * A function-like macro that is not followed by '(' does not expand;
+ * the first token scanned after the name is the last one popped.
+ */
+static int expanded(struct expansion *x)
+{
+	struct cons *c = x->pdstk_pop;
+
+	if (!x->msym->arglist)
+		return 1;
+	while (c && c->next)
+		c = c->next;
+	return c && match_op(c->t, '(');
+}
+
+static void note_result(SCTX_ void *obj, void *data)
+{
+	struct unit_deps *u = data;
+	struct expansion *x = obj;
+	struct cons *c;
+	uint32_t n;
+
+	if (u->skip) {
+		u->skip--;
+		return;
+	}
+	if (x->typ != EXPANSION_MACRO || !x->msym || !x->tok || !expanded(x))
+		return;
+	/* later, inner expansions win for the tokens passed through */
+	n = sym_node(sctx_ u, x->msym, 'm');
+	for (c = x->pdstk_push; c; c = c->next)
+		map_put(&u->caller, c->t, n);
+}
+
+static int cmp_tok(const void *a, const void *b)
+{
+	const struct position *x = &(*(struct token * const *)a)->pos;
+	const struct position *y = &(*(struct token * const *)b)->pos;
+
+	if (x->stream != y->stream)
+		return x->stream < y->stream ? -1 : 1;
+	if (x->line != y->line)
+		return x->line < y->line ? -1 : 1;
+	return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/*
+ * The declaration a macro invocation at 'pos' went into: the one of
+ * the first parsed token at or after it on the same line, or else of
+ * the last one before it on that line. Invocations on lines of their
+ * own that expand to nothing, or in directives, have none.
+ */
+static int find_decl(SCTX_ struct unit_deps *u, struct position pos, uint32_t *decl)
+{
+	struct token key = { .pos = pos }, *k = &key;
+	uint32_t lo = 0, hi = u->nr_toks;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (cmp_tok(&u->toks[mid], &k) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < u->nr_toks && u->toks[lo]->pos.stream == pos.stream &&
+	    u->toks[lo]->pos.line == pos.line)
+		;
+	else if (lo > 0 && u->toks[lo - 1]->pos.stream == pos.stream &&
+		 u->toks[lo - 1]->pos.line == pos.line)
+		lo--;
+	else
+		return 0;
+	if (u->tok_decl[lo] == ~0u)
+		return 0;
+	*decl = sym_node(sctx_ u, u->syms[u->tok_decl[lo]], 'd');
+	return 1;
+}
+
+/*
+ * The parsed tokens split into external declarations at the ';' and
+ * '}' that close them. A token belongs to the last symbol declared
+ * before it in its external declaration, or to the first one if
+ * there is none yet.
+ */
+static void map_declarations(SCTX_ struct unit_deps *u, struct symbol_list *list)
+{
+	struct symbol *sym;
+	struct token *tok;
+	uint32_t i, start, nr = 0, cur, n;
+	int depth = 0;
+
+	FOR_EACH_PTR(list, sym) {
+		nr++;
+	} END_FOR_EACH_PTR(sym);
+	u->syms = malloc((nr + 1) * sizeof(*u->syms));
+	nr = 0;
+	FOR_EACH_PTR(list, sym) {
+		if (sym->ident && sym->pos) {
+			map_put(&u->decl, sym->pos, nr);
+			u->syms[nr++] = sym;
+		}
+	} END_FOR_EACH_PTR(sym);
+
+	for (tok = sctxp pp_tokenlist; tok && !eof_token(tok); tok = tok->next)
+		u->nr_toks++;
+	u->toks = malloc(u->nr_toks * sizeof(*u->toks));
+	u->tok_decl = malloc(u->nr_toks * sizeof(uint32_t));
+	for (i = 0, tok = sctxp pp_tokenlist; i < u->nr_toks; i++, tok = tok->next)
+		u->toks[i] = tok;
+
+	for (start = 0; start < u->nr_toks; start = i) {
+		/* find the end, and the first symbol on the way */
+		cur = ~0u;
+		for (i = start; i < u->nr_toks; ) {
+			tok = u->toks[i++];
+			if (cur == ~0u)
+				map_get(&u->decl, tok, &cur);
+			if (token_type(tok) != TOKEN_SPECIAL)
+				continue;
+			if (match_op(tok, '(') || match_op(tok, '[') || match_op(tok, '{'))
+				depth++;
+			else if (match_op(tok, ')') || match_op(tok, ']'))
+				depth--;
+			else if (match_op(tok, '}') && !--depth)
+				break;
+			else if (match_op(tok, ';') && !depth)
+				break;
+		}
+		for (n = start; n < i; n++) {
+			map_get(&u->decl, u->toks[n], &cur);
+			u->tok_decl[n] = cur;
+		}
+	}
+
+	/* sort the tokens by position, their declarations along */
+	for (i = 0; i < u->nr_toks; i++)
+		map_put(&u->decl, u->toks[i], u->tok_decl[i]);
+	qsort(u->toks, u->nr_toks, sizeof(*u->toks), cmp_tok);
+	for (i = 0; i < u->nr_toks; i++)
+		map_get(&u->decl, u->toks[i], &u->tok_decl[i]);
+}
+
+static void note_expansion(SCTX_ void *obj, void *data)
+{
+	struct unit_deps *u = data;
+	struct expansion *x = obj;
+	uint32_t callee, caller, decl;
+
+	if (u->skip) {
+		u->skip--;
+		return;
+	}
+	if (x->typ != EXPANSION_MACRO || !x->msym || !x->tok || !expanded(x))
+		return;
+	callee = sym_node(sctx_ u, x->msym, 'm');
+	if (map_get(&u->caller, x->tok, &caller))
+		add_edge(&u->g, callee, caller);
+	if (find_decl(sctx_ u, x->tok->pos, &decl))
+		add_edge(&u->g, callee, decl);
+}
+
+/* check one unit, write its section */
+static void unit_section(SCTX_ FILE *f, char *file)
+{
+	unsigned long before = sctxp expansion_allocator.allocations;
+	struct symbol_list *list;
+	struct unit_deps u;
+	int first;
+
+	memset(&u, 0, sizeof(u));
+	first = sctxp input_stream_nr;
+	list = sparse_keep_tokens(sctx_ file);
+
+	show_unit_inputs(sctx_ f, file, first);
+
+	map_declarations(sctx_ &u, list);
+	u.skip = before;
+	for_each_allocation(sctx_ &sctxp expansion_allocator, sizeof(struct expansion), note_result, &u);
+	u.skip = before;
+	for_each_allocation(sctx_ &sctxp expansion_allocator, sizeof(struct expansion), note_expansion, &u);
+
+	write_graph(f, &u.g);
+	fprintf(f, "end\n");
+
+	free_graph(&u.g);
+	map_free(&u.nodes);
+	map_free(&u.caller);
+	map_free(&u.decl);
+	free(u.syms);
+	free(u.toks);
+	free(u.tok_decl);
+}
+
+/******** graph files ********/
+
+static int update_graph(SCTX_ const char *out, struct string_list *filelist)
+{
+	struct unit_index units = { 0 };
+	char *file;
+
+	read_unit_index(&units, out);
+	FOR_EACH_PTR_NOTAG(filelist, file) {
+		struct unit_section *s = find_unit(&units, file);
+		char *text;
+		size_t len;
+		FILE *f;
+
+		if (s && unit_is_current(s->text))
+			continue;
+
+		f = open_memstream(&text, &len);
+		unit_section(sctx_ f, file);
+		fclose(f);
+		set_unit(&units, file, text);
+	} END_FOR_EACH_PTR_NOTAG(file);
+
+	return write_unit_index(&units, out);
+}
+
+/* node line -> merged node, for -r */
+struct name_map {
+	char **key;
+	uint32_t *val;
+	unsigned long size, nr;
+};
+
+static unsigned long name_slot(struct name_map *m, const char *key)
+{
+	unsigned long h = 0;
+	const char *p;
+
+	for (p = key; *p; p++)
+		h = h * 31 + (unsigned char)*p;
+	h &= m->size - 1;
+	while (m->key[h] && strcmp(m->key[h], key))
+		h = (h + 1) & (m->size - 1);
+	return h;
+}
+
+static void name_put(struct name_map *m, char *key, uint32_t v)
+{
+	unsigned long h;
+
+	if (2 * (m->nr + 1) > m->size) {
+		struct name_map old = *m;
+		unsigned long i;
+
+		m->size = old.size ? old.size * 2 : 1024;
+		m->key = calloc(m->size, sizeof(char *));
+		m->val = malloc(m->size * sizeof(uint32_t));
+		m->nr = 0;
+		for (i = 0; i < old.size; i++)
+			if (old.key[i])
+				name_put(m, old.key[i], old.val[i]);
+		free(old.key);
+		free(old.val);
+	}
+	h = name_slot(m, key);
+	m->nr++;
+	m->key[h] = key;
+	m->val[h] = v;
+}
+
+/* all sections of a graph file as one graph, nodes and edges counted once */
+static int show_graph(const char *name)
+{
+	struct graph g = { 0 };
+	struct name_map names = { 0 };
+	uint32_t *local = NULL, nr_local = 0, alloc_local = 0;
+	char *line = NULL;
+	size_t alloc = 0;
+	ssize_t n;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f) {
+		fprintf(stderr, "%s: can't read the graph\n", name);
+		return 1;
+	}
+	while ((n = getline(&line, &alloc, f)) > 0) {
+		if (line[n - 1] == '\n')
+			line[--n] = 0;
+		if (!strncmp(line, "unit ", 5)) {
+			nr_local = 0;
+		} else if (!strncmp(line, "node ", 5)) {
+			char kind, nodename[1024];
+			unsigned int nodeline;
+			unsigned long h;
+			int at = 0;
+			uint32_t id;
+
+			if (sscanf(line, "node %c %1023s %u %n", &kind, nodename, &nodeline, &at) < 3 || !at)
+				continue;
+			/* nodes of different units are the same when all of the line is */
+			h = names.size ? name_slot(&names, line + 5) : 0;
+			if (names.size && names.key[h]) {
+				id = names.val[h];
+			} else {
+				id = add_node(&g, kind, nodename, nodeline, line + at);
+				name_put(&names, strdup(line + 5), id);
+			}
+			if (nr_local == alloc_local) {
+				alloc_local = alloc_local ? alloc_local * 2 : 256;
+				local = realloc(local, alloc_local * sizeof(uint32_t));
+			}
+			local[nr_local++] = id;
+		} else if (!strncmp(line, "edge ", 5)) {
+			char *p, *end;
+			uint32_t from = strtoul(line + 5, &end, 10), to;
+
+			for (p = end; *p; p = end) {
+				to = strtoul(p, &end, 10);
+				if (end == p)
+					break;
+				if (from < nr_local && to < nr_local)
+					add_edge(&g, local[from], local[to]);
+			}
+		}
+	}
+	free(line);
+	free(local);
+	fclose(f);
+
+	write_graph(stdout, &g);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct string_list *filelist = NULL;
+	const char *out = NULL, *in = NULL;
+	char *file;
+	int i, j, ret = 0;
+	SPARSE_CTX_INIT;
+
+	for (i = j = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			out = argv[++i];
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			in = argv[++i];
+		else
+			argv[j++] = argv[i];
+	}
+	argv[j] = NULL;
+	argc = j;
+
+	if (in && !out)
+		return show_graph(in);
+
+	sparse_initialize(sctx_ argc, argv, &filelist);
+	if (out) {
+		if (update_graph(sctx_ out, filelist)) {
+			fprintf(stderr, "%s: can't write the graph\n", out);
+			return 1;
+		}
+		if (in)
+			ret = show_graph(in);
+	} else {
+		FOR_EACH_PTR_NOTAG(filelist, file) {
+			unit_section(sctx_ stdout, file);
+		} END_FOR_EACH_PTR_NOTAG(file);
+	}
+	return ret;
+}
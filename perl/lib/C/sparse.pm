@@ -289,10 +289,35 @@ C::sparse - Perl binding to Linux's Sparse
   my @s = $f[2]->e->s # get pre  pre-processor tokenstream of test.c (source)
   my @d = $f[2]->e->d # get post pre-processor tokenstream of test.c (dest)
 
+  # all tokens of a stream at once, 4 ints per token:
+  # (type, line, column, index into @$names or -1)
+  my ($packed, $names) = $f[2]->tokens;
+  my @t = unpack("(i4)*", $packed);
+
+  # walk all function bodies and initializers in C, the sub is only
+  # called for the statement/expression kinds selected by the masks
+  $s->visit(sub { my ($node) = @_; ... },
+            1 << C::sparse::STMT_RETURN, 1 << C::sparse::EXPR_CALL);
+  $sym->visit(...)    # same, for one symbol
+
+  # one context per job, parsed on 4 native threads; a job that hits
+  # a fatal error gives undef
+  my @c = C::sparse::batch(4, ["-I.", "a.c"], ["-I.", "b.c"]);
+
 =head1 DESCRIPTION
 
 Binding to the Linux static analyser Sparse.
 
+Every C node is wrapped in a single Perl object that is created on
+first access and then reused, so asking for the same node twice gives
+the same reference.
+
+A context is released when its object goes away. Node objects don't
+keep it alive, using one afterwards croaks.
+
+C<batch> parses on its own threads without entering the interpreter
+and returns once every job is done.
+
 =head2 EXPORT
 
 None by default.
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <pthread.h>
+#include <setjmp.h>
 #ifdef __linux__
 #undef  _GNU_SOURCE
 #define _GNU_SOURCE
@@ -79,6 +81,8 @@ typedef struct token     sparse__tok;
   struct type##_elem {							\
     type##_t            m;						\
     struct type##_elem  *next;						\
+    SV                  *sv;	/* cached referent, see ref_##type */	\
+    int                 stale;	/* its sparse context was destroyed */	\
   };									\
   typedef struct type##_elem  *type;					\
   typedef struct type##_elem  *type##_assume;				\
@@ -119,22 +123,79 @@ typedef struct token     sparse__tok;
       p->next = type##_hash[h]; 					\
       type##_hash[h] = p; 						\
       p->m = e;/*TRACE (printf ("  p=%p\n", p));*/			\
+      p->sv = NULL;							\
+      p->stale = 0;							\
       assert_support (type##_count++);					\
     }									\
     TRACE (printf (" =>%p\n", p));					\
     TRACE_ACTIVE ();							\
     return p;								\
   }									\
+  /* point rv at the one referent of p, bless it only once */	\
+  static SV *								\
+  ref_##type (SV *rv, type p, HV *stash)				\
+  {									\
+    if (!p->sv)								\
+      p->sv = newSViv (PTR2IV (p));					\
+    SvUPGRADE (rv, SVt_IV);						\
+    SvRV_set (rv, SvREFCNT_inc_simple_NN (p->sv));			\
+    SvROK_on (rv);							\
+    if (stash && (!SvOBJECT (p->sv) || SvSTASH (p->sv) != stash))	\
+      sv_bless (rv, stash);						\
+    return rv;								\
+  }									\
   static SV *								\
   newbless_##type (type##_t e)						\
   {									\
     if (!e) return &PL_sv_undef;					\
-    return sv_bless (sv_setref_pv (sv_newmortal(), NULL, new_##type (e)), type##_class_hv); \
+    return ref_##type (sv_newmortal(), new_##type (e), type##_class_hv); \
   }									\
-  static SV *newsv_##type (type##_t e)					\
+  static SV *newsv_##type (type##_t e, HV *stash)			\
   {									\
     if (!e) return &PL_sv_undef;					\
-    return sv_setref_pv (sv_newmortal(), NULL, new_##type (e));		\
+    return ref_##type (sv_newmortal(), new_##type (e), stash);	\
+  }									\
+  /* take p off its hash chain, see ctx DESTROY */			\
+  static void								\
+  unlink_##type (type p)						\
+  {									\
+    unsigned int h = (int) (long)p->m;					\
+    h = ((h >> 4) ^ (h >> 8) ^ (h >> 12) ^ 0x57a45) & (SPARSE_HASHSIZE-1); \
+    type *pp = &type##_hash[h];						\
+    while (*pp && *pp != p)						\
+      pp = &(*pp)->next;						\
+    if (*pp)								\
+      *pp = p->next;							\
+  }									\
+  /* drop the wrappers of the objects owned(), see ctx DESTROY */	\
+  static void								\
+  purge_##type (int (*owned)(void *, void *), void *data)		\
+  {									\
+    int h;								\
+    for (h = 0; h < SPARSE_HASHSIZE; h++) {				\
+      type *pp = &type##_hash[h];					\
+      while (*pp) {							\
+	type p = *pp;							\
+	if (!p->m || !owned ((void *)p->m, data)) {			\
+	  pp = &p->next;						\
+	  continue;							\
+	}								\
+	*pp = p->next;							\
+	p->m = NULL;							\
+	p->stale = 1;							\
+	if (p->sv) {							\
+	  int last = SvREFCNT (p->sv) == 1;				\
+	  SV *sv = p->sv;						\
+	  p->sv = NULL;							\
+	  SvREFCNT_dec (sv);						\
+	  if (last) {							\
+	    p->next = type##_freelist;					\
+	    type##_freelist = p;					\
+	    assert_support (type##_count--);				\
+	  }								\
+	}								\
+      }									\
+    }									\
   }									\
 
 CREATE_SPARSE(sparsepos,   C::sparse::pos   , position);
@@ -151,6 +212,15 @@ CREATE_SPARSE(sparseexpand,C::sparse::expand, expansion);
 CREATE_SPARSE(sparsectx,   C::sparse::ctx   , sparse_ctx);
 CREATE_SPARSE(sparsestream,C::sparse::stream, stream);
 
+/* gv_stashpv() is a hash lookup, remember the per-kind classes */
+static HV *
+class_stash (HV **cache, char **names, int idx)
+{
+  if (!cache[idx])
+    cache[idx] = gv_stashpv (names[idx], 1);
+  return cache[idx];
+}
+
 static char *token_types_class[] =  {
 	"C::sparse::tok::TOKEN_EOF",
 	"C::sparse::tok::TOKEN_ERROR",
@@ -185,9 +255,10 @@ static char *token_types_class[] =  {
 	"C::sparse::tok::TOKEN_CONS",
 	0
 };
+static HV *token_types_stash[sizeof(token_types_class)/sizeof(char *)];
 static SV *bless_tok(sparsetok_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparsetok (e), gv_stashpv (token_types_class[token_type(e)],1));
+    return newsv_sparsetok (e, class_stash (token_types_stash, token_types_class, token_type(e)));
 }
 static SV *bless_sparsetok(sparsetok_t e) { return bless_tok(e); }
 static char *stmt_types_class[] =  {
@@ -206,9 +277,10 @@ static char *stmt_types_class[] =  {
 	"C::sparse::stmt::STMT_CONTEXT",
 	"C::sparse::stmt::STMT_RANGE"
 };
+static HV *stmt_types_stash[sizeof(stmt_types_class)/sizeof(char *)];
 static SV *bless_stmt(sparsestmt_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparsestmt(e), gv_stashpv (stmt_types_class[e->type],1));
+    return newsv_sparsestmt(e, class_stash (stmt_types_stash, stmt_types_class, e->type));
 }
 static SV *bless_sparsestmt(sparsestmt_t e) { return bless_stmt(e); }
 
@@ -233,9 +305,10 @@ static char *sym_types_class[] =  {
 	"C::sparse::sym::SYM_KEYWORD",
 	"C::sparse::sym::SYM_BAD",
 };
+static HV *sym_types_stash[sizeof(sym_types_class)/sizeof(char *)];
 static SV *bless_sym(sparsesym_t e)   { 
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparsesym(e), gv_stashpv (sym_types_class[e->type],1));
+    return newsv_sparsesym(e, class_stash (sym_types_stash, sym_types_class, e->type));
 }
 static SV *bless_sparsesym(sparsesym_t e)   { return bless_sym(e); }
 
@@ -272,25 +345,26 @@ static char *expr_types_class[] =  {
 	"C::sparse::expr::EXPR_SLICE",
 	"C::sparse::expr::EXPR_OFFSETOF"
 };
+static HV *expr_types_stash[sizeof(expr_types_class)/sizeof(char *)];
 static SV *bless_expr(sparseexpr_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparseexpr(e), gv_stashpv (expr_types_class[e->type],1));
+    return newsv_sparseexpr(e, class_stash (expr_types_stash, expr_types_class, e->type));
 }
 static SV *bless_sparseexpr(sparseexpr_t e) { return bless_expr(e); }
 
 static SV *bless_ctype(sparsectype_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparsectype(e), gv_stashpv (sparsectype_class,1));
+    return newsv_sparsectype(e, sparsectype_class_hv);
 }
 static SV *bless_sparsectype(sparsectype_t e) { return bless_ctype(e); }
 static SV *bless_symctx(sparsesymctx_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparsesymctx(e), gv_stashpv (sparsesymctx_class,1));
+    return newsv_sparsesymctx(e, sparsesymctx_class_hv);
 }
 static SV *bless_sparsesymctx(sparsesymctx_t e) { return bless_symctx(e); }
 static SV *bless_scope(sparsescope_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparsescope(e), gv_stashpv (sparsescope_class,1));
+    return newsv_sparsescope(e, sparsescope_class_hv);
 }
 static SV *bless_sparsescope(sparsesymctx_t e) { return bless_symctx(e); }
 
@@ -302,19 +376,21 @@ static char *expand_types_class[] =  {
 	"C::sparse::expand::EXPANSION_MACRO",
 	"C::sparse::expand::EXPANSION_MACROARG",
 	"C::sparse::expand::EXPANSION_CONCAT",
+	"C::sparse::expand::EXPANSION_PREPRO",
 	"C::sparse::expand::EXPANSION_SUBST",
 
 	"C::sparse::expand::EXPANSION_RESULT",
 };
+static HV *expand_types_stash[sizeof(expand_types_class)/sizeof(char *)];
 static SV *bless_expand(sparseexpand_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparseexpand(e), gv_stashpv (expand_types_class[e->typ],1));
+    return newsv_sparseexpand(e, class_stash (expand_types_stash, expand_types_class, e->typ));
 }
 static SV *bless_sparseexpand(sparseexpand_t e) { return bless_expand(e); }
 
 static SV *bless_stream(sparsestream_t e) {
     if (!e) return &PL_sv_undef;
-    return sv_bless (newsv_sparsestream(e), gv_stashpv ("C::sparse::stream",1));
+    return newsv_sparsestream(e, sparsestream_class_hv);
 }
 static SV *bless_sparsestream(sparsestream_t e) { return bless_stream(e); }
 
@@ -326,6 +402,95 @@ class_or_croak (SV *sv, const char *cl)
     croak("not type %s", cl);
 }
 
+static void
+live_or_croak (int stale, const char *cl)
+{
+  if (stale)
+    croak("%s: sparse context already destroyed", cl);
+}
+
+/* address ranges owned by one sparse context, sorted for bsearch */
+struct ctx_ranges {
+  struct ctx_range { char *lo, *hi; } *r;
+  int n, alloc;
+};
+
+static void
+add_range (struct ctx_ranges *rs, void *lo, unsigned long len)
+{
+  if (!lo || !len)
+    return;
+  if (rs->n == rs->alloc) {
+    rs->alloc = rs->alloc ? rs->alloc * 2 : 64;
+    Renew (rs->r, rs->alloc, struct ctx_range);
+  }
+  rs->r[rs->n].lo = lo;
+  rs->r[rs->n].hi = (char *)lo + len;
+  rs->n++;
+}
+
+static void
+add_blob (struct sparse_ctx *_sctx, struct allocator_struct *desc, struct allocation_blob *blob, void *data)
+{
+  add_range (data, blob, desc->chunking);
+}
+
+static void
+add_allocator (struct sparse_ctx *_sctx, struct allocator_struct *desc, void *data)
+{
+  for_each_blob (sctx_ desc, add_blob, data);
+}
+
+static int
+range_cmp (const void *a, const void *b)
+{
+  char *x = ((const struct ctx_range *)a)->lo, *y = ((const struct ctx_range *)b)->lo;
+  return x < y ? -1 : x > y;
+}
+
+static int
+in_ranges (void *p, void *data)
+{
+  struct ctx_ranges *rs = data;
+  int lo = 0, hi = rs->n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if ((char *)p < rs->r[mid].lo)
+      hi = mid;
+    else if ((char *)p >= rs->r[mid].hi)
+      lo = mid + 1;
+    else
+      return 1;
+  }
+  return 0;
+}
+
+/* wrappers don't keep their context alive: mark them stale instead */
+static void
+purge_ctx_wrappers (struct sparse_ctx *c)
+{
+  struct ctx_ranges rs = { NULL, 0, 0 };
+
+  add_range (&rs, c, sizeof (*c));
+  add_range (&rs, c->input_streams, c->input_streams_allocated * sizeof (struct stream));
+  sparse_ctx_for_each_allocator (c, add_allocator, &rs);
+  qsort (rs.r, rs.n, sizeof (*rs.r), range_cmp);
+
+  purge_sparsepos (in_ranges, &rs);
+  purge_sparsetok (in_ranges, &rs);
+  purge_sparsecons (in_ranges, &rs);
+  purge_sparsestmt (in_ranges, &rs);
+  purge_sparseexpr (in_ranges, &rs);
+  purge_sparsesym (in_ranges, &rs);
+  purge_sparseident (in_ranges, &rs);
+  purge_sparsectype (in_ranges, &rs);
+  purge_sparsesymctx (in_ranges, &rs);
+  purge_sparsescope (in_ranges, &rs);
+  purge_sparseexpand (in_ranges, &rs);
+  purge_sparsestream (in_ranges, &rs);
+  Safefree (rs.r);
+}
+
 static void clean_up_symbols(SCTX_ struct symbol_list *list)
 {
 	struct symbol *sym;
@@ -354,6 +519,320 @@ sparse_main(SCTX_ int argc, char **argv)
 }
 
 
+/*
+ * C side walk over statements and expressions: the Perl callback is
+ * only entered for the statement and expression kinds whose bit is
+ * set in the masks, nothing is blessed for the other nodes.
+ */
+struct visit {
+	SV *cb;
+	UV stmts, exprs;
+};
+
+static void visit_stmt(struct visit *v, struct statement *stmt);
+static void visit_expr(struct visit *v, struct expression *expr);
+
+static void visit_call(struct visit *v, SV *node)
+{
+	dSP;
+
+	ENTER;
+	SAVETMPS;
+	PUSHMARK(SP);
+	XPUSHs(node);
+	PUTBACK;
+	call_sv(v->cb, G_DISCARD);
+	FREETMPS;
+	LEAVE;
+}
+
+static void visit_expr_list(struct visit *v, struct expression_list *list)
+{
+	struct expression *expr;
+
+	FOR_EACH_PTR(list, expr) {
+		visit_expr(v, expr);
+	} END_FOR_EACH_PTR(expr);
+}
+
+static void visit_sym(struct visit *v, struct symbol *sym)
+{
+	struct symbol *base;
+
+	if (!sym)
+		return;
+	visit_expr(v, sym->initializer);
+	base = sym->ctype.base_type;
+	if (sym->type == SYM_NODE && base && base->type == SYM_FN)
+		visit_stmt(v, base->stmt);
+}
+
+static void visit_sym_list(struct visit *v, struct symbol_list *list)
+{
+	struct symbol *sym;
+
+	FOR_EACH_PTR(list, sym) {
+		visit_sym(v, sym);
+	} END_FOR_EACH_PTR(sym);
+}
+
+static void visit_expr(struct visit *v, struct expression *expr)
+{
+	if (!expr)
+		return;
+	if (v->exprs & ((UV)1 << expr->type))
+		visit_call(v, bless_expr(expr));
+
+	switch (expr->type) {
+	case EXPR_STATEMENT:
+		visit_stmt(v, expr->statement);
+		break;
+	case EXPR_BINOP: case EXPR_COMMA: case EXPR_COMPARE:
+	case EXPR_LOGICAL: case EXPR_ASSIGNMENT:
+		visit_expr(v, expr->left);
+		visit_expr(v, expr->right);
+		break;
+	case EXPR_PREOP: case EXPR_POSTOP:
+		visit_expr(v, expr->unop);
+		break;
+	case EXPR_DEREF:
+		visit_expr(v, expr->deref);
+		break;
+	case EXPR_SLICE:
+		visit_expr(v, expr->base);
+		break;
+	case EXPR_CAST: case EXPR_FORCE_CAST: case EXPR_IMPLIED_CAST:
+	case EXPR_SIZEOF: case EXPR_ALIGNOF: case EXPR_PTRSIZEOF:
+		visit_expr(v, expr->cast_expression);
+		break;
+	case EXPR_CONDITIONAL: case EXPR_SELECT:
+		visit_expr(v, expr->conditional);
+		visit_expr(v, expr->cond_true);
+		visit_expr(v, expr->cond_false);
+		break;
+	case EXPR_CALL:
+		visit_expr(v, expr->fn);
+		visit_expr_list(v, expr->args);
+		break;
+	case EXPR_INITIALIZER:
+		visit_expr_list(v, expr->expr_list);
+		break;
+	case EXPR_IDENTIFIER:
+		visit_expr(v, expr->ident_expression);
+		break;
+	case EXPR_INDEX:
+		visit_expr(v, expr->idx_expression);
+		break;
+	case EXPR_POS:
+		visit_expr(v, expr->init_expr);
+		break;
+	default:
+		break;
+	}
+}
+
+static void visit_stmt(struct visit *v, struct statement *stmt)
+{
+	struct statement *s;
+
+	if (!stmt)
+		return;
+	if (v->stmts & ((UV)1 << stmt->type))
+		visit_call(v, bless_stmt(stmt));
+
+	switch (stmt->type) {
+	case STMT_DECLARATION:
+		visit_sym_list(v, stmt->declaration);
+		break;
+	case STMT_EXPRESSION:
+		visit_expr(v, stmt->expression);
+		visit_expr(v, stmt->context);
+		break;
+	case STMT_CONTEXT:
+		visit_expr(v, stmt->expression);
+		break;
+	case STMT_RETURN:
+		visit_expr(v, stmt->ret_value);
+		break;
+	case STMT_IF:
+		visit_expr(v, stmt->if_conditional);
+		visit_stmt(v, stmt->if_true);
+		visit_stmt(v, stmt->if_false);
+		break;
+	case STMT_COMPOUND:
+		visit_stmt(v, stmt->args);
+		FOR_EACH_PTR(stmt->stmts, s) {
+			visit_stmt(v, s);
+		} END_FOR_EACH_PTR(s);
+		break;
+	case STMT_LABEL:
+		visit_stmt(v, stmt->label_statement);
+		break;
+	case STMT_CASE:
+		visit_expr(v, stmt->case_expression);
+		visit_expr(v, stmt->case_to);
+		visit_stmt(v, stmt->case_statement);
+		break;
+	case STMT_SWITCH:
+		visit_expr(v, stmt->switch_expression);
+		visit_stmt(v, stmt->switch_statement);
+		break;
+	case STMT_ITERATOR:
+		visit_stmt(v, stmt->iterator_pre_statement);
+		visit_expr(v, stmt->iterator_pre_condition);
+		visit_stmt(v, stmt->iterator_statement);
+		visit_stmt(v, stmt->iterator_post_statement);
+		visit_expr(v, stmt->iterator_post_condition);
+		break;
+	case STMT_GOTO:
+		visit_expr(v, stmt->goto_expression);
+		break;
+	case STMT_ASM:
+		visit_expr(v, stmt->asm_string);
+		visit_expr_list(v, stmt->asm_outputs);
+		visit_expr_list(v, stmt->asm_inputs);
+		break;
+	case STMT_RANGE:
+		visit_expr(v, stmt->range_expression);
+		visit_expr(v, stmt->range_low);
+		visit_expr(v, stmt->range_high);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * All tokens starting at t as one packed string of native ints
+ * (type, line, column, ident-id), ident-id indexes into names or is -1.
+ */
+static SV *pack_tokens(SCTX_ struct token *t, AV *names)
+{
+	HV *ids = newHV();
+	SV *packed = newSVpvn("", 0);
+	struct token *c;
+	int n = 0;
+
+	for (c = t; c && !eof_token(c); c = c->next)
+		n++;
+	SvGROW(packed, n * 4 * sizeof(I32) + 1);
+
+	for (; t && !eof_token(t); t = t->next) {
+		I32 rec[4];
+
+		rec[0] = token_type(t);
+		rec[1] = t->pos.line;
+		rec[2] = t->pos.pos;
+		rec[3] = -1;
+		if (token_type(t) == TOKEN_IDENT) {
+			SV **id = hv_fetch(ids, (char *)&t->ident, sizeof(t->ident), 0);
+			if (id) {
+				rec[3] = SvIV(*id);
+			} else {
+				rec[3] = av_len(names) + 1;
+				av_push(names, newSVpvn(t->ident->name, t->ident->len));
+				hv_store(ids, (char *)&t->ident, sizeof(t->ident), newSViv(rec[3]), 0);
+			}
+		}
+		sv_catpvn(packed, (char *)rec, sizeof(rec));
+	}
+	SvREFCNT_dec((SV *)ids);
+	return packed;
+}
+
+/* parse argv into a fresh context, touches no perl state */
+static struct sparse_ctx *
+run_sparse (struct sparse_ctx *_sctx, int argc, char **argv, void (*die_hook)(struct sparse_ctx *))
+{
+	char *file;
+
+	_sctx = sparse_ctx_init( _sctx);
+	_sctx ->ppnoopt = 1;
+	_sctx ->die_hook = die_hook;
+	_sctx ->argv = argv;
+	_sctx ->symlist = sparse_initialize(sctx_ argc, argv, &_sctx->filelist);
+	FOR_EACH_PTR_NOTAG(_sctx->filelist, file) {
+		concat_symbol_list(sctx_ sparse(sctx_ file), &_sctx ->symlist);
+	} END_FOR_EACH_PTR_NOTAG(file);
+	return _sctx;
+}
+
+static char **
+job_argv (SV **args, int n)
+{
+	char **a = (char **)malloc(sizeof(void *) * (n+2));
+	int i;
+
+	a[0] = "sparse";
+	for (i = 0; i < n; i++)
+		a[i+1] = strdup(SvPV_nolen(args[i]));
+	a[n+1] = 0;
+	return a;
+}
+
+struct batch {
+	struct batch_job { int argc, failed; char **argv; struct sparse_ctx *ctx; } *jobs;
+	int nr, next;
+	pthread_mutex_t lock;
+};
+
+/* a fatal error ends the job, not the process */
+static TLS_ATTR jmp_buf *batch_jmp;
+
+static void
+batch_die (struct sparse_ctx *_sctx)
+{
+	longjmp(*batch_jmp, 1);
+}
+
+static void *
+batch_worker (void *data)
+{
+	struct batch *b = data;
+	jmp_buf jb;
+
+	batch_jmp = &jb;
+	for (;;) {
+		struct batch_job *j;
+		pthread_mutex_lock(&b->lock);
+		j = b->next < b->nr ? &b->jobs[b->next++] : NULL;
+		pthread_mutex_unlock(&b->lock);
+		if (!j)
+			return NULL;
+		if (!setjmp(jb))
+			run_sparse(j->ctx, j->argc, j->argv, batch_die);
+		else
+			j->failed = 1;
+	}
+}
+
+static void
+run_batch (struct batch *b, int threads)
+{
+	pthread_t *t;
+	int i, n = 0;
+
+	pthread_mutex_init(&b->lock, NULL);
+	if (threads > b->nr)
+		threads = b->nr;
+	if (threads <= 1) {
+		batch_worker(b);
+		pthread_mutex_destroy(&b->lock);
+		return;
+	}
+	t = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+	for (i = 0; i < threads; i++)
+		if (!pthread_create(&t[n], NULL, batch_worker, b))
+			n++;
+	if (!n)
+		batch_worker(b);
+	for (i = 0; i < n; i++)
+		pthread_join(t[i], NULL);
+	pthread_mutex_destroy(&b->lock);
+	free(t);
+}
+
+
 MODULE = C::sparse         PACKAGE = C::sparse
 
 INCLUDE: const-xs.inc
@@ -407,32 +886,69 @@ x2()
 sparsectx
 sparse(...)
     PREINIT:
-	struct string_list *filelist = NULL;
-	char *file; char **a = 0; int i; struct symbol *sym; struct symbol_list *symlist;
+	char **a; int i;
 	struct sparse_ctx *_sctx;
     CODE:
-        a = (char **)malloc(sizeof(void *) * (items+2));
-	a[0] = "sparse";
-        for (i = 0; i < items; i++) {
-            a[i+1] = strdup(SvPV_nolen(ST(i)));
-	}
-        a[items+1] = 0;
+	a = job_argv(&ST(0), items);
 	TRACE(printf("sparse_initialize("));
 	for (i = 0; i < items+1; i++) {
 	    TRACE(printf(" \"%s\"",a[i]));
         }
 	TRACE(printf(")\n"));
 	New (SPARSE_MALLOC_ID,  _sctx, 1, struct sparse_ctx);
-	_sctx = sparse_ctx_init( _sctx);
-        _sctx ->ppnoopt = 1;
-	_sctx ->symlist = sparse_initialize(sctx_ items+1, a, &_sctx->filelist);
-	FOR_EACH_PTR_NOTAG(_sctx->filelist, file) {
-            concat_symbol_list(sctx_ sparse(sctx_ file), &_sctx ->symlist);
-        } END_FOR_EACH_PTR_NOTAG(file);
+	_sctx = run_sparse(_sctx, items+1, a, NULL);
 	RETVAL = new_sparsectx((sparsectx_t)_sctx);
     OUTPUT:
 	RETVAL	
 
+void
+batch(threads, ...)
+	int threads
+    PREINIT:
+	struct batch b; int i;
+    PPCODE:
+	b.nr = items - 1; b.next = 0;
+	New (SPARSE_MALLOC_ID, b.jobs, b.nr ? b.nr : 1, struct batch_job);
+	for (i = 0; i < b.nr; i++) {
+	    SV *job = ST(i+1);
+	    AV *av;
+	    if (!SvROK(job) || SvTYPE(SvRV(job)) != SVt_PVAV) {
+		while (i--) {
+		    char **a;
+		    for (a = b.jobs[i].argv + 1; *a; a++)
+			free(*a);
+		    free(b.jobs[i].argv);
+		    Safefree(b.jobs[i].ctx);
+		}
+		Safefree(b.jobs);
+		croak("batch: job %d is not an array reference", (int)i);
+	    }
+	    av = (AV *)SvRV(job);
+	    b.jobs[i].argc = av_len(av) + 2;
+	    b.jobs[i].failed = 0;
+	    b.jobs[i].argv = job_argv(AvARRAY(av), b.jobs[i].argc - 1);
+	    New (SPARSE_MALLOC_ID, b.jobs[i].ctx, 1, struct sparse_ctx);
+	}
+	/* the workers only see C data, the interpreter is not entered */
+	run_batch(&b, threads);
+	EXTEND(SP, b.nr);
+	for (i = 0; i < b.nr; i++) {
+	    SV *rv = sv_newmortal();
+	    if (b.jobs[i].failed) {
+		char **a;
+		for (a = b.jobs[i].argv + 1; *a; a++)
+		    free(*a);
+		free(b.jobs[i].argv);
+		sparse_ctx_free(b.jobs[i].ctx);
+		Safefree(b.jobs[i].ctx);
+		PUSHs(&PL_sv_undef);
+		continue;
+	    }
+	    sv_bless(sv_setref_pv(rv, NULL, new_sparsectx((sparsectx_t)b.jobs[i].ctx)), sparsectx_class_hv);
+	    PUSHs(rv);
+	}
+	Safefree(b.jobs);
+
 MODULE = C::sparse   PACKAGE = C::sparse::ctx
 PROTOTYPES: ENABLE
 
@@ -444,6 +960,20 @@ DESTROY (r)
     CODE:
         c = r->m;
         /*TRACE (printf ("%s DESTROY %p\n", sparsectx_class, r);fflush(stdout););*/
+        if (c) {
+            char **a;
+            unlink_sparsectx (r);
+            purge_ctx_wrappers (c);
+            for (a = c->argv + 1; *a; a++)
+                free (*a);
+            free (c->argv);
+            sparse_ctx_free (c);
+            Safefree (c);
+            /* only this referent pointed at r */
+            r->stale = 0;
+            r->next = sparsectx_freelist;
+            sparsectx_freelist = r;
+        }
         assert_support (sparsectx_count--);
         TRACE_ACTIVE ();
 
@@ -509,6 +1039,35 @@ symbols(p,...)
 	}
 
 
+void
+visit(p,cb,stmts,exprs)
+	sparsectx p
+	SV *cb
+	UV stmts
+	UV exprs
+    PREINIT:
+	struct visit v;
+    CODE:
+	v.cb = cb; v.stmts = stmts; v.exprs = exprs;
+	visit_sym_list(&v, ((struct sparse_ctx *)p->m)->symlist);
+
+MODULE = C::sparse   PACKAGE = C::sparse::stream
+PROTOTYPES: ENABLE
+
+void
+tokens(s)
+	sparsestream s
+    PREINIT:
+	AV *names = newAV(); struct token *t; SPARSE_CTX_GEN(0);
+    PPCODE:
+	t = s->m->e ? s->m->e->s : NULL;
+	if (t)
+	    SPARSE_CTX_SET(t->ctx);
+	EXTEND(SP, 2);
+	PUSHs(sv_2mortal(pack_tokens(sctx_ t, names)));
+	PUSHs(sv_2mortal(newRV_noinc((SV *)names)));
+
+
 MODULE = C::sparse   PACKAGE = C::sparse::tok
 PROTOTYPES: ENABLE
 
@@ -615,6 +1174,18 @@ id(s)
     OUTPUT:
 	RETVAL
 
+void
+visit(s,cb,stmts,exprs)
+	sparsesym s
+	SV *cb
+	UV stmts
+	UV exprs
+    PREINIT:
+	struct visit v;
+    CODE:
+	v.cb = cb; v.stmts = stmts; v.exprs = exprs;
+	visit_sym(&v, s->m);
+
 SV *
 typename(s)
 	sparsesym s
@@ -0,0 +1,30 @@
+#!/usr/bin/perl -w
+use C::sparse qw(:all);
+use Scalar::Util qw(refaddr);
+use Test::More tests => 7;
+
+my $s0 = C::sparse::sparse("t/visit.c");
+
+# packed token dump of one stream
+my ($f) = grep { $_->name eq 't/visit.c' } $s0->streams;
+my @s = $f->e->s;
+my ($packed, $names) = $f->tokens;
+my @t = unpack("(i4)*", $packed);
+is( scalar(@t) / 4, scalar(@s), "one record per token" );
+my ($first) = grep { $s[$_]->isa('C::sparse::tok::TOKEN_IDENT') } 0..$#s;
+is( $$names[$t[$first * 4 + 3]], "$s[$first]", "ident ids index the name table" );
+is( $t[$first * 4 + 1], $s[$first]->position->line, "line of the record" );
+
+# C side walk, only calls back for the requested kinds
+my %n;
+$s0->visit(sub { $n{ref($_[0])}++ },
+	   (1 << C::sparse::STMT_RETURN) | (1 << C::sparse::STMT_ITERATOR),
+	   (1 << C::sparse::EXPR_CALL));
+is( $n{'C::sparse::stmt::STMT_RETURN'}, 2, "returns" );
+is( $n{'C::sparse::stmt::STMT_ITERATOR'}, 1, "loops" );
+is( $n{'C::sparse::expr::EXPR_CALL'}, 2, "calls" );
+
+# wrappers are cached per C pointer
+my @a = $s0->symbols;
+my @b = $s0->symbols;
+is( refaddr($a[0]), refaddr($b[0]), "same wrapper for the same symbol" );
@@ -0,0 +1,33 @@
+#!/usr/bin/perl -w
+use C::sparse qw(:all);
+use Test::More tests => 5;
+
+# contexts are released when the last reference goes
+for (1..50) {
+    my $s = C::sparse::sparse("t/visit.c");
+    my @s = $s->symbols;
+}
+pass( "create and drop contexts" );
+
+my $s0 = C::sparse::sparse("t/visit.c");
+my ($sym) = $s0->symbols;
+my $name = $sym->ident->name;
+ok( length($name), "symbol of a live context" );
+undef $s0;
+
+# stale wrappers croak instead of touching freed memory
+eval { $sym->ident };
+like( $@, qr/sparse context already destroyed/, "stale wrapper croaks" );
+
+my $s1 = C::sparse::sparse("t/visit.c");
+my ($sym1) = $s1->symbols;
+is( $sym1->ident->name, $name, "fresh context after a destroy" );
+
+# several contexts alive at once, dropped out of order and reused
+my @live;
+for (1..20) {
+    push @live, C::sparse::sparse("t/visit.c") while @live < 3;
+    splice @live, 1, 1;
+}
+is( join(",", map { ($_->symbols)[0]->ident->name } @live), "$name,$name",
+    "several live contexts" );
@@ -0,0 +1,20 @@
+#!/usr/bin/perl -w
+use C::sparse qw(:all);
+use Test::More tests => 6;
+
+my $one = C::sparse::sparse("t/visit.c");
+my @want = map { $_->ident->name } $one->symbols;
+
+# one context per job, parsed on 4 threads
+my @c = C::sparse::batch(4, map { ["-Wno-decl", "t/visit.c"] } 1..8);
+is( scalar(@c), 8, "one context per job" );
+isa_ok( $c[7], "C::sparse::ctx" );
+is_deeply( [ map { $_->ident->name } $c[5]->symbols ], \@want, "same symbols as a serial parse" );
+
+eval { C::sparse::batch(2, "t/visit.c") };
+like( $@, qr/not an array reference/, "jobs are array references" );
+
+# a fatal error only fails its own job
+my @r = C::sparse::batch(2, ["t/die.c"], ["t/visit.c"]);
+ok( !defined $r[0], "failed job gives undef" );
+isa_ok( $r[1], "C::sparse::ctx" );
@@ -0,0 +1 @@
+#include "does-not-exist.h"
@@ -0,0 +1,12 @@
+int g(int a, int b);
+
+int f(int a)
+{
+	int i, s = 0;
+
+	for (i = 0; i < a; i++)
+		s += g(i, a);
+	if (s)
+		return g(s, 1);
+	return 0;
+}
@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <errno.h>
 #include <time.h>
 
 #include "lib.h"
@@ -46,6 +47,7 @@
 
 static int false_nesting = 0;
 static struct pushdown_stack_op *cur_stack_op = 0;
+static void (*pp_emit)(struct token *) = NULL;
 
 #define INCLUDEPATHS 300
 const char *includepath[INCLUDEPATHS+1] = { /* insync with ctx.c */
@@ -89,6 +91,35 @@ static const char **dirafter_includepath = includepath + 3;
 		stream->protect = NULL;	\
 	} while(0)
 
+/*
+ * Tokens that are streamed out with pp_emit are not kept for the
+ * trace: nothing records what was consumed and pushed, and argument
+ * lists and separators that did not make it into the result are
+ * given back to the token allocator when the expansion is done, as
+ * are the tokens once they are out and the expansion records once
+ * their macro is substituted. The allocators only take them back
+ * then, see sparse_tokenstream().
+ */
+static inline int pp_traced(SCTX)
+{
+	return !sctxp pp_emit;
+}
+
+/* only the trace walks the expansions that happened in ep */
+static void push_expansion(SCTX_ struct expansion *ep, struct expansion *e)
+{
+	if (pp_traced(sctx)) {
+		e->n = ep->pdstk;
+		ep->pdstk = e;
+	}
+}
+
+static void expansion_done(SCTX_ struct expansion *e)
+{
+	if (e && !pp_traced(sctx))
+		__free_expansion(sctx_ e);
+}
+
 struct expansion *expansion_new(SCTX_ int typ)
 {
 	struct expansion *e = __alloc_expansion(sctx_ 0);
@@ -174,27 +205,30 @@ static int expand(SCTX_ struct expansion *e, struct token **, struct symbol *, s
 
 static void replace_with_string(SCTX_ struct token *token, const char *str)
 {
-	int size = strlen(str) + 1;
-	struct string *s = __alloc_string(sctx_ size);
-
-	s->length = size;
-	memcpy(s->data, str, size);
 	token_type(token) = TOKEN_STRING;
-	token->string = s;
+	token->string = intern_string(sctx_ str, strlen(str));
 }
 
 static void replace_with_integer(SCTX_ struct token *token, unsigned int val)
 {
-	char *buf = __alloc_bytes(sctx_ 11);
-	sprintf(buf, "%u", val);
+	char buf[11];
+	int len = sprintf(buf, "%u", val);
 	token_type(token) = TOKEN_NUMBER;
-	token->number = buf;
+	token->number = intern_string(sctx_ buf, len)->data;
 }
 
+/*
+ * Asked of every identifier that is scanned: ident->macro is what
+ * lookup_symbol(ident, NS_MACRO | NS_UNDEF) would find on the chain,
+ * see bind_symbol() and remove_symbol_scope().
+ */
 static struct symbol *lookup_macro(SCTX_ struct ident *ident)
 {
-	struct symbol *sym = lookup_symbol(sctx_ ident, NS_MACRO | NS_UNDEF);
-	if (sym && sym->namespace != NS_MACRO)
+	struct symbol *sym = ident->macro;
+	if (!sym)
+		return NULL;
+	sym->used = 1;
+	if (sym->namespace != NS_MACRO)
 		sym = NULL;
 	return sym;
 }
@@ -227,8 +261,8 @@ static int expand_one_symbol(SCTX_ struct expansion *e, struct token **list)
 {
 	struct token *token = *list;
 	struct symbol *sym;
-	static char buffer[12]; /* __DATE__: 3 + ' ' + 2 + ' ' + 4 + '\0' */
-	static time_t t = 0;
+	static TLS_ATTR char buffer[12]; /* __DATE__: 3 + ' ' + 2 + ' ' + 4 + '\0' */
+	static TLS_ATTR time_t t = 0;
 
 	if (token->pos.noexpand)
 		return 1;
@@ -258,8 +292,61 @@ static int expand_one_symbol(SCTX_ struct expansion *e, struct token **list)
 
 #ifndef DO_CTX
 struct token_stack *tok_stk = 0;
+static struct scratch_chunk *scratch = NULL, *scratch_spare = NULL;
 #endif
 
+/*
+ * The argument arrays and token stack records of expand() live only as
+ * long as the expansion, and nested expansions end before the outer one:
+ * they come from a stack that is unwound to the mark taken on entry.
+ * Chunks that are unwound are kept for the next expansion.
+ */
+#define SCRATCH_CHUNK	(64 * 1024)
+
+static inline struct scratch_mark scratch_mark(SCTX)
+{
+	struct scratch_mark m = { sctxp scratch, sctxp scratch ? sctxp scratch->used : 0 };
+	return m;
+}
+
+static void *scratch_alloc(SCTX_ unsigned long size)
+{
+	struct scratch_chunk *c = sctxp scratch;
+	void *p;
+
+	size = (size + sizeof(c->data[0]) - 1) & ~(sizeof(c->data[0]) - 1);
+	if (!c || c->size - c->used < size) {
+		c = sctxp scratch_spare;
+		if (c && c->size >= size) {
+			sctxp scratch_spare = c->prev;
+		} else {
+			unsigned long n = size > SCRATCH_CHUNK ? size : SCRATCH_CHUNK;
+			c = malloc(sizeof(*c) + n);
+			if (!c)
+				sparse_die(sctx_ "out of memory");
+			c->size = n;
+		}
+		c->prev = sctxp scratch;
+		c->used = 0;
+		sctxp scratch = c;
+	}
+	p = (char *)c->data + c->used;
+	c->used += size;
+	return p;
+}
+
+static void scratch_release(SCTX_ struct scratch_mark m)
+{
+	while (sctxp scratch != m.chunk) {
+		struct scratch_chunk *c = sctxp scratch;
+		sctxp scratch = c->prev;
+		c->prev = sctxp scratch_spare;
+		sctxp scratch_spare = c;
+	}
+	if (m.chunk)
+		m.chunk->used = m.used;
+}
+
 static inline int expansion_depth(SCTX_ struct expansion *e)
 {
 	int max = -1, c; struct token *tok;
@@ -282,7 +369,7 @@ static inline int expansion_depth(SCTX_ struct expansion *e)
 
 static inline struct token_stack *token_push_rec(SCTX)
 {
-	struct token_stack *t = malloc(sizeof(struct token_stack));
+	struct token_stack *t = scratch_alloc(sctx_ sizeof(struct token_stack));
 	memset(t, 0, sizeof(struct token_stack));
 	t->p = &t->h;
 	t->n = sctxp tok_stk;
@@ -295,7 +382,6 @@ static inline struct cons *token_pop_rec(SCTX)
 	struct token_stack *t = sctxp tok_stk;
 	struct cons *h = t->h;
 	sctxp tok_stk = t->n;
-	free(t);
 	return h;
 }
 
@@ -344,18 +430,28 @@ void cons_unshift(SCTX_ struct cons **c, struct token *token) {
 static struct token *scan_next(SCTX_ struct expansion *e, struct token **where)
 {
 	struct token *token = *where;
-	if (token_type(token) != TOKEN_UNTAINT)
-		return 
-			cons_unshift(sctx_  &e->pdstk_pop, token),
-			token_push(sctx_ token),
-			token;
+	int traced = pp_traced(sctx);
+	if (token_type(token) != TOKEN_UNTAINT) {
+		if (traced) {
+			cons_unshift(sctx_  &e->pdstk_pop, token);
+			token_push(sctx_ token);
+		}
+		return token;
+	}
 	do {
+		struct token *untaint = token;
+
 		token->ident->tainted = 0;
 		token = token->next;
-		cons_unshift(sctx_  &e->pdstk_pop, token);
+		if (traced)
+			cons_unshift(sctx_  &e->pdstk_pop, token);
+		else
+			__free_token(sctx_ untaint);
 	} while (token_type(token) == TOKEN_UNTAINT);
 	*where = token;
-	return token_push(sctx_ token), token;
+	if (traced)
+		token_push(sctx_ token);
+	return token;
 }
 
 static void expand_list(SCTX_ struct expansion *e, struct token **list )
@@ -364,7 +460,8 @@ static void expand_list(SCTX_ struct expansion *e, struct token **list )
 	while (!eof_token(next = scan_next(sctx_ e, list))) {
 		if (token_type(next) != TOKEN_IDENT || 
 		    expand_one_symbol(sctx_ e, list)) {
-			cons_unshift(sctx_ &e->pdstk_push, next);
+			if (pp_traced(sctx))
+				cons_unshift(sctx_ &e->pdstk_push, next);
 			list = &next->next;
 		}
 	}
@@ -421,6 +518,22 @@ static struct token *collect_arg(SCTX_ struct expansion *e, struct token *prev,
  * We store arglist as <counter> [arg1] <number of uses for arg1> ... eof
  */
 
+static void free_token_list(SCTX_ struct token *list)
+{
+	while (list && !eof_token(list)) {
+		struct token *next = list->next;
+		__free_token(sctx_ list);
+		list = next;
+	}
+}
+
+/* the '(', ',' and ')' around the arguments, once they are collected */
+static inline void free_separator(SCTX_ struct token *token)
+{
+	if (!pp_traced(sctx))
+		__free_token(sctx_ token);
+}
+
 struct arg {
 	struct token *arg;
 	struct token *expanded;
@@ -446,6 +559,7 @@ static int collect_arguments(SCTX_ struct expansion *e, struct token *start, str
 			count++;
 			goto Emany;
 		}
+		free_separator(sctx_ start);
 	} else {
 		for (count = 0; count < wanted; count++) {
 			struct argcount *p = &arglist->next->count;
@@ -457,6 +571,7 @@ static int collect_arguments(SCTX_ struct expansion *e, struct token *start, str
 			args[count].n_normal = p->normal;
 			args[count].n_quoted = p->quoted;
 			args[count].n_str = p->str;
+			free_separator(sctx_ start);
 			if (match_op(next, ')')) {
 				count++;
 				break;
@@ -478,6 +593,7 @@ static int collect_arguments(SCTX_ struct expansion *e, struct token *start, str
 			goto Efew;
 	}
 	what->next = next->next;
+	free_separator(sctx_ next);
 	return 1;
 
 Efew:
@@ -506,7 +622,7 @@ static struct token *dup_one(SCTX_ struct token *tok)
 {
 	struct token *newtok = __alloc_token(sctx_ 0);
 	*newtok = *tok;
-	newtok->copy = tok;
+	newtok->copy = pp_traced(sctx) ? tok : NULL;
 #ifdef DO_CTX
 	newtok->ctx = sctx;
 #endif
@@ -517,11 +633,12 @@ static struct token *dup_list(SCTX_ struct token *list, struct token *end)
 {
 	struct token *res = NULL;
 	struct token **p = &res;
+	int traced = pp_traced(sctx);
 
 	while ((list != end) && !eof_token(list)) {
 		struct token *newtok = __alloc_token(sctx_ 0);
 		*newtok = *list;
-		newtok->copy = list;
+		newtok->copy = traced ? list : NULL;
 #ifdef DO_CTX
 		newtok->ctx = sctx;
 #endif
@@ -568,7 +685,7 @@ static struct token *dup_list_e(SCTX_ struct token *list, struct token *end, str
 
 static const char *show_token_sequence(SCTX_ struct token *token, int quote)
 {
-	static char buffer[MAX_STRING];
+	static TLS_ATTR char buffer[MAX_STRING];
 	char *ptr = buffer;
 	int whitespace = 0;
 
@@ -597,16 +714,12 @@ static const char *show_token_sequence(SCTX_ struct token *token, int quote)
 static struct token *stringify(SCTX_ struct token *arg)
 {
 	const char *s = show_token_sequence(sctx_ arg, 1);
-	int size = strlen(s)+1;
 	struct token *token = __alloc_token(sctx_ 0);
-	struct string *string = __alloc_string(sctx_ size);
 
-	memcpy(string->data, s, size);
-	string->length = size;
 	token->space = 0;
 	token->pos = arg->pos;
 	token_type(token) = TOKEN_STRING;
-	token->string = string;
+	token->string = intern_string(sctx_ s, strlen(s));
 	token->next = &sctxp eof_token_entry;
 #ifdef DO_CTX
 	token->ctx = sctx;
@@ -643,6 +756,7 @@ static void expand_arguments_pp(SCTX_ int count, struct arg *args, struct expans
 			e->mac = m;
 			expand_list(sctx_ e, &args[i].expanded);
 			e->d = args[i].expanded;
+			expansion_done(sctx_ e);
 		}
 	}
 }
@@ -716,15 +830,19 @@ static enum token_type combine(SCTX_ struct token *left, struct token *right, ch
 
 static int merge(SCTX_ struct token *left, struct token *right)
 {
-	static char buffer[512];
+	static TLS_ATTR char buffer[512];
 	enum token_type res = combine(sctx_ left, right, buffer);
 	int n; struct token *tok;
 	struct expansion *e;
 
-	e = expansion_new(sctx_ EXPANSION_CONCAT);
-	e->s = dup_one(sctx_ left);
-	e->s->next = tok = dup_one(sctx_ right); tok->next = NULL;
-	e->d = left;
+	if (pp_traced(sctx)) {
+		e = expansion_new(sctx_ EXPANSION_CONCAT);
+		e->s = dup_one(sctx_ left);
+		e->s->next = tok = dup_one(sctx_ right); tok->next = NULL;
+		e->d = left;
+	} else {
+		e = left->e;
+	}
 
 	switch (res) {
 	case TOKEN_IDENT:
@@ -733,14 +851,12 @@ static int merge(SCTX_ struct token *left, struct token *right)
 		left->e = e;
 		return 1;
 
-	case TOKEN_NUMBER: {
-		char *number = __alloc_bytes(sctx_ strlen(buffer) + 1);
-		memcpy(number, buffer, strlen(buffer) + 1);
+	case TOKEN_NUMBER:
 		token_type(left) = TOKEN_NUMBER;	/* could be . + num */
-		left->number = number;
+		left->number = intern_string(sctx_ buffer, strlen(buffer))->data;
 		left->e = e;
 		return 1;
-	}
+
 
 	case TOKEN_SPECIAL:
 		if (buffer[2] && buffer[3])
@@ -788,11 +904,21 @@ static struct token *dup_token(SCTX_ struct token *token, struct position *strea
 	return alloc;	
 }
 
-static struct token **copy(SCTX_ struct token **where, struct token *body, struct token *list, int *count)
+/*
+ * The trace keeps every argument as it was passed and as it expanded,
+ * so each use is a copy. Without it the last use takes the tokens and
+ * clears *listp, what is left in the arguments afterwards is garbage,
+ * see free_args().
+ */
+static struct token **copy(SCTX_ struct token **where, struct token *body, struct token **listp, int *count)
 {
+	struct token *list = *listp;
 	int need_copy = --*count; /*struct expansion *e;*/
 	/*struct token **o = where;*/ /*struct cons *l;*/
-	need_copy = 1;
+	if (pp_traced(sctx))
+		need_copy = 1;
+	else if (!need_copy)
+		*listp = NULL;
 	while (!eof_token(list)) {
 		struct token *token;
 		if (need_copy)
@@ -837,6 +963,19 @@ static int handle_kludge(SCTX_ struct token **p, struct arg *args)
 	}
 }
 
+/* the argument lists that substitute() did not take */
+static void free_args(SCTX_ int count, struct arg *args)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (args[i].expanded != args[i].arg)
+			free_token_list(sctx_ args[i].expanded);
+		free_token_list(sctx_ args[i].arg);
+		free_token_list(sctx_ args[i].str);
+	}
+}
+
 static struct token **substitute(SCTX_ struct token **list, struct token *body, struct arg *args)
 {
 	struct position *base_pos = &(*list)->pos;
@@ -844,7 +983,7 @@ static struct token **substitute(SCTX_ struct token **list, struct token *body,
 	enum {Normal, Placeholder, Concat} state = Normal;
 
 	for (; !eof_token(body); body = body->next) {
-		struct token *added, *arg;
+		struct token *added, *arg, **argp;
 		struct token **tail;
 		struct token *t;
 
@@ -873,12 +1012,14 @@ static struct token **substitute(SCTX_ struct token **list, struct token *body,
 			break;
 
 		case TOKEN_STR_ARGUMENT:
-			arg = args[body->argnum].str;
+			argp = &args[body->argnum].str;
+			arg = *argp;
 			count = &args[body->argnum].n_str;
 			goto copy_arg;
 
 		case TOKEN_QUOTED_ARGUMENT:
-			arg = args[body->argnum].arg;
+			argp = &args[body->argnum].arg;
+			arg = *argp;
 			count = &args[body->argnum].n_quoted;
 			if (!arg || eof_token(arg)) {
 				if (state == Concat)
@@ -890,7 +1031,8 @@ static struct token **substitute(SCTX_ struct token **list, struct token *body,
 			goto copy_arg;
 
 		case TOKEN_MACRO_ARGUMENT:
-			arg = args[body->argnum].expanded;
+			argp = &args[body->argnum].expanded;
+			arg = *argp;
 			count = &args[body->argnum].n_normal;
 			if (eof_token(arg)) {
 				state = Normal;
@@ -899,7 +1041,7 @@ static struct token **substitute(SCTX_ struct token **list, struct token *body,
 		copy_arg:
 			/* todo: mark the argument replacemnt as expansion */
 
-			tail = copy(sctx_ &added, body, arg, count);
+			tail = copy(sctx_ &added, body, argp, count);
 			added->pos.newline = body->pos.newline;
 			added->pos.whitespace = body->pos.whitespace;
 			break;
@@ -932,6 +1074,8 @@ static struct token **substitute(SCTX_ struct token **list, struct token *body,
 			*list = added->next;
 			if (tail != &added->next)
 				list = tail;
+			if (!pp_traced(sctx))
+				__free_token(sctx_ added);
 		} else {
 			*list = added;
 			list = tail;
@@ -946,9 +1090,62 @@ int mark_expand(SCTX_ struct token *from, struct token *to, struct expansion *e)
 	return 0;
 }
 
-static int expand(SCTX_ struct expansion *ep, struct token **list, struct symbol *sym, struct token *mtok)
+/*
+ * An object-like macro whose body holds nothing that could expand or be
+ * substituted: its result is the body as is. Copy it without the argument
+ * machinery and let the trace refer to the definition instead of listing
+ * the copies, they can't be the name of a macro invocation.
+ */
+static int inert_expansion(SCTX_ struct token *arglist, struct token *body)
 {
+	if (arglist)
+		return 0;
+	for (; !eof_token(body); body = body->next) {
+		switch (token_type(body)) {
+		case TOKEN_IDENT:
+		case TOKEN_CONCAT:
+		case TOKEN_GNU_KLUDGE:
+		case TOKEN_STR_ARGUMENT:
+		case TOKEN_QUOTED_ARGUMENT:
+		case TOKEN_MACRO_ARGUMENT:
+			return 0;
+		default:
+			break;
+		}
+	}
+	return 1;
+}
+
+static void expand_inert(SCTX_ struct expansion *ep, struct token **list, struct symbol *sym, struct token *mtok)
+{
+	struct token *token = *list, *last = token->next, *body;
+	struct token **tail = list;
 	struct expansion *e;
+
+	e = expansion_new(sctx_ EXPANSION_MACRO);
+	push_expansion(sctx_ ep, e);
+	e->s = sym->expansion;
+	e->tok = mtok;
+	e->msym = sym;
+
+	token->ident->tainted = 1;
+	for (body = sym->expansion; !eof_token(body); body = body->next) {
+		struct token *added = dup_token(sctx_ body, &token->pos);
+		*tail = added;
+		tail = &added->next;
+	}
+	(*list)->pos.newline = token->pos.newline;
+	(*list)->pos.whitespace = token->pos.whitespace;
+	*tail = last;
+
+	if (!pp_traced(sctx))
+		__free_token(sctx_ token);
+	expansion_done(sctx_ e);
+}
+
+static int expand(SCTX_ struct expansion *ep, struct token **list, struct symbol *sym, struct token *mtok)
+{
+	struct expansion *e = NULL;
 	struct token *last;
 	struct token *token = *list;
 	struct ident *expanding = token->ident;
@@ -956,20 +1153,27 @@ static int expand(SCTX_ struct expansion *ep, struct token **list, struct symbol
 	int nargs = sym->arglist ? sym->arglist->count.normal : 0;
 	struct arg *args = NULL; /*[nargs];*/
 	struct token_stack *t = 0; int ret = 0;
+	struct scratch_mark mark = scratch_mark(sctx);
+
+	if (nargs) {
+		args = scratch_alloc(sctx_ nargs * sizeof(struct arg));
+		memset(args, 0, nargs * sizeof(struct arg));
+	}
 
-	if (nargs)
-		args = malloc(nargs * sizeof(struct arg));
-	
 	if (expanding->tainted) {
 		token->pos.noexpand = 1;
 		goto ret1;
 	}
 
+	if (sym->inert) {
+		expand_inert(sctx_ ep, list, sym, mtok);
+		return 0;
+	}
+
 	t = token_push_rec(sctx); /* register args_colllect */
 
 	e = expansion_new(sctx_ EXPANSION_MACRO);
-	e->n = ep->pdstk;
-	ep->pdstk = e;
+	push_expansion(sctx_ ep, e);
 	
 	e->s = 0 /*sym->expansion;*/;
 	e->d = 0 /*dup_list_e(sctx_ sym->expansion, 0, e)*/;
@@ -1006,13 +1210,18 @@ static int expand(SCTX_ struct expansion *ep, struct token **list, struct symbol
 	(*list)->pos.whitespace = token->pos.whitespace;
 	*tail = last;
 
-	e->pdstk_push = l = cons_list(sctx_ *list, last);
-	expansion_push(sctx_ e, l);
+	if (pp_traced(sctx)) {
+		e->pdstk_push = l = cons_list(sctx_ *list, last);
+		expansion_push(sctx_ e, l);
+	} else {
+		free_args(sctx_ nargs, args);
+		__free_token(sctx_ token);
+	}
 	
 ret2:
 	if (t) (token_pop_rec(sctx), t = 0);
-	if (args)
-		free(args);
+	expansion_done(sctx_ e);
+	scratch_release(sctx_ mark);
 	return ret;
 ret1:
 	ret = 1;
@@ -1021,7 +1230,7 @@ ret1:
 
 static const char *token_name_sequence(SCTX_ struct token *token, int endop, struct token *start)
 {
-	static char buffer[256];
+	static TLS_ATTR char buffer[256];
 	char *ptr = buffer;
 
 	while (!eof_token(token) && !match_op(token, endop)) {
@@ -1131,7 +1340,7 @@ static int try_include(SCTX_ const char *path, const char *filename, int flen, s
 {
 	int fd; struct expansion *e;
 	int plen = strlen(path);
-	static char fullname[PATH_MAX];
+	static TLS_ATTR char fullname[PATH_MAX];
 
 	memcpy(fullname, path, plen);
 	if (plen && path[plen-1] != '/') {
@@ -1261,7 +1470,9 @@ static int token_different(SCTX_ struct token *t1, struct token *t2)
 		different = 0;
 		break;
 	case TOKEN_NUMBER:
-		different = strcmp(t1->number, t2->number);
+		/* interned, but replace_with_defined() numbers aren't */
+		different = t1->number != t2->number &&
+			strcmp(t1->number, t2->number);
 		break;
 	case TOKEN_SPECIAL:
 		different = t1->special != t2->special;
@@ -1283,6 +1494,9 @@ static int token_different(SCTX_ struct token *t1, struct token *t2)
 
 		s1 = t1->string;
 		s2 = t2->string;
+		different = 0;
+		if (s1 == s2)
+			break;
 		different = 1;
 		if (s1->length != s2->length)
 			break;
@@ -1637,6 +1851,7 @@ static int do_handle_define(SCTX_ struct expansion *ep, struct stream *stream, s
 	if (!ret) {
 		sym->expansion = expansion;
 		sym->arglist = arglist;
+		sym->inert = inert_expansion(sctx_ arglist, expansion);
 		__free_token(sctx_ token);	/* Free the "define" token, but not the rest of the line */
 	}
 
@@ -1767,6 +1982,269 @@ static int handle_ifndef(SCTX_ struct expansion *e, struct stream *stream, struc
 
 static const char *show_token_sequence(SCTX_ struct token *token, int quote);
 
+/*
+ * Fast path for #if: integer constants, "defined" already replaced and
+ * identifiers zeroed, evaluated straight from the tokens with the types
+ * and conversions the C parser would use, but nothing allocated. Gives
+ * up on anything else and on whatever the parser would warn about, so
+ * the caller can fall back to it and get the same diagnostics.
+ */
+struct pp_value {
+	unsigned long long v;	/* sign extended when signed */
+	unsigned char bits, is_unsigned;
+	unsigned char is_not;	/* a '!' expression, "dubious" with & and | */
+};
+
+static void pp_set(struct pp_value *val, unsigned long long v, int bits, int is_unsigned)
+{
+	if (bits < 64) {
+		v &= (1ULL << bits) - 1;
+		if (!is_unsigned && (v & (1ULL << (bits - 1))))
+			v |= ~0ULL << bits;
+	}
+	val->v = v;
+	val->bits = bits;
+	val->is_unsigned = is_unsigned;
+	val->is_not = 0;
+}
+
+/* usual arithmetic conversions, like bigger_int_type() */
+static void pp_convert(struct pp_value *l, struct pp_value *r)
+{
+	int bits = l->bits, is_unsigned = l->is_unsigned;
+
+	if (r->bits > bits || (r->bits == bits && r->is_unsigned))
+		is_unsigned = r->is_unsigned;
+	if (r->bits > bits)
+		bits = r->bits;
+	pp_set(l, l->v, bits, is_unsigned);
+	pp_set(r, r->v, bits, is_unsigned);
+}
+
+static int pp_number(SCTX_ struct token *token, struct pp_value *val)
+{
+	const char *str = token->number;
+	unsigned long long value;
+	int size = 0, is_unsigned = 0, bits;
+	char *end;
+
+	errno = 0;
+	if (str[0] == '0' && tolower(str[1]) == 'b')
+		value = strtoull(str + 2, &end, 2);
+	else
+		value = strtoull(str, &end, 0);
+	if (end == str || errno)
+		return 0;
+	for (; *end; end++) {
+		if ((*end == 'u' || *end == 'U') && !is_unsigned)
+			is_unsigned = 1;
+		else if ((*end == 'l' || *end == 'L') && !size)
+			size = end[1] == *end ? (end++, 2) : 1;
+		else
+			return 0;
+	}
+	bits = size == 0 ? sctxp bits_in_int : size == 1 ? sctxp bits_in_long : sctxp bits_in_longlong;
+	if (bits < 64 && (value >> bits))
+		return 0;
+	if (!is_unsigned && (value >> (bits - 1))) {
+		/* octal and hex turn unsigned, the parser warns for decimals */
+		if (str[0] != '0')
+			return 0;
+		is_unsigned = 1;
+	}
+	pp_set(val, value, bits, is_unsigned);
+	return 1;
+}
+
+static int pp_cond(SCTX_ struct token **next, struct pp_value *val);
+
+static int pp_unary(SCTX_ struct token **next, struct pp_value *val)
+{
+	struct token *token = *next;
+	int op;
+
+	switch (token_type(token)) {
+	case TOKEN_NUMBER:
+		*next = token->next;
+		return pp_number(sctx_ token, val);
+	case TOKEN_ZERO_IDENT:
+		if (sctxp Wundef)
+			return 0;
+		*next = token->next;
+		pp_set(val, 0, sctxp bits_in_int, 0);
+		return 1;
+	case TOKEN_SPECIAL:
+		break;
+	default:
+		return 0;
+	}
+
+	op = token->special;
+	*next = token->next;
+	if (op == '(') {
+		if (!pp_cond(sctx_ next, val) || !match_op(*next, ')'))
+			return 0;
+		*next = (*next)->next;
+		return 1;
+	}
+	if (!pp_unary(sctx_ next, val))
+		return 0;
+	switch (op) {
+	case '+':
+		break;
+	case '-':
+		if (!val->is_unsigned && val->v == ~0ULL << (val->bits - 1))
+			return 0;	/* overflow */
+		pp_set(val, -val->v, val->bits, val->is_unsigned);
+		break;
+	case '~':
+		pp_set(val, ~val->v, val->bits, val->is_unsigned);
+		break;
+	case '!':
+		pp_set(val, !val->v, sctxp bits_in_int, 0);
+		val->is_not = 1;
+		break;
+	default:
+		return 0;
+	}
+	return 1;
+}
+
+static int pp_precedence(struct token *token)
+{
+	if (token_type(token) != TOKEN_SPECIAL)
+		return 0;
+	switch (token->special) {
+	case '*': case '/': case '%':			return 10;
+	case '+': case '-':				return 9;
+	case SPECIAL_LEFTSHIFT: case SPECIAL_RIGHTSHIFT: return 8;
+	case '<': case '>':
+	case SPECIAL_LTE: case SPECIAL_GTE:		return 7;
+	case SPECIAL_EQUAL: case SPECIAL_NOTEQUAL:	return 6;
+	case '&':					return 5;
+	case '^':					return 4;
+	case '|':					return 3;
+	case SPECIAL_LOGICAL_AND:			return 2;
+	case SPECIAL_LOGICAL_OR:			return 1;
+	}
+	return 0;
+}
+
+static int pp_binop(SCTX_ int op, struct pp_value *l, struct pp_value *r)
+{
+	unsigned long long a, b, v;
+	int bits, is_unsigned;
+
+	if (op == SPECIAL_LEFTSHIFT || op == SPECIAL_RIGHTSHIFT) {
+		/* the count as the parser sees it, it warns when too big */
+		b = r->bits < 64 ? r->v & ((1ULL << r->bits) - 1) : r->v;
+		if (b >= l->bits)
+			return 0;
+		if (op == SPECIAL_LEFTSHIFT)
+			v = l->v << b;
+		else if (l->is_unsigned)
+			v = l->v >> b;
+		else
+			v = (long long)l->v >> b;
+		pp_set(l, v, l->bits, l->is_unsigned);
+		return 1;
+	}
+	if (op == SPECIAL_LOGICAL_AND || op == SPECIAL_LOGICAL_OR) {
+		v = op == SPECIAL_LOGICAL_AND ? l->v && r->v : l->v || r->v;
+		pp_set(l, v, sctxp bits_in_int, 0);
+		return 1;
+	}
+	if ((op == '&' || op == '|') && (l->is_not || r->is_not))
+		return 0;
+
+	pp_convert(l, r);
+	a = l->v;
+	b = r->v;
+	bits = l->bits;
+	is_unsigned = l->is_unsigned;
+	switch (op) {
+	case '+': v = a + b; break;
+	case '-': v = a - b; break;
+	case '*': v = a * b; break;
+	case '&': v = a & b; break;
+	case '|': v = a | b; break;
+	case '^': v = a ^ b; break;
+	case '/': case '%':
+		if (!b)
+			return 0;
+		if (is_unsigned) {
+			v = op == '/' ? a / b : a % b;
+		} else {
+			if (a == ~0ULL << (bits - 1) && b == ~0ULL)
+				return 0;
+			v = op == '/' ? (long long)a / (long long)b : (long long)a % (long long)b;
+		}
+		break;
+	case '<': case '>': case SPECIAL_LTE: case SPECIAL_GTE: {
+		int lt = is_unsigned ? a < b : (long long)a < (long long)b;
+		int gt = is_unsigned ? a > b : (long long)a > (long long)b;
+
+		v = op == '<' ? lt : op == '>' ? gt : op == SPECIAL_LTE ? !gt : !lt;
+		pp_set(l, v, sctxp bits_in_int, 0);
+		return 1;
+	}
+	case SPECIAL_EQUAL: case SPECIAL_NOTEQUAL:
+		pp_set(l, (a == b) == (op == SPECIAL_EQUAL), sctxp bits_in_int, 0);
+		return 1;
+	default:
+		return 0;
+	}
+	pp_set(l, v, bits, is_unsigned);
+	return 1;
+}
+
+static int pp_binary(SCTX_ struct token **next, int min, struct pp_value *val)
+{
+	int prec;
+
+	if (!pp_unary(sctx_ next, val))
+		return 0;
+	while ((prec = pp_precedence(*next)) >= min) {
+		int op = (*next)->special;
+		struct pp_value r;
+
+		*next = (*next)->next;
+		if (!pp_binary(sctx_ next, prec + 1, &r) || !pp_binop(sctx_ op, val, &r))
+			return 0;
+	}
+	return 1;
+}
+
+static int pp_cond(SCTX_ struct token **next, struct pp_value *val)
+{
+	struct pp_value t, f;
+
+	if (!pp_binary(sctx_ next, 1, val))
+		return 0;
+	if (!match_op(*next, '?'))
+		return 1;
+	*next = (*next)->next;
+	if (!pp_cond(sctx_ next, &t) || !match_op(*next, ':'))
+		return 0;
+	*next = (*next)->next;
+	if (!pp_cond(sctx_ next, &f))
+		return 0;
+	pp_convert(&t, &f);
+	*val = val->v ? t : f;
+	val->is_not = 0;
+	return 1;
+}
+
+static int fast_expression_value(SCTX_ struct token *token, int *value)
+{
+	struct pp_value val;
+
+	if (!pp_cond(sctx_ &token, &val) || !eof_token(token))
+		return 0;
+	*value = val.v != 0;
+	return 1;
+}
+
 /*
  * Expression handling for #if and #elif; it differs from normal expansion
  * due to special treatment of "defined".
@@ -1777,7 +2255,7 @@ static int expression_value(SCTX_ struct expansion *e, struct token **where)
 	struct token *p;
 	struct token **list = where, **beginning = NULL;
 	long long value;
-	int state = 0;
+	int state = 0, fast;
 
 	while (!eof_token(p = scan_next(sctx_ e, list))) {
 		switch (state) {
@@ -1822,6 +2300,8 @@ static int expression_value(SCTX_ struct expansion *e, struct token **where)
 		list = &p->next;
 	}
 
+	if (fast_expression_value(sctx_ *where, &fast))
+		return fast;
 	p = constant_expression(sctx_ *where, &expr);
 	if (!eof_token(p))
 		sparse_error(sctx_ p->pos, "garbage at end: %s", show_token_sequence(sctx_ p, 0));
@@ -2213,13 +2693,6 @@ static void handle_preprocessor_line(SCTX_ struct expansion *ep, struct stream *
 	if (eof_token(token))
 		return;
 
-	e = expansion_new(sctx_ EXPANSION_PREPRO); /* pop */
-	e->s = start;
-	e->d = dup_list_e(sctx_ token, 0, e);
-	e->pdstk_pop = cons_list(sctx_ start, 0);
-	e->n = ep->pdstk;
-	ep->pdstk = e;
-
 	if (token_type(token) == TOKEN_IDENT) {
 		struct symbol *sym = lookup_symbol(sctx_ token->ident, NS_PREPROCESSOR);
 		if (sym) {
@@ -2236,13 +2709,25 @@ static void handle_preprocessor_line(SCTX_ struct expansion *ep, struct stream *
 
 	if (is_normal) {
 		dirty_stream(stream);
-		if (sctxp false_nesting)
-			goto out;
+		/* skipped, don't bother recording it */
+		if (sctxp false_nesting) {
+			free_preprocessor_line(sctx_ token);
+			return;
+		}
+	}
+
+	e = expansion_new(sctx_ EXPANSION_PREPRO); /* pop */
+	e->s = start;
+	if (pp_traced(sctx)) {
+		e->d = dup_list_e(sctx_ token, 0, e);
+		e->pdstk_pop = cons_list(sctx_ start, 0);
 	}
+	e->n = ep->pdstk;
+	ep->pdstk = e;
+
 	if (!handler(sctx_ e, stream, line, token))	/* all set */
 		return;
 
-out:
 	free_preprocessor_line(sctx_ token);
 }
 
@@ -2276,6 +2761,34 @@ static struct expansion *setup_expansion_result(SCTX_ struct expansion *ep, stru
 	return p;
 }
 
+/*
+ * Inside a false group nothing but the next directive matters: drop
+ * plain tokens without tracing them.  Anything unusual (untaint markers,
+ * stream boundaries, a pending macro expansion) takes the slow path.
+ */
+static void skip_false_group(SCTX_ struct token **list)
+{
+	while (!sctxp tok_stk) {
+		struct token *next = *list;
+		struct stream *stream = sctxp input_streams + next->pos.stream;
+
+		switch (token_type(next)) {
+		case TOKEN_EOF:
+		case TOKEN_STREAMBEGIN:
+		case TOKEN_STREAMEND:
+		case TOKEN_UNTAINT:
+			return;
+		default:
+			break;
+		}
+		if (next->pos.newline && match_op(next, '#'))
+			return;
+		dirty_stream(stream);
+		*list = next->next;
+		__free_token(sctx_ next);
+	}
+}
+
 static struct token *do_preprocess(SCTX_ struct expansion *ep)
 {
 	struct token *next; struct token *l = NULL; /*, **c = &l;*/
@@ -2314,25 +2827,37 @@ static struct token *do_preprocess(SCTX_ struct expansion *ep)
 			if (sctxp false_nesting) {
 				*list = next->next;
 				__free_token(sctx_ next);
+				skip_false_group(sctx_ list);
 				continue;
 			}
 
 			if (token_type(next) != TOKEN_IDENT ||
 			    expand_one_symbol(sctx_ ep, list)) {
-				cons_unshift(sctx_ &e->pdstk_push, next);
+				/* streamed out, nobody walks the trace */
+				if (sctxp pp_emit) {
+					*list = next->next;
+					sctxp pp_emit(sctx_ next);
+					__free_token(sctx_ next);
+					continue;
+				}
 				list = &next->next;
+				cons_unshift(sctx_ &e->pdstk_push, next);
 			}
 		}
 	}
 	return l;
 }
 
+/*
+ * With a pp_emit callback set, every token is handed out as soon as
+ * nothing can change it any more, in output order.
+ */
 struct token * preprocess(SCTX_ struct expansion *e)
 {
 	sctxp preprocessing = 1;
 	init_preprocessor(sctx );
 
-	e->d = dup_list_e(sctx_ e->s, 0, e);
+	e->d = pp_traced(sctx) ? dup_list_e(sctx_ e->s, 0, e) : e->s;
 	do_preprocess(sctx_ e);
 
 	// Drop all expressions from preprocessing, they're not used any more.
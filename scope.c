@@ -74,11 +74,20 @@ void start_function_scope(SCTX)
 
 static void remove_symbol_scope(SCTX_ struct symbol *sym)
 {
-	struct symbol **ptr = &sym->ident->symbols;
+	struct ident *ident = sym->ident;
+	struct symbol **ptr = &ident->symbols;
 
 	while (*ptr != sym)
 		ptr = &(*ptr)->next_id;
 	*ptr = sym->next_id;
+
+	if (ident->macro == sym) {
+		for (sym = sym->next_id; sym; sym = sym->next_id) {
+			if (sym->namespace & (NS_MACRO | NS_UNDEF))
+				break;
+		}
+		ident->macro = sym;
+	}
 }
 
 static void end_scope(SCTX_ struct scope **s)
@@ -99,6 +108,45 @@ void end_file_scope(SCTX)
 	end_scope(sctx_ &sctxp file_scope);
 }
 
+/* What a fatal error in the middle of a function left open */
+void end_inner_scopes(SCTX)
+{
+	while (sctxp block_scope != sctxp file_scope)
+		end_scope(sctx_ &sctxp block_scope);
+	while (sctxp function_scope != sctxp file_scope)
+		end_scope(sctx_ &sctxp function_scope);
+}
+
+/*
+ * Unbind the externally visible symbols declared after the first
+ * 'keep' ones, so that a long-running process can check the same
+ * file again without it clashing with its earlier self.
+ */
+void trim_global_scope(SCTX_ int keep)
+{
+	struct symbol_list **symbols = &sctxp global_scope->symbols;
+	int nr = symbol_list_size(sctx_ *symbols);
+	struct symbol *sym, *prev;
+
+	/* in place: the list nodes of the kept ones may be kept too */
+	while (nr-- > keep) {
+		sym = delete_last_symbol(sctx_ symbols);
+		remove_symbol_scope(sctx_ sym);
+		if (sym->namespace != NS_SYMBOL)
+			continue;
+		for (prev = sym->same_symbol; prev; prev = prev->same_symbol) {
+			if (prev->definition == sym)
+				prev->definition = NULL;
+		}
+	}
+
+	/* nor were the kept macros used in the next file yet */
+	FOR_EACH_PTR(*symbols, sym) {
+		if (sym->namespace == NS_MACRO)
+			sym->used_in = NULL;
+	} END_FOR_EACH_PTR(sym);
+}
+
 void new_file_scope(SCTX)
 {
 	if (sctxp file_scope != &sctxp builtin_scope)
@@ -18,7 +18,9 @@ static inline int toplevel(SCTX_ struct scope *scope)
 
 extern void start_file_scope(SCTX);
 extern void end_file_scope(SCTX);
+extern void end_inner_scopes(SCTX);
 extern void new_file_scope(SCTX);
+extern void trim_global_scope(SCTX_ int keep);
 
 extern void start_symbol_scope(SCTX);
 extern void end_symbol_scope(SCTX);
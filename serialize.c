@@ -0,0 +1,848 @@
+/*
+ * serialize.c - binary dump of a parsed translation unit
+ *
+ * Tokens and expansions are taken straight from their allocators,
+ * less what was freed. Symbols, statements and expressions are
+ * numbered as they are reached from the top level symbols.
+ *
+ * Licensed under the Open Software License version 1.1
+ */
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lib.h"
+#include "allocate.h"
+#include "token.h"
+#include "symbol.h"
+#include "parse.h"
+#include "expression.h"
+#include "serialize.h"
+
+/* pointer -> index (or string offset) */
+struct dump_map {
+	void **key;
+	uint32_t *val;
+	unsigned long size, nr;
+};
+
+struct dump_buf {
+	char *data;
+	unsigned long nr, alloc;
+};
+
+struct dump_objs {
+	void **p;
+	uint32_t nr, alloc, done;
+};
+
+struct dumper {
+	struct dump_map map, idents;
+	struct dump_buf sect[DUMP_SECTIONS];
+	struct dump_objs tokens, expansions, syms, stmts, exprs;
+};
+
+static unsigned long map_slot(struct dump_map *m, void *p)
+{
+	unsigned long h = ((unsigned long)p >> 3) * 0x9E3779B97F4A7C15ull;
+
+	h &= m->size - 1;
+	while (m->key[h] && m->key[h] != p)
+		h = (h + 1) & (m->size - 1);
+	return h;
+}
+
+static uint32_t map_get(struct dump_map *m, void *p)
+{
+	unsigned long h;
+
+	if (!m->size)
+		return 0;
+	h = map_slot(m, p);
+	return m->key[h] ? m->val[h] : 0;
+}
+
+static void map_put(struct dump_map *m, void *p, uint32_t v)
+{
+	unsigned long h;
+
+	if (2 * (m->nr + 1) > m->size) {
+		struct dump_map old = *m;
+		unsigned long i;
+
+		m->size = old.size ? old.size * 2 : 1024;
+		m->key = calloc(m->size, sizeof(void *));
+		m->val = malloc(m->size * sizeof(uint32_t));
+		m->nr = 0;
+		for (i = 0; i < old.size; i++)
+			if (old.key[i])
+				map_put(m, old.key[i], old.val[i]);
+		free(old.key);
+		free(old.val);
+	}
+	h = map_slot(m, p);
+	if (!m->key[h])
+		m->nr++;
+	m->key[h] = p;
+	m->val[h] = v;
+}
+
+static unsigned long buf_add(struct dump_buf *b, const void *data, unsigned long len)
+{
+	unsigned long at = b->nr;
+
+	if (b->nr + len > b->alloc) {
+		b->alloc = b->alloc ? b->alloc * 2 : 4096;
+		while (b->nr + len > b->alloc)
+			b->alloc *= 2;
+		b->data = realloc(b->data, b->alloc);
+	}
+	memcpy(b->data + at, data, len);
+	b->nr += len;
+	return at;
+}
+
+static uint32_t objs_add(struct dump_objs *o, void *p)
+{
+	if (o->nr == o->alloc) {
+		o->alloc = o->alloc ? o->alloc * 2 : 256;
+		o->p = realloc(o->p, o->alloc * sizeof(void *));
+	}
+	o->p[o->nr] = p;
+	return o->nr++;
+}
+
+static uint32_t str_add(struct dumper *d, const void *data, unsigned long len)
+{
+	uint32_t at = buf_add(&d->sect[DUMP_STRINGS], data, len);
+
+	buf_add(&d->sect[DUMP_STRINGS], "", 1);
+	return at;
+}
+
+static uint32_t str_ident(struct dumper *d, struct ident *ident)
+{
+	uint32_t s;
+
+	if (!ident)
+		return 0;
+	s = map_get(&d->idents, ident);
+	if (!s) {
+		s = str_add(d, ident->name, ident->len);
+		map_put(&d->idents, ident, s);
+	}
+	return s;
+}
+
+static uint32_t ref(struct dumper *d, struct dump_objs *o, void *p)
+{
+	uint32_t i;
+
+	if (!p)
+		return 0;
+	i = map_get(&d->map, p);
+	if (!i) {
+		i = objs_add(o, p);
+		map_put(&d->map, p, i);
+	}
+	return i;
+}
+
+#define sym_ref(d, p)	ref(d, &(d)->syms, p)
+#define stmt_ref(d, p)	ref(d, &(d)->stmts, p)
+#define expr_ref(d, p)	ref(d, &(d)->exprs, p)
+
+/* tokens and expansions are all known up front, others are 0 */
+static uint32_t known(struct dumper *d, void *p)
+{
+	return p ? map_get(&d->map, p) : 0;
+}
+
+static uint32_t list_start(struct dumper *d)
+{
+	uint32_t nr = 0;
+
+	return buf_add(&d->sect[DUMP_REFS], &nr, sizeof(nr)) / sizeof(uint32_t);
+}
+
+static void list_add(struct dumper *d, uint32_t list, uint32_t v)
+{
+	buf_add(&d->sect[DUMP_REFS], &v, sizeof(v));
+	((uint32_t *)d->sect[DUMP_REFS].data)[list]++;
+}
+
+static uint32_t sym_list(struct dumper *d, struct symbol_list *syms)
+{
+	struct symbol *sym;
+	uint32_t list;
+
+	if (!syms)
+		return 0;
+	list = list_start(d);
+	FOR_EACH_PTR(syms, sym) {
+		list_add(d, list, sym_ref(d, sym));
+	} END_FOR_EACH_PTR(sym);
+	return list;
+}
+
+static uint32_t expr_list(struct dumper *d, uint32_t list, struct expression_list *exprs)
+{
+	struct expression *expr;
+	uint32_t nr = 0;
+
+	FOR_EACH_PTR(exprs, expr) {
+		list_add(d, list, expr_ref(d, expr));
+		nr++;
+	} END_FOR_EACH_PTR(expr);
+	return nr;
+}
+
+static void add_token(struct sparse_ctx *_sctx, void *p, void *data)
+{
+	struct dumper *d = data;
+
+	map_put(&d->map, p, objs_add(&d->tokens, p));
+}
+
+static void add_expansion(struct sparse_ctx *_sctx, void *p, void *data)
+{
+	struct dumper *d = data;
+
+	map_put(&d->map, p, objs_add(&d->expansions, p));
+}
+
+static void dump_token(struct dumper *d, struct token *t)
+{
+	struct dump_token r = { 0 };
+
+	r.type = token_type(t);
+	r.flags = (t->pos.newline ? DUMP_TOK_NEWLINE : 0) |
+		  (t->pos.whitespace ? DUMP_TOK_WHITESPACE : 0) |
+		  (t->pos.noexpand ? DUMP_TOK_NOEXPAND : 0);
+	r.col = t->pos.pos;
+	r.stream = t->pos.stream;
+	r.line = t->pos.line;
+	r.next = known(d, t->next);
+	r.copy = known(d, t->copy);
+	r.e = known(d, t->e);
+
+	switch (r.type) {
+	case TOKEN_IDENT: case TOKEN_ZERO_IDENT: case TOKEN_UNTAINT:
+		r.value = str_ident(d, t->ident);
+		break;
+	case TOKEN_NUMBER:
+		if (t->number)
+			r.value = str_add(d, t->number, strlen(t->number));
+		break;
+	case TOKEN_CHAR: case TOKEN_WIDE_CHAR:
+	case TOKEN_STRING: case TOKEN_WIDE_STRING:
+		if (t->string) {
+			r.value = str_add(d, t->string->data, t->string->length);
+			r.len = t->string->length;
+		}
+		break;
+	case TOKEN_CHAR_EMBEDDED_0 ... TOKEN_CHAR_EMBEDDED_3:
+	case TOKEN_WIDE_CHAR_EMBEDDED_0 ... TOKEN_WIDE_CHAR_EMBEDDED_3:
+		memcpy(&r.value, t->embedded, 4);
+		break;
+	case TOKEN_SPECIAL:
+		r.value = t->special;
+		break;
+	case TOKEN_MACRO_ARGUMENT: case TOKEN_STR_ARGUMENT:
+	case TOKEN_QUOTED_ARGUMENT:
+		r.value = t->argnum;
+		break;
+	case TOKEN_ARG_COUNT:
+		memcpy(&r.value, &t->count, 4);
+		break;
+	}
+	buf_add(&d->sect[DUMP_TOKENS], &r, sizeof(r));
+}
+
+static void dump_expansion(struct dumper *d, struct expansion *e)
+{
+	struct dump_expansion r = { 0 };
+
+	r.typ = e->typ;
+	r.s = known(d, e->s);
+	r.d = known(d, e->d);
+	r.up = known(d, e->pdstk);
+	switch (e->typ) {
+	case EXPANSION_MACRO:
+		r.tok = known(d, e->tok);
+		r.sym = sym_ref(d, e->msym);
+		break;
+	case EXPANSION_MACRODEF:
+		r.sym = sym_ref(d, e->mdefsym);
+		break;
+	case EXPANSION_MACROARG:
+		r.mac = known(d, e->mac);
+		break;
+	}
+	buf_add(&d->sect[DUMP_EXPANSIONS], &r, sizeof(r));
+}
+
+static void dump_symbol(struct dumper *d, struct symbol *sym)
+{
+	struct dump_symbol r = { 0 };
+
+	r.type = sym->type;
+	r.ns = sym->namespace;
+	r.ident = str_ident(d, sym->ident);
+	r.pos = known(d, sym->pos);
+	r.endpos = known(d, sym->endpos);
+	if (sym->namespace & (NS_MACRO | NS_UNDEF)) {
+		r.initializer = known(d, sym->expansion);
+		r.array_size = known(d, sym->arglist);
+	} else if (!(sym->namespace & NS_PREPROCESSOR)) {
+		r.base = sym_ref(d, sym->ctype.base_type);
+		r.members = sym_list(d, sym->symbol_list);
+		r.arguments = sym_list(d, sym->arguments);
+		r.initializer = expr_ref(d, sym->initializer);
+		r.array_size = expr_ref(d, sym->array_size);
+		r.stmt = stmt_ref(d, sym->stmt);
+		r.bit_size = sym->bit_size;
+		r.as = sym->ctype.as;
+		r.modifiers = sym->ctype.modifiers;
+		r.offset = sym->offset;
+		r.alignment = sym->ctype.alignment;
+	}
+	buf_add(&d->sect[DUMP_SYMBOLS], &r, sizeof(r));
+}
+
+static void dump_statement(struct dumper *d, struct statement *stmt)
+{
+	struct dump_statement r = { 0 };
+	struct statement *s;
+
+	r.type = stmt->type;
+	r.tok = known(d, stmt->tok);
+	r.pos = known(d, stmt->pos);
+	switch (stmt->type) {
+	case STMT_DECLARATION:
+		r.list = sym_list(d, stmt->declaration);
+		break;
+	case STMT_EXPRESSION:
+		r.a = expr_ref(d, stmt->expression);
+		r.b = expr_ref(d, stmt->context);
+		break;
+	case STMT_CONTEXT:
+		r.a = expr_ref(d, stmt->expression);
+		break;
+	case STMT_COMPOUND:
+		r.list = list_start(d);
+		FOR_EACH_PTR(stmt->stmts, s) {
+			list_add(d, r.list, stmt_ref(d, s));
+		} END_FOR_EACH_PTR(s);
+		r.a = stmt_ref(d, stmt->args);
+		r.b = sym_ref(d, stmt->ret);
+		r.c = sym_ref(d, stmt->inline_fn);
+		break;
+	case STMT_IF:
+		r.a = expr_ref(d, stmt->if_conditional);
+		r.b = stmt_ref(d, stmt->if_true);
+		r.c = stmt_ref(d, stmt->if_false);
+		break;
+	case STMT_RETURN:
+		r.a = expr_ref(d, stmt->ret_value);
+		r.b = sym_ref(d, stmt->ret_target);
+		break;
+	case STMT_CASE:
+		r.a = expr_ref(d, stmt->case_expression);
+		r.b = expr_ref(d, stmt->case_to);
+		r.c = stmt_ref(d, stmt->case_statement);
+		r.d = sym_ref(d, stmt->case_label);
+		break;
+	case STMT_SWITCH:
+		r.a = expr_ref(d, stmt->switch_expression);
+		r.b = stmt_ref(d, stmt->switch_statement);
+		r.c = sym_ref(d, stmt->switch_break);
+		r.d = sym_ref(d, stmt->switch_case);
+		break;
+	case STMT_ITERATOR:
+		r.a = stmt_ref(d, stmt->iterator_pre_statement);
+		r.b = expr_ref(d, stmt->iterator_pre_condition);
+		r.c = stmt_ref(d, stmt->iterator_statement);
+		r.d = stmt_ref(d, stmt->iterator_post_statement);
+		r.e = expr_ref(d, stmt->iterator_post_condition);
+		r.list = sym_list(d, stmt->iterator_syms);
+		break;
+	case STMT_LABEL:
+		r.a = sym_ref(d, stmt->label_identifier);
+		r.b = stmt_ref(d, stmt->label_statement);
+		break;
+	case STMT_GOTO:
+		r.a = sym_ref(d, stmt->goto_label);
+		r.b = expr_ref(d, stmt->goto_expression);
+		break;
+	case STMT_ASM:
+		r.a = expr_ref(d, stmt->asm_string);
+		r.list = list_start(d);
+		r.b = expr_list(d, r.list, stmt->asm_outputs);
+		expr_list(d, r.list, stmt->asm_inputs);
+		break;
+	case STMT_RANGE:
+		r.a = expr_ref(d, stmt->range_expression);
+		r.b = expr_ref(d, stmt->range_low);
+		r.c = expr_ref(d, stmt->range_high);
+		break;
+	default:
+		break;
+	}
+	buf_add(&d->sect[DUMP_STATEMENTS], &r, sizeof(r));
+}
+
+static void dump_expression(struct dumper *d, struct expression *expr)
+{
+	struct dump_expression r = { 0 };
+	double fv;
+
+	r.type = expr->type;
+	r.flags = expr->flags;
+	r.op = expr->op;
+	r.tok = known(d, expr->tok);
+	r.pos = known(d, expr->pos);
+	r.ctype = sym_ref(d, expr->ctype);
+	switch (expr->type) {
+	case EXPR_VALUE:
+		r.value = expr->value;
+		break;
+	case EXPR_FVALUE:
+		fv = expr->fvalue;
+		memcpy(&r.value, &fv, sizeof(fv));
+		break;
+	case EXPR_STRING:
+		if (expr->string) {
+			r.a = str_add(d, expr->string->data, expr->string->length);
+			r.b = expr->string->length;
+		}
+		r.c = expr->wide;
+		break;
+	case EXPR_SYMBOL: case EXPR_TYPE:
+		r.a = sym_ref(d, expr->symbol);
+		r.b = str_ident(d, expr->symbol_name);
+		break;
+	case EXPR_BINOP: case EXPR_COMMA: case EXPR_COMPARE:
+	case EXPR_LOGICAL: case EXPR_ASSIGNMENT:
+		r.a = expr_ref(d, expr->left);
+		r.b = expr_ref(d, expr->right);
+		break;
+	case EXPR_DEREF:
+		r.a = expr_ref(d, expr->deref);
+		r.b = str_ident(d, expr->member);
+		break;
+	case EXPR_PREOP: case EXPR_POSTOP:
+		r.a = expr_ref(d, expr->unop);
+		break;
+	case EXPR_CAST: case EXPR_FORCE_CAST: case EXPR_IMPLIED_CAST:
+	case EXPR_SIZEOF: case EXPR_ALIGNOF: case EXPR_PTRSIZEOF:
+		r.a = sym_ref(d, expr->cast_type);
+		r.b = expr_ref(d, expr->cast_expression);
+		break;
+	case EXPR_CONDITIONAL: case EXPR_SELECT:
+		r.a = expr_ref(d, expr->conditional);
+		r.b = expr_ref(d, expr->cond_true);
+		r.c = expr_ref(d, expr->cond_false);
+		break;
+	case EXPR_STATEMENT:
+		r.a = stmt_ref(d, expr->statement);
+		break;
+	case EXPR_CALL:
+		r.a = expr_ref(d, expr->fn);
+		r.list = list_start(d);
+		expr_list(d, r.list, expr->args);
+		break;
+	case EXPR_LABEL:
+		r.a = sym_ref(d, expr->label_symbol);
+		break;
+	case EXPR_INITIALIZER:
+		r.list = list_start(d);
+		expr_list(d, r.list, expr->expr_list);
+		break;
+	case EXPR_IDENTIFIER:
+		r.a = str_ident(d, expr->expr_ident);
+		r.b = sym_ref(d, expr->field);
+		r.c = expr_ref(d, expr->ident_expression);
+		break;
+	case EXPR_INDEX:
+		r.a = expr_ref(d, expr->idx_expression);
+		r.value = expr->idx_from | (uint64_t)expr->idx_to << 32;
+		break;
+	case EXPR_POS:
+		r.a = expr_ref(d, expr->init_expr);
+		r.value = expr->init_offset | (uint64_t)expr->init_nr << 32;
+		break;
+	case EXPR_SLICE:
+		r.a = expr_ref(d, expr->base);
+		r.value = expr->r_bitpos | (uint64_t)expr->r_nrbits << 32;
+		break;
+	case EXPR_OFFSETOF:
+		r.a = sym_ref(d, expr->in);
+		r.b = expr_ref(d, expr->down);
+		if (expr->op == '.')
+			r.c = str_ident(d, expr->ident);
+		else
+			r.c = expr_ref(d, expr->index);
+		break;
+	default:
+		break;
+	}
+	buf_add(&d->sect[DUMP_EXPRESSIONS], &r, sizeof(r));
+}
+
+static void dumper_free(struct dumper *d)
+{
+	int i;
+
+	free(d->map.key); free(d->map.val);
+	free(d->idents.key); free(d->idents.val);
+	for (i = 0; i < DUMP_SECTIONS; i++)
+		free(d->sect[i].data);
+	free(d->tokens.p); free(d->expansions.p);
+	free(d->syms.p); free(d->stmts.p); free(d->exprs.p);
+}
+
+static const unsigned int record_size[DUMP_SECTIONS] = {
+	[DUMP_STRINGS] = 1,
+	[DUMP_REFS] = sizeof(uint32_t),
+	[DUMP_STREAMS] = sizeof(struct dump_stream),
+	[DUMP_TOKENS] = sizeof(struct dump_token),
+	[DUMP_EXPANSIONS] = sizeof(struct dump_expansion),
+	[DUMP_SYMBOLS] = sizeof(struct dump_symbol),
+	[DUMP_STATEMENTS] = sizeof(struct dump_statement),
+	[DUMP_EXPRESSIONS] = sizeof(struct dump_expression),
+};
+
+/* big enough for any record and for the padding between sections */
+union dump_record {
+	struct dump_stream stream;
+	struct dump_token token;
+	struct dump_expansion expansion;
+	struct dump_symbol symbol;
+	struct dump_statement statement;
+	struct dump_expression expression;
+	uint64_t pad;
+};
+
+/*
+ * Write everything the context knows about: all tokens and expansions
+ * and whatever is reachable from the symbols in list.
+ */
+int write_ast_dump(SCTX_ FILE *f, struct symbol_list *list)
+{
+	static const char zero[sizeof(union dump_record)];
+	struct dumper d = { 0 };
+	struct dump_header h = { AST_DUMP_MAGIC };
+	uint64_t offset;
+	uint32_t i;
+	int s, ret = 0;
+
+	for (s = 0; s < DUMP_SECTIONS; s++)
+		if (s != DUMP_STREAMS)
+			buf_add(&d.sect[s], zero, record_size[s]);
+	objs_add(&d.tokens, NULL);
+	objs_add(&d.expansions, NULL);
+	objs_add(&d.syms, NULL);
+	objs_add(&d.stmts, NULL);
+	objs_add(&d.exprs, NULL);
+
+	for_each_allocation(sctx_ &sctxp token_allocator, sizeof(struct token), add_token, &d);
+	for_each_allocation(sctx_ &sctxp expansion_allocator, sizeof(struct expansion), add_expansion, &d);
+	for (i = 1; i < d.tokens.nr; i++)
+		dump_token(&d, d.tokens.p[i]);
+	for (i = 1; i < d.expansions.nr; i++)
+		dump_expansion(&d, d.expansions.p[i]);
+	for (s = 0; s < sctxp input_stream_nr; s++) {
+		struct stream *stream = sctxp input_streams + s;
+		struct dump_stream r;
+		r.name = str_add(&d, stream->name, strlen(stream->name));
+		r.e = known(&d, stream->e);
+		buf_add(&d.sect[DUMP_STREAMS], &r, sizeof(r));
+	}
+	h.symbols = sym_list(&d, list);
+
+	/* anything can reach anything, go round until nothing is new */
+	while (d.syms.done + 1 < d.syms.nr || d.stmts.done + 1 < d.stmts.nr ||
+	       d.exprs.done + 1 < d.exprs.nr) {
+		while (d.syms.done + 1 < d.syms.nr)
+			dump_symbol(&d, d.syms.p[++d.syms.done]);
+		while (d.stmts.done + 1 < d.stmts.nr)
+			dump_statement(&d, d.stmts.p[++d.stmts.done]);
+		while (d.exprs.done + 1 < d.exprs.nr)
+			dump_expression(&d, d.exprs.p[++d.exprs.done]);
+	}
+
+	h.version = AST_DUMP_VERSION;
+	h.byteorder = AST_DUMP_BYTEORDER;
+	offset = (sizeof(h) + 7) & ~7ul;
+	for (s = 0; s < DUMP_SECTIONS; s++) {
+		h.sect[s].size = record_size[s];
+		h.sect[s].count = d.sect[s].nr / record_size[s];
+		h.sect[s].offset = offset;
+		offset += (d.sect[s].nr + 7) & ~7ul;
+	}
+	if (fwrite(&h, sizeof(h), 1, f) != 1)
+		ret = -1;
+	offset = sizeof(h);
+	for (s = 0; s < DUMP_SECTIONS && !ret; s++) {
+		unsigned long pad = h.sect[s].offset - offset;
+		if (fwrite(zero, 1, pad, f) != pad ||
+		    fwrite(d.sect[s].data, 1, d.sect[s].nr, f) != d.sect[s].nr)
+			ret = -1;
+		offset = h.sect[s].offset + d.sect[s].nr;
+	}
+	dumper_free(&d);
+	return ret;
+}
+
+/*
+ * A dump is used in place, so everything a reader may follow is
+ * checked once when it is opened: indices against their tables, lists
+ * and strings against their sections, as dump_*() above wrote them.
+ */
+#define IN(s, i)	((i) < dump_count(dump, s))
+#define TOK(i)		IN(DUMP_TOKENS, i)
+#define EXP(i)		IN(DUMP_EXPANSIONS, i)
+#define SYM(i)		IN(DUMP_SYMBOLS, i)
+#define STMT(i)		IN(DUMP_STATEMENTS, i)
+#define EXPR(i)		IN(DUMP_EXPRESSIONS, i)
+#define STR(i)		IN(DUMP_STRINGS, i)
+
+/* a string of len bytes and its NUL */
+static int check_string(const struct ast_dump *dump, uint32_t s, uint32_t len)
+{
+	return STR(s) && len < dump_count(dump, DUMP_STRINGS) - s;
+}
+
+static int check_list(const struct ast_dump *dump, uint32_t list, enum ast_dump_section sect)
+{
+	const uint32_t *entries;
+	uint32_t nr, i;
+
+	if (!IN(DUMP_REFS, list))
+		return 0;
+	nr = dump->refs[list];
+	if (nr >= dump_count(dump, DUMP_REFS) - list)
+		return 0;
+	entries = dump->refs + list + 1;
+	for (i = 0; i < nr; i++)
+		if (!IN(sect, entries[i]))
+			return 0;
+	return 1;
+}
+
+static int check_token(const struct ast_dump *dump, const struct dump_token *t)
+{
+	if (!IN(DUMP_STREAMS, t->stream) || !TOK(t->next) || !TOK(t->copy) || !EXP(t->e))
+		return 0;
+	switch (t->type) {
+	case TOKEN_IDENT: case TOKEN_ZERO_IDENT: case TOKEN_UNTAINT:
+	case TOKEN_NUMBER:
+		return STR(t->value);
+	case TOKEN_CHAR: case TOKEN_WIDE_CHAR:
+	case TOKEN_STRING: case TOKEN_WIDE_STRING:
+		return check_string(dump, t->value, t->len);
+	}
+	return 1;
+}
+
+static int check_expansion(const struct ast_dump *dump, const struct dump_expansion *e)
+{
+	return TOK(e->s) && TOK(e->d) && EXP(e->up) && TOK(e->tok) &&
+	       SYM(e->sym) && EXP(e->mac);
+}
+
+static int check_symbol(const struct ast_dump *dump, const struct dump_symbol *sym)
+{
+	if (!STR(sym->ident) || !TOK(sym->pos) || !TOK(sym->endpos))
+		return 0;
+	if (sym->ns & (NS_MACRO | NS_UNDEF))
+		return TOK(sym->initializer) && TOK(sym->array_size);
+	return SYM(sym->base) && check_list(dump, sym->members, DUMP_SYMBOLS) &&
+	       check_list(dump, sym->arguments, DUMP_SYMBOLS) &&
+	       EXPR(sym->initializer) && EXPR(sym->array_size) && STMT(sym->stmt);
+}
+
+static int check_statement(const struct ast_dump *dump, const struct dump_statement *stmt)
+{
+	if (!TOK(stmt->tok) || !TOK(stmt->pos))
+		return 0;
+	switch (stmt->type) {
+	case STMT_DECLARATION:
+		return check_list(dump, stmt->list, DUMP_SYMBOLS);
+	case STMT_EXPRESSION:
+		return EXPR(stmt->a) && EXPR(stmt->b);
+	case STMT_CONTEXT:
+		return EXPR(stmt->a);
+	case STMT_COMPOUND:
+		return check_list(dump, stmt->list, DUMP_STATEMENTS) &&
+		       STMT(stmt->a) && SYM(stmt->b) && SYM(stmt->c);
+	case STMT_IF:
+		return EXPR(stmt->a) && STMT(stmt->b) && STMT(stmt->c);
+	case STMT_RETURN:
+		return EXPR(stmt->a) && SYM(stmt->b);
+	case STMT_CASE:
+		return EXPR(stmt->a) && EXPR(stmt->b) && STMT(stmt->c) && SYM(stmt->d);
+	case STMT_SWITCH:
+		return EXPR(stmt->a) && STMT(stmt->b) && SYM(stmt->c) && SYM(stmt->d);
+	case STMT_ITERATOR:
+		return STMT(stmt->a) && EXPR(stmt->b) && STMT(stmt->c) &&
+		       STMT(stmt->d) && EXPR(stmt->e) &&
+		       check_list(dump, stmt->list, DUMP_SYMBOLS);
+	case STMT_LABEL:
+		return SYM(stmt->a) && STMT(stmt->b);
+	case STMT_GOTO:
+		return SYM(stmt->a) && EXPR(stmt->b);
+	case STMT_ASM:
+		return EXPR(stmt->a) && check_list(dump, stmt->list, DUMP_EXPRESSIONS) &&
+		       stmt->b <= dump->refs[stmt->list];
+	case STMT_RANGE:
+		return EXPR(stmt->a) && EXPR(stmt->b) && EXPR(stmt->c);
+	}
+	return 1;
+}
+
+static int check_expression(const struct ast_dump *dump, const struct dump_expression *expr)
+{
+	if (!TOK(expr->tok) || !TOK(expr->pos) || !SYM(expr->ctype))
+		return 0;
+	switch (expr->type) {
+	case EXPR_STRING:
+		return check_string(dump, expr->a, expr->b);
+	case EXPR_SYMBOL: case EXPR_TYPE:
+		return SYM(expr->a) && STR(expr->b);
+	case EXPR_BINOP: case EXPR_COMMA: case EXPR_COMPARE:
+	case EXPR_LOGICAL: case EXPR_ASSIGNMENT:
+		return EXPR(expr->a) && EXPR(expr->b);
+	case EXPR_DEREF:
+		return EXPR(expr->a) && STR(expr->b);
+	case EXPR_PREOP: case EXPR_POSTOP:
+	case EXPR_INDEX: case EXPR_POS: case EXPR_SLICE:
+		return EXPR(expr->a);
+	case EXPR_CAST: case EXPR_FORCE_CAST: case EXPR_IMPLIED_CAST:
+	case EXPR_SIZEOF: case EXPR_ALIGNOF: case EXPR_PTRSIZEOF:
+		return SYM(expr->a) && EXPR(expr->b);
+	case EXPR_CONDITIONAL: case EXPR_SELECT:
+		return EXPR(expr->a) && EXPR(expr->b) && EXPR(expr->c);
+	case EXPR_STATEMENT:
+		return STMT(expr->a);
+	case EXPR_CALL:
+		return EXPR(expr->a) && check_list(dump, expr->list, DUMP_EXPRESSIONS);
+	case EXPR_LABEL:
+		return SYM(expr->a);
+	case EXPR_INITIALIZER:
+		return check_list(dump, expr->list, DUMP_EXPRESSIONS);
+	case EXPR_IDENTIFIER:
+		return STR(expr->a) && SYM(expr->b) && EXPR(expr->c);
+	case EXPR_OFFSETOF:
+		return SYM(expr->a) && EXPR(expr->b) &&
+		       (expr->op == '.' ? STR(expr->c) : EXPR(expr->c));
+	}
+	return 1;
+}
+
+static int check_dump(const struct ast_dump *dump)
+{
+	uint32_t i;
+
+	for (i = 0; i < DUMP_SECTIONS; i++)
+		if (i != DUMP_STREAMS && !dump_count(dump, i))
+			return 0;
+	if (dump->strings[dump_count(dump, DUMP_STRINGS) - 1])
+		return 0;
+	for (i = 0; i < dump_count(dump, DUMP_STREAMS); i++)
+		if (!STR(dump->streams[i].name) || !EXP(dump->streams[i].e))
+			return 0;
+	for (i = 0; i < dump_count(dump, DUMP_TOKENS); i++)
+		if (!check_token(dump, dump->tokens + i))
+			return 0;
+	for (i = 0; i < dump_count(dump, DUMP_EXPANSIONS); i++)
+		if (!check_expansion(dump, dump->expansions + i))
+			return 0;
+	for (i = 0; i < dump_count(dump, DUMP_SYMBOLS); i++)
+		if (!check_symbol(dump, dump->symbols + i))
+			return 0;
+	for (i = 0; i < dump_count(dump, DUMP_STATEMENTS); i++)
+		if (!check_statement(dump, dump->statements + i))
+			return 0;
+	for (i = 0; i < dump_count(dump, DUMP_EXPRESSIONS); i++)
+		if (!check_expression(dump, dump->expressions + i))
+			return 0;
+	return check_list(dump, dump->header->symbols, DUMP_SYMBOLS);
+}
+
+#undef IN
+#undef TOK
+#undef EXP
+#undef SYM
+#undef STMT
+#undef EXPR
+#undef STR
+
+/* Map a dump read-only, NULL if it isn't one this version can read */
+struct ast_dump *open_ast_dump(const char *name)
+{
+	struct ast_dump *dump;
+	const struct dump_header *h;
+	struct stat st;
+	void *map;
+	int fd, s;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(*h)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	h = map;
+	if (memcmp(h->magic, AST_DUMP_MAGIC, sizeof(h->magic)) ||
+	    h->version != AST_DUMP_VERSION || h->byteorder != AST_DUMP_BYTEORDER)
+		goto bad;
+	for (s = 0; s < DUMP_SECTIONS; s++) {
+		const struct dump_section *sect = h->sect + s;
+		if (sect->size != record_size[s] || sect->offset % 8 ||
+		    sect->offset < sizeof(*h) || sect->offset > st.st_size ||
+		    (uint64_t)sect->count * sect->size > st.st_size - sect->offset)
+			goto bad;
+	}
+
+	dump = malloc(sizeof(*dump));
+	dump->map = map;
+	dump->size = st.st_size;
+	dump->header = h;
+#define SECTION(s)	((const void *)((const char *)map + h->sect[s].offset))
+	dump->strings = SECTION(DUMP_STRINGS);
+	dump->refs = SECTION(DUMP_REFS);
+	dump->streams = SECTION(DUMP_STREAMS);
+	dump->tokens = SECTION(DUMP_TOKENS);
+	dump->expansions = SECTION(DUMP_EXPANSIONS);
+	dump->symbols = SECTION(DUMP_SYMBOLS);
+	dump->statements = SECTION(DUMP_STATEMENTS);
+	dump->expressions = SECTION(DUMP_EXPRESSIONS);
+#undef SECTION
+	if (!check_dump(dump)) {
+		free(dump);
+		goto bad;
+	}
+	return dump;
+
+bad:
+	munmap(map, st.st_size);
+	return NULL;
+}
+
+void close_ast_dump(struct ast_dump *dump)
+{
+	munmap(dump->map, dump->size);
+	free(dump);
+}
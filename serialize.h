@@ -0,0 +1,197 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+/*
+ * Binary dump of a parsed translation unit: tokens, the expansion
+ * trace, symbols, statements and expressions as fixed size records
+ * that refer to each other by index. The file is meant to be mmap()ed
+ * and used in place: open_ast_dump() checks that every index, list and
+ * string in it stays inside its section, and the accessors below don't.
+ *
+ * Index 0 of every record table but the streams is a zeroed record and
+ * means "none"; streams are indexed by stream id.
+ * Strings are byte offsets into the string table, 0 is "". Lists are
+ * indices into the refs table: refs[i] is the count, followed by the
+ * entries. Everything is in native byte order.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "lib.h"
+
+#define AST_DUMP_MAGIC		"SPARSEd"
+#define AST_DUMP_VERSION	1
+#define AST_DUMP_BYTEORDER	0x01020304
+
+enum ast_dump_section {
+	DUMP_STRINGS,
+	DUMP_REFS,
+	DUMP_STREAMS,
+	DUMP_TOKENS,
+	DUMP_EXPANSIONS,
+	DUMP_SYMBOLS,
+	DUMP_STATEMENTS,
+	DUMP_EXPRESSIONS,
+	DUMP_SECTIONS
+};
+
+struct dump_section {
+	uint32_t count;		/* records */
+	uint32_t size;		/* bytes per record */
+	uint64_t offset;
+};
+
+struct dump_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	struct dump_section sect[DUMP_SECTIONS];
+	uint32_t symbols;	/* list of the top level symbols */
+	uint32_t pad;
+};
+
+struct dump_stream {
+	uint32_t name;
+	uint32_t e;		/* expansion of the whole stream */
+};
+
+#define DUMP_TOK_NEWLINE	1
+#define DUMP_TOK_WHITESPACE	2
+#define DUMP_TOK_NOEXPAND	4
+
+/*
+ * value: string for idents, numbers, chars and strings (with len),
+ * the raw bytes of embedded chars, the special, the argument number
+ * or the argument count.
+ */
+struct dump_token {
+	uint8_t type;
+	uint8_t flags;
+	uint16_t col;
+	uint32_t stream, line;
+	uint32_t next;
+	uint32_t copy;		/* token this one was copied from */
+	uint32_t e;		/* expansion that produced it */
+	uint32_t value, len;
+};
+
+struct dump_expansion {
+	uint32_t typ;
+	uint32_t s, d;		/* source and result tokens */
+	uint32_t up;		/* enclosing expansion */
+	uint32_t tok;		/* macro: the invocation */
+	uint32_t sym;		/* macro, macro definition: the macro */
+	uint32_t mac;		/* macro argument: the macro expansion */
+};
+
+/* for NS_MACRO, initializer and array_size are the body and arglist tokens */
+struct dump_symbol {
+	uint8_t type, pad;
+	uint16_t ns;
+	uint32_t ident;
+	uint32_t pos, endpos;
+	uint32_t base;
+	uint32_t members, arguments;
+	uint32_t initializer, array_size;
+	uint32_t stmt;
+	int32_t bit_size;
+	uint32_t as;
+	uint32_t pad2;
+	uint64_t modifiers, offset, alignment;
+};
+
+/*
+ * Operands by statement type:
+ *	DECLARATION	list: symbols
+ *	EXPRESSION	a, b: expression, context
+ *	CONTEXT		a: expression
+ *	COMPOUND	list: statements, a: args, b: ret, c: inline_fn
+ *	IF		a: cond, b, c: true, false statements
+ *	RETURN		a: value, b: target symbol
+ *	CASE		a, b: from, to, c: statement, d: label symbol
+ *	SWITCH		a: expression, b: statement, c, d: break, case symbols
+ *	ITERATOR	a: pre statement, b: pre condition, c: statement,
+ *			d: post statement, e: post condition, list: symbols
+ *	LABEL		a: symbol, b: statement
+ *	GOTO		a: label symbol, b: expression
+ *	ASM		a: string, list: outputs then inputs, b: outputs count
+ *	RANGE		a, b, c: expression, low, high
+ */
+struct dump_statement {
+	uint32_t type;
+	uint32_t tok, pos;
+	uint32_t a, b, c, d, e;
+	uint32_t list;
+};
+
+/*
+ * Operands by expression type:
+ *	VALUE		value
+ *	FVALUE		value: the bits of the double
+ *	STRING		a: string, b: its length, c: wide
+ *	SYMBOL, TYPE	a: symbol, b: name
+ *	BINOP ...	a, b: left, right
+ *	DEREF		a: expression, b: member name
+ *	PREOP, POSTOP	a: operand
+ *	CAST, SIZEOF ..	a: type symbol, b: expression
+ *	CONDITIONAL	a, b, c: condition, true, false
+ *	STATEMENT	a: statement
+ *	CALL		a: function, list: arguments
+ *	LABEL		a: label symbol
+ *	INITIALIZER	list: entries
+ *	IDENTIFIER	a: name, b: field symbol, c: expression
+ *	INDEX		a: expression, value: from | to << 32
+ *	POS		a: expression, value: offset | nr << 32
+ *	SLICE		a: base, value: bitpos | nrbits << 32
+ *	OFFSETOF	a: symbol, b: down, c: member name or index
+ */
+struct dump_expression {
+	uint8_t type, flags;
+	uint16_t pad;
+	int32_t op;
+	uint32_t tok, pos;
+	uint32_t ctype;
+	uint32_t a, b, c;
+	uint32_t list;
+	uint32_t pad2;
+	uint64_t value;
+};
+
+/* Read-only view of a dump file */
+struct ast_dump {
+	void *map;
+	size_t size;
+	const struct dump_header *header;
+	const char *strings;
+	const uint32_t *refs;
+	const struct dump_stream *streams;
+	const struct dump_token *tokens;
+	const struct dump_expansion *expansions;
+	const struct dump_symbol *symbols;
+	const struct dump_statement *statements;
+	const struct dump_expression *expressions;
+};
+
+struct symbol_list;
+
+extern int write_ast_dump(SCTX_ FILE *f, struct symbol_list *list);
+extern struct ast_dump *open_ast_dump(const char *name);
+extern void close_ast_dump(struct ast_dump *dump);
+
+static inline uint32_t dump_count(const struct ast_dump *dump, enum ast_dump_section s)
+{
+	return dump->header->sect[s].count;
+}
+
+static inline const char *dump_string(const struct ast_dump *dump, uint32_t s)
+{
+	return dump->strings + s;
+}
+
+/* the entries of a list, *nr of them */
+static inline const uint32_t *dump_list(const struct ast_dump *dump, uint32_t list, uint32_t *nr)
+{
+	*nr = dump->refs[list];
+	return dump->refs + list + 1;
+}
+
+#endif
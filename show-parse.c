@@ -94,7 +94,7 @@ void debug_symbol(SCTX_ struct symbol *sym)
  */
 const char *modifier_string(SCTX_ unsigned long mod)
 {
-	static char buffer[100];
+	static TLS_ATTR char buffer[100];
 	int len = 0;
 	int i;
 	struct mod_name {
@@ -194,7 +194,7 @@ static void prepend_cnt(SCTX_ struct type_name *name, const char *buffer, int n)
 
 static void FORMAT_ATTR(2+SCTXCNT) prepend(SCTX_ struct type_name *name, const char *fmt, ...)
 {
-	static char buffer[512];
+	static TLS_ATTR char buffer[512];
 	int n;
 
 	va_list args;
@@ -225,7 +225,7 @@ static void append_cnt(SCTX_ struct type_name *name, const char *buffer, int n)
 
 static void FORMAT_ATTR(2+SCTXCNT) append(SCTX_ struct type_name *name, const char *fmt, ...)
 {
-	static char buffer[512];
+	static TLS_ATTR char buffer[512];
 	int n;
 
 	va_list args;
@@ -470,7 +470,7 @@ void show_type(SCTX_ struct symbol *sym)
 
 const char *show_typename(SCTX_ struct symbol *sym)
 {
-	static char array[200];
+	static TLS_ATTR char array[200];
 	struct type_name name;
 	name.fnargs = 0;
 	name.start = name.end = array+100;
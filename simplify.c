@@ -867,15 +867,15 @@ static int simplify_branch(SCTX_ struct instruction *insn)
 static int simplify_switch(SCTX_ struct instruction *insn)
 {
 	pseudo_t cond = insn->cond;
-	long long val;
 	struct multijmp *jmp;
+	long long val;
 
 	if (!sparse_constant(cond))
 		return 0;
-	val = insn->cond->value;
 
+	/* sorted by linearize_switch(), the first match wins, then the default */
+	val = switch_value(insn, cond->value);
 	FOR_EACH_PTR(insn->multijmp_list, jmp) {
-		/* Default case */
 		if (jmp->begin > jmp->end)
 			goto found;
 		if (val >= jmp->begin && val <= jmp->end)
@@ -686,35 +686,64 @@ static void output_op_sel(SCTX_ struct function *fn, struct instruction *insn)
 	insn->target->priv = target;
 }
 
+/* case ranges longer than this are compared instead of listed */
+#define SWITCH_CASES_MAX	64
+
+/*
+ * LLVM lowers a switch to a table or a tree by itself, it gets the
+ * ranges merged by plan_multijmp(). Long ranges are folded onto their
+ * first value with a select, the switch stays the one terminator of
+ * the block and the phi sources keep their block.
+ */
 static void output_op_switch(SCTX_ struct function *fn, struct instruction *insn)
 {
-	LLVMValueRef sw_val, target;
-	struct basic_block *def = NULL;
-	struct multijmp *jmp;
-	int n_jmp = 0;
-
-	FOR_EACH_PTR(insn->multijmp_list, jmp) {
-		if (jmp->begin == jmp->end) {		/* case N */
-			n_jmp++;
-		} else if (jmp->begin < jmp->end) {	/* case M..N */
-			assert(0);
-		} else					/* default case */
-			def = jmp->target;
-	} END_FOR_EACH_PTR(jmp);
+	LLVMValueRef sw_val, key, target;
+	LLVMTypeRef type;
+	struct switch_plan plan;
+	struct basic_block *def;
+	unsigned int n_jmp = 0;
+	int i;
 
 	sw_val = pseudo_to_value(sctx_ fn, insn, insn->target);
-	target = LLVMBuildSwitch(fn->builder, sw_val,
+	type = LLVMTypeOf(sw_val);
+	plan_multijmp(sctx_ &plan, insn);
+	def = plan.def;
+
+	key = sw_val;
+	for (i = 0; i < plan.nr; i++) {
+		struct switch_range *r = plan.ranges + i;
+		unsigned long long len = r->end - r->begin;
+		LLVMValueRef begin, in;
+
+		if (len < SWITCH_CASES_MAX) {
+			n_jmp += len + 1;
+			continue;
+		}
+		begin = LLVMConstInt(type, r->begin, 1);
+		in = LLVMBuildICmp(fn->builder, LLVMIntULE,
+			LLVMBuildSub(fn->builder, sw_val, begin, "case"),
+			LLVMConstInt(type, len, 0), "range");
+		key = LLVMBuildSelect(fn->builder, in, begin, key, "case");
+		n_jmp++;
+	}
+
+	target = LLVMBuildSwitch(fn->builder, key,
 				 def ? def->priv : NULL, n_jmp);
 
-	FOR_EACH_PTR(insn->multijmp_list, jmp) {
-		if (jmp->begin == jmp->end) {		/* case N */
-			LLVMAddCase(target,
-				LLVMConstInt(LLVMInt32Type(), jmp->begin, 0),
-				jmp->target->priv);
-		} else if (jmp->begin < jmp->end) {	/* case M..N */
-			assert(0);
+	for (i = 0; i < plan.nr; i++) {
+		struct switch_range *r = plan.ranges + i;
+		struct basic_block *bb = r->target;
+		long long val = r->begin;
+
+		if ((unsigned long long)(r->end - r->begin) >= SWITCH_CASES_MAX) {
+			LLVMAddCase(target, LLVMConstInt(type, val, 1), bb->priv);
+			continue;
 		}
-	} END_FOR_EACH_PTR(jmp);
+		do {
+			LLVMAddCase(target, LLVMConstInt(type, val, 1), bb->priv);
+		} while (val++ < r->end);
+	}
+	free_switch_plan(sctx_ &plan);
 
 	insn->target->priv = target;
 }
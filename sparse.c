@@ -15,6 +15,12 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include "lib.h"
 #include "allocate.h"
@@ -23,6 +29,7 @@
 #include "symbol.h"
 #include "expression.h"
 #include "linearize.h"
+#include "scope.h"
 
 static int context_increase(SCTX_ struct basic_block *bb, int entry)
 {
@@ -255,33 +262,531 @@ static void check_context(SCTX_ struct entrypoint *ep)
 	check_bb_context(sctx_ ep, ep->entry->bb, in_context, out_context);
 }
 
+static void check_symbol(SCTX_ struct symbol *sym)
+{
+	struct entrypoint *ep;
+
+	expand_symbol(sctx_ sym);
+	ep = linearize_symbol(sctx_ sym);
+	if (ep) {
+		if (sctxp dbg_entry)
+			show_entry(sctx_ ep);
+
+		check_context(sctx_ ep);
+	}
+}
+
 static void check_symbols(SCTX_ struct symbol_list *list)
 {
 	struct symbol *sym;
 
 	FOR_EACH_PTR(list, sym) {
-		struct entrypoint *ep;
+		check_symbol(sctx_ sym);
+	} END_FOR_EACH_PTR(sym);
+}
+
+/*
+ * -j N: the declarations of a file are evaluated and checked first,
+ * then the function bodies are shared out to N forked workers. A
+ * body only changes what it owns and the copies of the file-scope
+ * symbols its worker has, so nothing is shared while they run.
+ * The diagnostics of everyone go through diag_file, each with the
+ * place a serial run would have given it: the evaluation of the
+ * i-th symbol of the file comes before that of the next one, and
+ * all of them before the checking of the first. They are shown in
+ * that order when the workers are done, that is also when the limits
+ * on warnings and errors apply, so the output is the serial one.
+ */
+#define EVALUATE_ORDER(i)	((long long)(i))
+#define CHECK_ORDER(i)		((1LL << 32) | (i))
+
+struct diag_entry {
+	struct diagnostic d;
+	int worker, seq;
+	int head;		/* an info goes with what it is about */
+	int dup;
+	char *text;
+};
 
-		expand_symbol(sctx_ sym);
-		ep = linearize_symbol(sctx_ sym);
-		if (ep) {
-			if (sctxp dbg_entry)
-				show_entry(sctx_ ep);
+struct body {
+	struct symbol *sym;
+	int index;		/* in the list of the file */
+};
+
+static int has_body(struct symbol *sym)
+{
+	struct symbol *base = sym->ctype.base_type;
+
+	return base && base->type == SYM_FN && (base->stmt || base->inline_stmt);
+}
 
-			check_context(sctx_ ep);
+static void evaluate_one(SCTX_ struct symbol *sym, int index)
+{
+	struct symbol_list *one = NULL;
+
+	add_symbol(sctx_ &one, sym);
+	sctxp diag_order = EVALUATE_ORDER(index);
+	evaluate_symbol_list(sctx_ one);
+	free_ptr_list(&one);
+}
+
+static void check_one(SCTX_ struct symbol *sym, int index)
+{
+	sctxp diag_order = CHECK_ORDER(index);
+	check_symbol(sctx_ sym);
+}
+
+static void check_worker(SCTX_ struct symbol_list *list, struct body *bodies, int nr, int worker)
+{
+	struct body *mine = malloc((nr + 1) * sizeof(*mine));
+	int n = symbol_list_size(sctx_ list), count = 0, alloc = nr + 1, i;
+	struct symbol *sym;
+
+	for (i = 0; i < nr; i++) {
+		if (i % sctxp jobs == worker)
+			mine[count++] = bodies[i];
+	}
+	for (i = 0; i < count; i++)
+		evaluate_one(sctx_ mine[i].sym, mine[i].index);
+
+	/* what access_symbol() appended, it may append some more */
+	i = 0;
+	FOR_EACH_PTR(list, sym) {
+		if (i >= n) {
+			if (count == alloc) {
+				alloc *= 2;
+				mine = realloc(mine, alloc * sizeof(*mine));
+			}
+			mine[count].sym = sym;
+			mine[count++].index = i;
+			evaluate_one(sctx_ sym, i);
 		}
+		i++;
 	} END_FOR_EACH_PTR(sym);
+
+	for (i = 0; i < count; i++)
+		check_one(sctx_ mine[i].sym, mine[i].index);
+	free(mine);
+}
+
+static int diag_cmp_pos(const struct diag_entry *a, const struct diag_entry *b)
+{
+	if (a->d.pos.stream != b->d.pos.stream)
+		return a->d.pos.stream < b->d.pos.stream ? -1 : 1;
+	if (a->d.pos.line != b->d.pos.line)
+		return a->d.pos.line < b->d.pos.line ? -1 : 1;
+	if (a->d.pos.pos != b->d.pos.pos)
+		return a->d.pos.pos < b->d.pos.pos ? -1 : 1;
+	return strcmp(a->text, b->text);
+}
+
+static int diag_cmp_order(const struct diag_entry *a, const struct diag_entry *b)
+{
+	if (a->d.order != b->d.order)
+		return a->d.order < b->d.order ? -1 : 1;
+	if (a->worker != b->worker)
+		return a->worker < b->worker ? -1 : 1;
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+/* the same diagnostic together, the one a serial run shows first */
+static int diag_cmp_dup(const void *_a, const void *_b)
+{
+	const struct diag_entry *a = *(struct diag_entry **)_a, *b = *(struct diag_entry **)_b;
+	int cmp = diag_cmp_pos(a, b);
+
+	return cmp ? cmp : diag_cmp_order(a, b);
+}
+
+static int diag_cmp(const void *_a, const void *_b)
+{
+	return diag_cmp_order(_a, _b);
+}
+
+static void show_diagnostics(SCTX_ FILE **files, int nr)
+{
+	struct diag_entry *diags = NULL, **heads;
+	int count = 0, alloc = 0, nr_heads = 0, first, i;
+
+	for (i = 0; i < nr; i++) {
+		struct diag_entry e = { .worker = i };
+
+		rewind(files[i]);
+		while (fread(&e.d, sizeof(e.d), 1, files[i]) == 1) {
+			e.text = malloc(e.d.len + 1);
+			if (!e.text || fread(e.text, e.d.len, 1, files[i]) != 1)
+				break;
+			e.text[e.d.len] = '\0';
+			if (e.d.kind != DIAG_INFO || !e.seq || e.d.order != diags[count - 1].d.order)
+				e.head = count;
+			if (count == alloc) {
+				alloc = alloc ? alloc * 2 : 64;
+				diags = realloc(diags, alloc * sizeof(*diags));
+			}
+			diags[count++] = e;
+			e.seq++;
+		}
+		fclose(files[i]);
+	}
+
+	/*
+	 * An inline function used by several workers is evaluated by each,
+	 * and its cases are checked by each: the same diagnostic in the
+	 * same place of the serial run, or a diagnostic given once per
+	 * function, is only kept the first time, with its infos.
+	 */
+	heads = malloc((count + 1) * sizeof(*heads));
+	for (i = 0; i < count; i++) {
+		if (diags[i].head == i)
+			heads[nr_heads++] = diags + i;
+	}
+	qsort(heads, nr_heads, sizeof(*heads), diag_cmp_dup);
+	for (i = 0, first = 0; i < nr_heads; i++) {
+		struct diag_entry *e = heads[i];
+		int j;
+
+		if (diag_cmp_pos(heads[first], e))
+			first = i;
+		for (j = first; j < i; j++) {
+			if (heads[j]->worker != e->worker &&
+			    (heads[j]->d.order == e->d.order || (heads[j]->d.once && e->d.once)))
+				e->dup = 1;
+		}
+	}
+	for (i = 0; i < count; i++)
+		diags[i].dup = diags[diags[i].head].dup;
+	free(heads);
+
+	/* the head of an info is before it, and stays so */
+	qsort(diags, count, sizeof(*diags), diag_cmp);
+	for (i = 0; i < count; i++) {
+		if (!diags[i].dup)
+			show_diagnostic(sctx_ &diags[i].d, diags[i].text);
+		free(diags[i].text);
+	}
+	free(diags);
+}
+
+/* a worker that didn't finish, its bodies may not all be checked */
+static int worker_failed(int worker, int status)
+{
+	if (WIFEXITED(status) && !WEXITSTATUS(status))
+		return 0;
+	if (WIFSIGNALED(status))
+		fprintf(stderr, "sparse: worker %d killed by signal %d\n", worker, WTERMSIG(status));
+	else
+		fprintf(stderr, "sparse: worker %d exited with status %d\n", worker, WEXITSTATUS(status));
+	return 1;
+}
+
+/* how many workers failed */
+static int check_symbols_parallel(SCTX_ struct symbol_list *list)
+{
+	FILE **files = calloc(sctxp jobs + 1, sizeof(FILE *));
+	pid_t *pids = calloc(sctxp jobs, sizeof(pid_t));
+	int *status = calloc(sctxp jobs, sizeof(int));
+	struct body *bodies;
+	int n, nr = 0, i, failed = 0;
+	struct symbol *sym;
+
+	files[0] = tmpfile();
+	if (!files[0])
+		sparse_die(sctx_ "cannot create a file for the diagnostics");
+	sctxp diag_file = files[0];
+
+	/* the declarations, and what their evaluation appends */
+	i = 0;
+	FOR_EACH_PTR(list, sym) {
+		if (!has_body(sym))
+			evaluate_one(sctx_ sym, i);
+		i++;
+	} END_FOR_EACH_PTR(sym);
+
+	n = symbol_list_size(sctx_ list);
+	bodies = malloc((n + 1) * sizeof(*bodies));
+	i = 0;
+	FOR_EACH_PTR(list, sym) {
+		if (has_body(sym)) {
+			sctxp diag_order = EVALUATE_ORDER(i);
+			examine_symbol_type(sctx_ sym);
+			bodies[nr].sym = sym;
+			bodies[nr++].index = i;
+		}
+		i++;
+	} END_FOR_EACH_PTR(sym);
+	i = 0;
+	FOR_EACH_PTR(list, sym) {
+		if (!has_body(sym))
+			check_one(sctx_ sym, i);
+		i++;
+	} END_FOR_EACH_PTR(sym);
+
+	fflush(stdout);
+	fflush(files[0]);
+	for (i = 0; i < sctxp jobs; i++) {
+		files[i + 1] = tmpfile();
+		if (!files[i + 1])
+			sparse_die(sctx_ "cannot create a file for the diagnostics");
+		pids[i] = fork();
+		if (pids[i] < 0)
+			sparse_die(sctx_ "fork: %s", strerror(errno));
+		if (!pids[i]) {
+			/* a fatal error ends the worker, not a server request */
+			sctxp die_hook = NULL;
+			sctxp diag_file = files[i + 1];
+			check_worker(sctx_ list, bodies, nr, i);
+			fflush(stdout);
+			fflush(sctxp diag_file);
+			_exit(0);
+		}
+	}
+	for (i = 0; i < sctxp jobs; i++) {
+		while (waitpid(pids[i], status + i, 0) < 0 && errno == EINTR)
+			;
+	}
+	sctxp diag_file = NULL;
+	sctxp diag_order = 0;
+	show_diagnostics(sctx_ files, sctxp jobs + 1);
+	for (i = 0; i < sctxp jobs; i++)
+		failed += worker_failed(i, status[i]);
+
+	/* what the workers did is not here, don't do it again for later files */
+	for (i = 0; i < nr; i++)
+		bodies[i].sym->evaluated = 1;
+	free(bodies);
+	free(files);
+	free(pids);
+	free(status);
+	return failed;
+}
+
+/* non-zero when -j couldn't check everything */
+static int check_file(SCTX_ char *file)
+{
+	if (sctxp jobs > 1)
+		return check_symbols_parallel(sctx_ __sparse(sctx_ file));
+	check_symbols(sctx_ sparse(sctx_ file));
+	return 0;
+}
+
+/*
+ * --server SOCKET keeps the initialized context (builtins, -include
+ * files and, through -fincremental, every tokenized header) and
+ * answers one request per connection:
+ *
+ *	check FILE		warnings, as a normal run would print them
+ *	symbols FILE		the top-level symbols of FILE
+ *	preprocess FILE		like -E
+ *
+ * Everything printed while handling a request goes to the client.
+ * Headers are re-read when their size or mtime changed. A fatal error
+ * ends the request, not the server. What a request allocated is given
+ * back once it is answered, see end_request().
+ */
+static void show_symbols(SCTX_ struct symbol_list *list)
+{
+	struct symbol *sym;
+
+	FOR_EACH_PTR(list, sym) {
+		const char *kind = "variable";
+
+		if (!sym->ident)
+			continue;
+		if (sym->ctype.modifiers & MOD_TYPEDEF)
+			kind = "typedef";
+		else if (get_base_type(sctx_ sym) && get_base_type(sctx_ sym)->type == SYM_FN)
+			kind = "function";
+		printf("%s:%d:%d: %s %s\n",
+		       stream_name(sctx_ sym->pos->pos.stream), sym->pos->pos.line,
+		       sym->pos->pos.pos, kind, show_ident(sctx_ sym->ident));
+	} END_FOR_EACH_PTR(sym);
+}
+
+/* a fatal error only ends the request it happened in */
+static jmp_buf *request_jmp;
+
+/* what the server started with, each request is trimmed back to it */
+static struct {
+	int globals, fouled, streams, kept_streams;
+	struct member_index *member_indexes;
+} server_base;
+
+static void request_died(SCTX)
+{
+	longjmp(*request_jmp, 1);
+}
+
+/* what a request that died half way through left behind */
+static void request_cleanup(SCTX)
+{
+	end_inner_scopes(sctx);
+	sctxp false_nesting = 0;
+	sctxp preprocessing = 0;
+	sctxp preprocess_only = 0;
+	sctxp pp_emit = NULL;
+	sctxp token_allocator.nofree = 1;
+	sctxp current_fn = NULL;
+	sctxp diag_file = NULL;
+	sctxp cur_stack_op = NULL;
+	sctxp tok_stk = NULL;
+	memset(sctxp insn_hash_table, 0, sizeof(sctxp insn_hash_table));
+}
+
+/* identifiers, strings and the -fincremental caches serve every request */
+static void drop_request_allocations(SCTX_ struct allocator_struct *desc, void *data)
+{
+	if (desc == &sctxp ident_allocator || desc == &sctxp string_allocator ||
+	    desc == &sctxp CString_allocator || desc == &sctxp cached_token_allocator)
+		return;
+	drop_all_allocations(sctx_ desc);
+}
+
+static void protect_server_allocations(SCTX_ struct allocator_struct *desc, void *data)
+{
+	protect_allocations(sctx_ desc);
+}
+
+/*
+ * Forget the file the request was about and everything pointing into
+ * it, then give its memory back: a server checking the same file over
+ * and over again doesn't grow.
+ */
+static void end_request(SCTX)
+{
+	if (sctxp file_scope != &sctxp builtin_scope)
+		end_file_scope(sctx);
+	trim_global_scope(sctx_ server_base.globals);
+	trim_symbol_types(sctx_ server_base.fouled, server_base.member_indexes);
+	server_base.kept_streams = trim_input_streams(sctx_ server_base.streams, server_base.kept_streams);
+	forget_shared_pseudos(sctx);
+	sctxp translation_unit_used_list = NULL;
+	sctxp pp_tokenlist = NULL;
+	sctxp pp_printed = 0;
+	sparse_ctx_for_each_allocator(sctx, drop_request_allocations, NULL);
+}
+
+static void serve_request(SCTX_ char *line)
+{
+	char *cmd = strtok(line, " \t\r\n");
+	char *file = strtok(NULL, " \t\r\n");
+	jmp_buf jb;
+
+	if (!cmd || !file) {
+		printf("bad request\n");
+		return;
+	}
+	if (access(file, R_OK)) {
+		printf("No such file: %s\n", file);
+		return;
+	}
+
+	sctxp max_warnings = 100;
+	sctxp show_info = 1;
+	sctxp errors = 0;
+	sctxp too_many_errors = 0;
+	sctxp die_if_error = 0;
+
+	request_jmp = &jb;
+	sctxp die_hook = request_died;
+	if (setjmp(jb)) {
+		request_cleanup(sctx);
+	} else if (!strcmp(cmd, "check")) {
+		check_file(sctx_ file);
+	} else if (!strcmp(cmd, "symbols")) {
+		show_symbols(sctx_ sparse(sctx_ file));
+	} else if (!strcmp(cmd, "preprocess")) {
+		sctxp preprocess_only = 1;
+		sparse(sctx_ file);
+		sctxp preprocess_only = 0;
+	} else
+		printf("unknown request: %s\n", cmd);
+	sctxp die_hook = NULL;
+
+	end_request(sctx);
+}
+
+static int read_request(int fd, char *buf, int size)
+{
+	int len = 0;
+
+	while (len < size - 1) {
+		int n = read(fd, buf + len, size - 1 - len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		len += n;
+		if (memchr(buf + len - n, '\n', n))
+			break;
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+static void serve(SCTX)
+{
+	struct sockaddr_un addr;
+	int sock, out, err;
+	const char *path = sctxp server_socket;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		sparse_die(sctx_ "socket path too long: %s", path);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 16) < 0)
+		sparse_die(sctx_ "cannot listen on %s: %s", path, strerror(errno));
+
+	/* a client going away must not take the server with it */
+	signal(SIGPIPE, SIG_IGN);
+	out = dup(1);
+	err = dup(2);
+
+	server_base.globals = symbol_list_size(sctx_ sctxp global_scope->symbols);
+	server_base.fouled = symbol_list_size(sctx_ sctxp fouled);
+	server_base.streams = server_base.kept_streams = sctxp input_stream_nr;
+	server_base.member_indexes = sctxp member_indexes;
+	sparse_ctx_for_each_allocator(sctx, protect_server_allocations, NULL);
+
+	for (;;) {
+		char buf[4096];
+		int fd = accept(sock, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			sparse_die(sctx_ "accept: %s", strerror(errno));
+		}
+		if (read_request(fd, buf, sizeof(buf)) > 0) {
+			fflush(stdout);
+			fflush(stderr);
+			dup2(fd, 1);
+			dup2(fd, 2);
+			serve_request(sctx_ buf);
+			fflush(stdout);
+			fflush(stderr);
+			dup2(out, 1);
+			dup2(err, 2);
+		}
+		close(fd);
+	}
 }
 
 int main(int argc, char **argv)
 {
 	struct string_list *filelist = NULL;
 	char *file; SPARSE_CTX_INIT;
+	int failed = 0;
 
 	// Expand, linearize and show it.
 	check_symbols(sctx_ sparse_initialize(sctx_ argc, argv, &filelist));
+	if (sctxp server_socket)
+		serve(sctx);
 	FOR_EACH_PTR_NOTAG(filelist, file) {
-		check_symbols(sctx_ sparse(sctx_ file));
+		failed |= check_file(sctx_ file);
 	} END_FOR_EACH_PTR_NOTAG(file);
-	return 0;
+	return failed ? 1 : 0;
 }
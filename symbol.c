@@ -487,6 +487,204 @@ struct symbol *examine_pointer_target(SCTX_ struct symbol *sym)
 	return examine_base_type(sctx_ sym);
 }
 
+/*
+ * Member lookup. Big structs and unions get an index, built on the
+ * first lookup once they are laid out: every member by name, with the
+ * members of anonymous structs and unions flattened in, their offset
+ * from the start of the outer type and the top level member that holds
+ * them. Small ones are just scanned.
+ */
+#define MEMBER_INDEX_MIN 16
+
+struct member_entry {
+	struct ident *ident;
+	struct symbol *sym;		/* the first member of that name */
+	struct symbol *direct;		/* the first one at the top level */
+	int offset, index;
+};
+
+struct member_index {
+	struct member_index *next;
+	struct symbol *type;
+	struct symbol *last;		/* the members it was built from */
+	unsigned long mask;
+	struct member_entry entries[];
+};
+
+#ifndef DO_CTX
+static struct member_index *member_indexes;
+#endif
+
+static inline struct symbol *anonymous_member(struct symbol *sym)
+{
+	struct symbol *ctype = sym->ctype.base_type;
+
+	if (sym->ident || !ctype)
+		return NULL;
+	if (ctype->type != SYM_UNION && ctype->type != SYM_STRUCT)
+		return NULL;
+	return ctype;
+}
+
+static int count_members(struct symbol *type)
+{
+	struct symbol *sym, *sub;
+	int nr = 0;
+
+	FOR_EACH_PTR(type->symbol_list, sym) {
+		if (sym->ident)
+			nr++;
+		else if ((sub = anonymous_member(sym)) != NULL)
+			nr += count_members(sub);
+	} END_FOR_EACH_PTR(sym);
+	return nr;
+}
+
+static struct member_entry *member_slot(struct member_index *mi, struct ident *ident)
+{
+	unsigned long h = ((unsigned long)ident >> 4) * 0x9e3779b1UL;
+
+	for (h &= mi->mask; mi->entries[h].ident; h = (h + 1) & mi->mask)
+		if (mi->entries[h].ident == ident)
+			break;
+	return mi->entries + h;
+}
+
+/* top < 0 for the members of 'type' itself, else the member holding them */
+static void index_members(struct member_index *mi, struct symbol *type, int offset, int top)
+{
+	struct symbol *sym, *sub;
+	int i = 0;
+
+	FOR_EACH_PTR(type->symbol_list, sym) {
+		int index = top < 0 ? i : top;
+
+		if (sym->ident) {
+			struct member_entry *e = member_slot(mi, sym->ident);
+
+			if (!e->ident) {
+				e->ident = sym->ident;
+				e->sym = sym;
+				e->offset = offset + sym->offset;
+				e->index = index;
+			}
+			if (top < 0 && !e->direct)
+				e->direct = sym;
+		} else if ((sub = anonymous_member(sym)) != NULL) {
+			index_members(mi, sub, offset + sym->offset, index);
+		}
+		i++;
+	} END_FOR_EACH_PTR(sym);
+}
+
+static struct member_index *get_member_index(SCTX_ struct symbol *type)
+{
+	struct member_index *mi = type->member_index;
+	struct symbol *last;
+	unsigned long size;
+	int nr;
+
+	if (!type->examined || !type->symbol_list)
+		return NULL;
+	last = last_ptr_list((struct ptr_list *)type->symbol_list);
+	if (mi && mi->last == last)
+		return mi;
+
+	/* members were added since, build it again */
+	nr = count_members(type);
+	if (nr < MEMBER_INDEX_MIN)
+		return NULL;
+	for (size = 4; size < 2UL * nr; size <<= 1)
+		;
+	mi = calloc(1, sizeof(*mi) + size * sizeof(struct member_entry));
+	if (!mi)
+		return NULL;
+	mi->type = type;
+	mi->last = last;
+	mi->mask = size - 1;
+	index_members(mi, type, 0, -1);
+	mi->next = sctxp member_indexes;
+	sctxp member_indexes = mi;
+	type->member_index = mi;
+	return mi;
+}
+
+static struct symbol *scan_members(struct symbol *type, struct ident *ident, int *offset, int *index)
+{
+	struct symbol *sym, *sub, *found;
+	int i = 0;
+
+	FOR_EACH_PTR(type->symbol_list, sym) {
+		if (sym->ident == ident) {
+			*offset = sym->offset;
+			*index = i;
+			return sym;
+		}
+		if ((sub = anonymous_member(sym)) != NULL) {
+			found = scan_members(sub, ident, offset, index);
+			if (found) {
+				*offset += sym->offset;
+				*index = i;
+				return found;
+			}
+		}
+		i++;
+	} END_FOR_EACH_PTR(sym);
+	return NULL;
+}
+
+/*
+ * The member 'ident' of a struct or union, looked up in the anonymous
+ * members too. *offset is its byte offset in 'type', *index the number
+ * of the top level member it is or is part of; either may be NULL.
+ */
+struct symbol *find_member(SCTX_ struct symbol *type, struct ident *ident, int *offset, int *index)
+{
+	struct member_index *mi = get_member_index(sctx_ type);
+	struct symbol *sym;
+	int off = 0, nr = 0;
+
+	if (mi) {
+		struct member_entry *e = member_slot(mi, ident);
+
+		sym = e->sym;
+		off = e->offset;
+		nr = e->index;
+	} else {
+		sym = scan_members(type, ident, &off, &nr);
+	}
+	if (sym && offset)
+		*offset = off;
+	if (sym && index)
+		*index = nr;
+	return sym;
+}
+
+/* the member 'ident' of a struct or union, not looking into anonymous ones */
+struct symbol *find_direct_member(SCTX_ struct symbol *type, struct ident *ident)
+{
+	struct member_index *mi = get_member_index(sctx_ type);
+	struct symbol *sym;
+
+	if (mi)
+		return member_slot(mi, ident)->direct;
+	FOR_EACH_PTR(type->symbol_list, sym) {
+		if (sym->ident == ident)
+			return sym;
+	} END_FOR_EACH_PTR(sym);
+	return NULL;
+}
+
+void free_member_indexes(SCTX)
+{
+	while (sctxp member_indexes) {
+		struct member_index *mi = sctxp member_indexes;
+
+		sctxp member_indexes = mi->next;
+		free(mi);
+	}
+}
+
 #ifndef DO_CTX
 static struct symbol_list *restr, *fouled;
 #endif
@@ -524,6 +722,28 @@ struct symbol *befoul(SCTX_ struct symbol *type)
 	return NULL;
 }
 
+/*
+ * For a long-running process: forget the fouled types after the first
+ * 'keep' ones and the member indexes built since 'mi'.
+ */
+void trim_symbol_types(SCTX_ int keep, struct member_index *mi)
+{
+	int nr = symbol_list_size(sctx_ sctxp fouled);
+
+	while (nr-- > keep) {
+		delete_last_symbol(sctx_ &sctxp restr);
+		delete_last_symbol(sctx_ &sctxp fouled);
+	}
+	while (sctxp member_indexes != mi) {
+		struct member_index *m = sctxp member_indexes;
+
+		sctxp member_indexes = m->next;
+		if (m->type->member_index == m)
+			m->type->member_index = NULL;
+		free(m);
+	}
+}
+
 void check_declaration(SCTX_ struct symbol *sym)
 {
 	int warned = 0;
@@ -567,6 +787,8 @@ void bind_symbol(SCTX_ struct symbol *sym, struct ident *ident, enum namespace n
 	sym->namespace = ns;
 	sym->next_id = ident->symbols;
 	ident->symbols = sym;
+	if (ns & (NS_MACRO | NS_UNDEF))
+		ident->macro = sym;
 	if (sym->ident && sym->ident != ident)
 		warning(sctx_ sym->pos->pos, "Symbol '%s' already bound", show_ident(sctx_ sym->ident));
 	sym->ident = ident;
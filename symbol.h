@@ -70,6 +70,11 @@ extern const char *builtin_typename(SCTX_ struct symbol *sym);
 extern const char *builtin_ctypename(SCTX_ struct ctype *ctype);
 extern const char* get_type_name(SCTX_ enum type type);
 
+extern struct symbol *find_member(SCTX_ struct symbol *type, struct ident *ident, int *offset, int *index);
+extern struct symbol *find_direct_member(SCTX_ struct symbol *type, struct ident *ident);
+extern void free_member_indexes(SCTX);
+extern void trim_symbol_types(SCTX_ int keep, struct member_index *mi);
+
 extern void debug_symbol(SCTX_ struct symbol *);
 extern void merge_type(SCTX_ struct symbol *sym, struct symbol *base_type);
 extern void check_declaration(SCTX_ struct symbol *sym);
@@ -144,6 +144,7 @@ struct symbol {
 			struct token *expansion;
 			struct token *arglist;
 			struct scope *used_in;
+			int inert;	/* no identifiers or arguments in the body, see expand() */
 		};
 		struct /* NS_PREPROCESSOR */ {
 			int (*handler)(SCTX_ struct expansion *e, struct stream *, struct token **, struct token *);
@@ -161,12 +162,14 @@ struct symbol {
 					evaluated:1,
 					string:1,
 					designated_init:1,
-					forced_arg:1;
+					forced_arg:1,
+					cases_checked:1;	/* SYM_FN, see expand_switch_cases() */
 			struct expression *array_size;
 			struct ctype ctype;
 			struct symbol_list *arguments;
 			struct statement *stmt;
 			struct symbol_list *symbol_list;
+			struct member_index *member_index;	/* struct, union: see find_member() */
 			struct statement *inline_stmt;
 			struct symbol_list *inline_symbol_list;
 			struct expression *initializer;
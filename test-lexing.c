@@ -2,6 +2,15 @@
  * Example test program that just uses the tokenization and
  * preprocessing phases, and prints out the results.
  *
+ *	test-lexing [sparse options] files...
+ *	test-lexing --bench[=pp] [-j N] [sparse options] files...
+ *
+ * --bench only tokenizes the files, --bench=pp preprocesses them too,
+ * nothing is printed but the throughput, the identifier hash and literal
+ * pool hits and what the allocators handed out, with the bytes of the blobs
+ * they had to add for it. With -j the files are shared by N threads,
+ * each with a context of its own.
+ *
  * Copyright (C) 2003 Transmeta Corp.
  *               2003 Linus Torvalds
  *
@@ -14,16 +23,234 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "token.h"
 #include "symbol.h"
+#include "scope.h"
+#include "allocate.h"
+
+#define BENCH_ALLOCATORS 5
+
+struct bench_stats {
+	unsigned long files, bytes, tokens;
+	unsigned long ident_hit, ident_miss;
+	unsigned long string_hit, string_miss;
+	unsigned long allocations[BENCH_ALLOCATORS], alloc_bytes[BENCH_ALLOCATORS];
+	unsigned long blob_bytes[BENCH_ALLOCATORS];
+};
+
+static const char *alloc_names[BENCH_ALLOCATORS] = {
+	"tokens", "identifiers", "strings", "bytes", "expansions",
+};
+
+static struct allocator_struct *bench_allocator(SCTX_ int i)
+{
+	switch (i) {
+	case 0: return &sctxp token_allocator;
+	case 1: return &sctxp ident_allocator;
+	case 2: return &sctxp string_allocator;
+	case 3: return &sctxp bytes_allocator;
+	default: return &sctxp expansion_allocator;
+	}
+}
+
+/* what the counters of a context say, see bench_worker() */
+static void bench_count(SCTX_ struct bench_stats *st, int sign)
+{
+	int i;
+
+	st->ident_hit += sign * (long)sctxp ident_hit;
+	st->ident_miss += sign * (long)sctxp ident_miss;
+	st->string_hit += sign * (long)sctxp string_hit;
+	st->string_miss += sign * (long)sctxp string_miss;
+	for (i = 0; i < BENCH_ALLOCATORS; i++) {
+		struct allocator_struct *a = bench_allocator(sctx_ i);
+
+		st->allocations[i] += sign * (long)a->allocations;
+		st->alloc_bytes[i] += sign * (long)a->useful_bytes;
+		st->blob_bytes[i] += sign * (long)a->total_bytes;
+	}
+}
+
+static struct {
+	int argc;
+	char **argv;
+	char **files;
+	int nr, next;
+	int pp;
+	pthread_mutex_t lock;
+	pthread_barrier_t start;
+} bench;
+
+struct bench_worker {
+	pthread_t thread;
+	struct bench_stats st;
+};
+
+static char *next_file(void)
+{
+	char *file = NULL;
+
+	pthread_mutex_lock(&bench.lock);
+	if (bench.next < bench.nr)
+		file = bench.files[bench.next++];
+	pthread_mutex_unlock(&bench.lock);
+	return file;
+}
+
+static void bench_file(SCTX_ struct bench_stats *st, char *file)
+{
+	struct expansion *e;
+	struct token *token;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "No such file: %s\n", file);
+		return;
+	}
+	new_file_scope(sctx);
+	e = tokenize(sctx_ file, fd, NULL, sctxp includepath);
+	close(fd);
+	token = bench.pp ? preprocess(sctx_ e) : e->s;
+	for (; token && !eof_token(token); token = token->next)
+		st->tokens++;
+	st->files++;
+}
+
+static void *bench_worker(void *arg)
+{
+	struct bench_worker *w = arg;
+	struct sparse_ctx *ctx = malloc(sizeof(*ctx));
+	SPARSE_CTX_GEN(sparse_ctx_init(ctx))
+	struct string_list *filelist = NULL;
+	char **argv = malloc((bench.argc + 1) * sizeof(char *));
+	char *file;
+	int first, i;
+
+	for (i = 0; i < bench.argc; i++)
+		argv[i] = strdup(bench.argv[i]);
+	argv[i] = NULL;
+	sparse_initialize(sctx_ bench.argc, argv, &filelist);
+	bench_count(sctx_ &w->st, -1);
+	first = sctxp input_stream_nr;
+
+	pthread_barrier_wait(&bench.start);
+	while ((file = next_file()) != NULL)
+		bench_file(sctx_ &w->st, file);
+	bench_count(sctx_ &w->st, 1);
+
+	/* the bytes of every stream that was read, includes too */
+	for (i = first; i < sctxp input_stream_nr; i++) {
+		struct stat st;
+
+		if (!stat(stream_name(sctx_ i), &st))
+			w->st.bytes += st.st_size;
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_bench(int argc, char **argv, struct string_list *filelist, int jobs)
+{
+	struct bench_worker *workers = calloc(jobs, sizeof(*workers));
+	struct bench_stats total = { 0 };
+	unsigned long bytes = 0, blob_bytes = 0;
+	double start, secs;
+	char *file;
+	int i, j;
+
+	bench.argc = argc;
+	bench.argv = argv;
+	FOR_EACH_PTR_NOTAG(filelist, file) {
+		bench.files = realloc(bench.files, (bench.nr + 1) * sizeof(char *));
+		bench.files[bench.nr++] = file;
+	} END_FOR_EACH_PTR_NOTAG(file);
+	pthread_mutex_init(&bench.lock, NULL);
+	pthread_barrier_init(&bench.start, NULL, jobs + 1);
+
+	for (i = 0; i < jobs; i++)
+		pthread_create(&workers[i].thread, NULL, bench_worker, workers + i);
+	pthread_barrier_wait(&bench.start);
+	start = now();
+	for (i = 0; i < jobs; i++)
+		pthread_join(workers[i].thread, NULL);
+	secs = now() - start;
+
+	for (i = 0; i < jobs; i++) {
+		struct bench_stats *st = &workers[i].st;
+
+		total.files += st->files;
+		total.bytes += st->bytes;
+		total.tokens += st->tokens;
+		total.ident_hit += st->ident_hit;
+		total.ident_miss += st->ident_miss;
+		total.string_hit += st->string_hit;
+		total.string_miss += st->string_miss;
+		for (j = 0; j < BENCH_ALLOCATORS; j++) {
+			total.allocations[j] += st->allocations[j];
+			total.alloc_bytes[j] += st->alloc_bytes[j];
+			total.blob_bytes[j] += st->blob_bytes[j];
+		}
+	}
+	if (secs <= 0)
+		secs = 1e-9;
+
+	printf("%s: %lu files, %d jobs, %.3f s\n", bench.pp ? "preprocess" : "tokenize",
+		total.files, jobs, secs);
+	printf("  %lu bytes, %.2f MB/s\n", total.bytes, total.bytes / secs / 1e6);
+	printf("  %lu tokens, %.2f M/s\n", total.tokens, total.tokens / secs / 1e6);
+	printf("  identifiers: %lu hits, %lu misses, %.1f%% hits\n", total.ident_hit, total.ident_miss,
+		100.0 * total.ident_hit / (total.ident_hit + total.ident_miss ? : 1));
+	printf("  literals: %lu hits, %lu misses, %.1f%% hits\n", total.string_hit, total.string_miss,
+		100.0 * total.string_hit / (total.string_hit + total.string_miss ? : 1));
+	for (j = 0; j < BENCH_ALLOCATORS; j++) {
+		printf("  %s: %lu allocations, %lu bytes, %lu in new blobs\n", alloc_names[j],
+			total.allocations[j], total.alloc_bytes[j], total.blob_bytes[j]);
+		bytes += total.alloc_bytes[j];
+		blob_bytes += total.blob_bytes[j];
+	}
+	printf("  allocated: %lu bytes, %lu in new blobs\n", bytes, blob_bytes);
+	free(workers);
+	return total.files != (unsigned long)bench.nr;
+}
 
 int main(int argc, char **argv)
 {
 	struct string_list *filelist = NULL;
 	char *file;
+	int i, j, jobs = 1, benchmark = 0;
 	SPARSE_CTX_INIT
 
+	for (i = j = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--bench"))
+			benchmark = 1;
+		else if (!strcmp(argv[i], "--bench=pp"))
+			benchmark = bench.pp = 1;
+		else if (!strncmp(argv[i], "-j", 2) && (argv[i][2] || i + 1 < argc))
+			jobs = parse_jobs(sctx_ argv[i][2] ? argv[i] + 2 : argv[++i]);
+		else
+			argv[j++] = argv[i];
+	}
+	argv[j] = NULL;
+	argc = j;
+
+	if (benchmark) {
+		/* only for the file list, the workers set up contexts of their own */
+		sparse_initialize(sctx_ argc, argv, &filelist);
+		return run_bench(argc, argv, filelist, jobs);
+	}
+
 	sctxp preprocess_only = 1;
 	sparse_initialize(sctx_ argc, argv, &filelist);
 	FOR_EACH_PTR_NOTAG(filelist, file) {
@@ -0,0 +1,123 @@
+/*
+ * Drive sparse --server for the test-suite:
+ *
+ *	test-server [sparse options] {check|symbols|preprocess FILE}...
+ *
+ * starts the sparse next to it as a server on a private socket,
+ * sends it one request per pair of arguments, prints the answers
+ * and stops it again.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+static struct sockaddr_un addr;
+
+static int connect_server(void)
+{
+	int i;
+
+	/* the server only listens once it is done initializing */
+	for (i = 0; i < 1000; i++) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if (fd < 0)
+			return -1;
+		if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+			return fd;
+		close(fd);
+		usleep(10000);
+	}
+	return -1;
+}
+
+static int request(const char *cmd, const char *file)
+{
+	char buf[4096];
+	int fd, len, n;
+
+	fd = connect_server();
+	if (fd < 0)
+		return -1;
+	len = snprintf(buf, sizeof(buf), "%s %s\n", cmd, file);
+	if (write(fd, buf, len) != len) {
+		close(fd);
+		return -1;
+	}
+	while ((n = read(fd, buf, sizeof(buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		fwrite(buf, 1, n, stdout);
+	}
+	close(fd);
+	fflush(stdout);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/sparse-server.XXXXXX";
+	const char *slash = strrchr(argv[0], '/');
+	char *sparse, **args;
+	int i, opts, status, ret = 0;
+	pid_t pid;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+		;
+	opts = i - 1;
+	if ((argc - i) % 2) {
+		fprintf(stderr, "usage: %s [options] {check|symbols|preprocess FILE}...\n", argv[0]);
+		return 1;
+	}
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/socket", dir);
+
+	sparse = malloc(strlen(argv[0]) + sizeof("sparse"));
+	sprintf(sparse, "%.*ssparse", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+	args = calloc(opts + 4, sizeof(*args));
+	args[0] = sparse;
+	memcpy(args + 1, argv + 1, opts * sizeof(*args));
+	args[opts + 1] = (char *)"--server";
+	args[opts + 2] = addr.sun_path;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		rmdir(dir);
+		return 1;
+	}
+	if (!pid) {
+		execvp(sparse, args);
+		perror(sparse);
+		_exit(127);
+	}
+
+	for (; i < argc; i += 2) {
+		if (request(argv[i], argv[i + 1]) < 0) {
+			fprintf(stderr, "no answer from %s\n", sparse);
+			ret = 1;
+			break;
+		}
+	}
+
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	unlink(addr.sun_path);
+	rmdir(dir);
+	return ret;
+}
@@ -71,12 +71,15 @@ extern const char *show_token(SCTX_ const struct token *);
 extern const char *quote_token(SCTX_ const struct token *);
 extern struct expansion *tokenize(SCTX_ const char *, int, struct token *, const char **next_path);
 extern struct expansion * tokenize_buffer(SCTX_ void *, unsigned , unsigned long, struct token **);
+extern int trim_input_streams(SCTX_ int first, int kept);
 extern void init_preprocessor(SCTX);
 extern unsigned long hash_name(SCTX_ const char *name, int len);
 extern struct ident *create_hashed_ident(SCTX_ const char *name, int len, unsigned long hash);
+extern struct string *intern_string(SCTX_ const char *data, int len);
 extern void cstr_ccat(SCTX_ CString *cstr, int ch);
 extern void cstr_new(SCTX_ CString *cstr);
 extern void cstr_cstring(SCTX_ CString *cstr);
+extern void cstr_free(SCTX_ CString *cstr);
 extern int stream_issys(stream_t *stream);
 extern int ppre_issys(SCTX_ const char **p);
 extern struct cons *cons_list(SCTX_ struct token *list, struct token *end);
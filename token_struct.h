@@ -47,6 +47,14 @@ struct stream {
 	struct token *ifndef;
 	struct token *top_if;
 	struct expansion *e;
+
+	/* -fincremental: pristine tokens of the last tokenization */
+	struct token *cache;
+	long long mtime;	/* in ns, see stat_mtime_ns() */
+	int unit;		/* last translation unit it was recycled for */
+	off_t size;
+	dev_t dev;
+	ino_t ino;
 };
 
 #ifndef DO_CTX
@@ -59,6 +67,7 @@ extern int *hash_stream(SCTX_ const char *name);
 struct ident {
 	struct ident *next;	/* Hash chain of identifiers */
 	struct symbol *symbols;	/* Pointer to semantic meaning list */
+	struct symbol *macro;	/* First NS_MACRO|NS_UNDEF on that list */
 	unsigned char len;	/* Length of identifier name */
 	unsigned char tainted:1,
 	              reserved:1,
@@ -230,6 +239,18 @@ struct token_stack {
 	struct cons *h, **p;
 };
 
+/* LIFO scratch memory of macro expansion, see scratch_alloc() */
+struct scratch_chunk {
+	struct scratch_chunk *prev;
+	unsigned long size, used;
+	union { void *p; long long l; double d; } data[];
+};
+
+struct scratch_mark {
+	struct scratch_chunk *chunk;
+	unsigned long used;
+};
+
 enum expansion_typ {
 	EXPANSION_CMDLINE,
 	EXPANSION_STREAM,
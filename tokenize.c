@@ -15,6 +15,7 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <sys/stat.h>
 
 #include "lib.h"
 #include "allocate.h"
@@ -32,6 +33,10 @@ unsigned int tabstop = 8;
 
 #define BUFSIZE (8192)
 
+/* -fincremental caches outlive the tokens of the files they were made for */
+__DECLARE_ALLOCATOR(struct token, cached_token);
+__ALLOCATOR(struct token, "cached tokens", cached_token, 0);
+
 /* ctx.h 
 typedef struct {
 	int fd, offset, size;
@@ -77,7 +82,7 @@ int stream_issys(stream_t *stream)
 
 const char *show_special(SCTX_ int val)
 {
-	static char buffer[4];
+	static TLS_ATTR char buffer[4];
 
 	buffer[0] = val;
 	buffer[1] = 0;
@@ -88,7 +93,7 @@ const char *show_special(SCTX_ int val)
 
 const char *show_ident(SCTX_ const struct ident *ident)
 {
-	static char buffer[256];
+	static TLS_ATTR char buffer[256];
 	if (!ident)
 		return "<noident>";
 	sprintf(buffer, "%.*s", ident->len, ident->name);
@@ -120,7 +125,7 @@ static char *charstr(SCTX_ char *ptr, unsigned char c, unsigned char escape, uns
 
 const char *show_string(SCTX_ const struct string *string)
 {
-	static char buffer[4 * MAX_STRING + 3];
+	static TLS_ATTR char buffer[4 * MAX_STRING + 3];
 	char *ptr;
 	int i;
 
@@ -139,7 +144,7 @@ const char *show_string(SCTX_ const struct string *string)
 
 static const char *show_char(SCTX_ const char *s, size_t len, char prefix, char delim)
 {
-	static char buffer[MAX_STRING + 4];
+	static TLS_ATTR char buffer[MAX_STRING + 4];
 	char *p = buffer;
 	if (prefix)
 		*p++ = prefix;
@@ -153,7 +158,7 @@ static const char *show_char(SCTX_ const char *s, size_t len, char prefix, char
 
 static const char *quote_char(SCTX_ const char *s, size_t len, char prefix, char delim)
 {
-	static char buffer[2*MAX_STRING + 6];
+	static TLS_ATTR char buffer[2*MAX_STRING + 6];
 	size_t i;
 	char *p = buffer;
 	if (prefix)
@@ -175,7 +180,7 @@ static const char *quote_char(SCTX_ const char *s, size_t len, char prefix, char
 
 const char *show_token(SCTX_ const struct token *token)
 {
-	static char buffer[256];
+	static TLS_ATTR char buffer[256];
 
 	if (!token)
 		return "<no token>";
@@ -242,7 +247,7 @@ const char *show_token(SCTX_ const struct token *token)
 
 const char *quote_token(SCTX_ const struct token *token)
 {
-	static char buffer[256];
+	static TLS_ATTR char buffer[256];
 
 	switch (token_type(token)) {
 	case TOKEN_ERROR:
@@ -573,8 +578,8 @@ static const long cclass[257] = {
 static int get_one_number(SCTX_ int c, int next, stream_t *stream)
 {
 	struct token *token;
-	static char buffer[4095];
-	char *p = buffer, *buf, *buffer_end = buffer + sizeof (buffer);
+	static TLS_ATTR char buffer[4095];
+	char *p = buffer, *buffer_end = buffer + sizeof (buffer);
 	int len;
 
 	*p++ = c;
@@ -602,14 +607,11 @@ static int get_one_number(SCTX_ int c, int next, stream_t *stream)
 		p = buffer + 1;
 	}
 
-	*p++ = 0;
 	len = p - buffer;
-	buf = __alloc_bytes(sctx_ len);
-	memcpy(buf, buffer, len);
 
 	token = stream->token;
 	token_type(token) = TOKEN_NUMBER;
-	token->number = buf;
+	token->number = intern_string(sctx_ buffer, len)->data;
 	add_token(sctx_ stream);
 
 	return next;
@@ -617,8 +619,7 @@ static int get_one_number(SCTX_ int c, int next, stream_t *stream)
 
 static int eat_string(SCTX_ int next, stream_t *stream, enum token_type type)
 {
-	static char buffer[MAX_STRING];
-	struct string *string;
+	static TLS_ATTR char buffer[MAX_STRING];
 	struct token *token = stream->token;
 	int len = 0;
 	int escape;
@@ -672,11 +673,7 @@ static int eat_string(SCTX_ int next, stream_t *stream, enum token_type type)
 		memcpy(token->embedded, buffer, 4);
 	} else {
 		token_type(token) = type;
-		string = __alloc_string(sctx_ len+1);
-		memcpy(string->data, buffer, len);
-		string->data[len] = '\0';
-		string->length = len+1;
-		token->string = string;
+		token->string = intern_string(sctx_ buffer, len);
 	}
 
 	/* Pass it on.. */
@@ -858,6 +855,9 @@ static int get_one_special(SCTX_ int c, stream_t *stream)
 #ifndef DO_CTX
 static struct ident *hash_table[IDENT_HASH_SIZE];
 static int ident_hit, ident_miss, idents;
+static struct string **string_pool;
+static unsigned int string_pool_size, string_pool_nr;
+static int string_hit, string_miss;
 #endif
 
 void show_identifier_stats(SCTX)
@@ -894,6 +894,7 @@ static struct ident *alloc_ident(SCTX_ const char *name, int len)
 {
 	struct ident *ident = __alloc_ident(sctx_ len);
 	ident->symbols = NULL;
+	ident->macro = NULL;
 	ident->len = len;
 	ident->tainted = 0;
 	memcpy(ident->name, name, len);
@@ -947,6 +948,69 @@ unsigned long hash_name(SCTX_ const char *name, int len)
 	return ident_hash_end(hash);
 }
 
+/*
+ * Numbers and string literals are interned: the same spelling is the
+ * same struct string, whose data is then never written to. The pool
+ * is open addressed and at most half full.
+ */
+static unsigned int string_hash(const char *data, int len)
+{
+	unsigned int hash = 2166136261u;
+
+	while (len--)
+		hash = (hash ^ (unsigned char)*data++) * 16777619u;
+	return hash;
+}
+
+static void grow_string_pool(SCTX)
+{
+	unsigned int size = sctxp string_pool_size ? sctxp string_pool_size * 2 : 1024;
+	struct string **pool = calloc(size, sizeof(*pool));
+	unsigned int i;
+
+	if (!pool)
+		sparse_die(sctx_ "out of memory");
+	for (i = 0; i < sctxp string_pool_size; i++) {
+		struct string *s = sctxp string_pool[i];
+		unsigned int h;
+
+		if (!s)
+			continue;
+		h = string_hash(s->data, s->length - 1);
+		while (pool[h & (size - 1)])
+			h++;
+		pool[h & (size - 1)] = s;
+	}
+	free(sctxp string_pool);
+	sctxp string_pool = pool;
+	sctxp string_pool_size = size;
+}
+
+/* the interned copy of len bytes, 0 terminated */
+struct string *intern_string(SCTX_ const char *data, int len)
+{
+	unsigned int h, mask;
+	struct string *s;
+
+	if (2 * (sctxp string_pool_nr + 1) > sctxp string_pool_size)
+		grow_string_pool(sctx);
+	mask = sctxp string_pool_size - 1;
+	for (h = string_hash(data, len); (s = sctxp string_pool[h & mask]) != NULL; h++) {
+		if (s->length == len + 1 && !memcmp(s->data, data, len)) {
+			sctxp string_hit++;
+			return s;
+		}
+	}
+	s = __alloc_string(sctx_ len + 1);
+	memcpy(s->data, data, len);
+	s->data[len] = '\0';
+	s->length = len + 1;
+	sctxp string_pool[h & mask] = s;
+	sctxp string_pool_nr++;
+	sctxp string_miss++;
+	return s;
+}
+
 struct ident *hash_ident(SCTX_ struct ident *ident)
 {
 	return insert_hash(sctx_ ident, hash_name(sctx_ ident->name, ident->len));
@@ -1097,6 +1161,118 @@ struct expansion * tokenize_buffer(SCTX_ void *buffer, unsigned idx, unsigned lo
 	return e;
 }
 
+/*
+ * -fincremental: every tokenized file keeps a pristine copy of its
+ * token list, tagged with the file's identity. A later inclusion of
+ * the same, unmodified file just duplicates the cached list instead
+ * of reading and lexing it again. Streams of earlier files are not
+ * active anymore and get recycled, once per file, so that a
+ * long-running context doesn't run out of stream numbers. A header
+ * that includes itself (gcc's limits.h does, through syslimits.h)
+ * gets a new stream the second time.
+ */
+static struct token *dup_stream_tokens(SCTX_ struct token *list, int idx, struct expansion *e, struct token **end,
+				       struct token *(*alloc)(SCTX_ int))
+{
+	struct token *res = NULL, *token = NULL;
+	struct token **p = &res;
+
+	while (!eof_token(list)) {
+		token = alloc(sctx_ 0);
+		*token = *list;
+		token->pos.stream = idx;
+		token->e = e;
+		*p = token;
+		p = &token->next;
+		list = list->next;
+	}
+	*p = &sctxp eof_token_entry;
+	*end = token;
+	return res;
+}
+
+static void stream_cache_save(SCTX_ struct stream *s, struct token *begin, int fd)
+{
+	struct stat st;
+	struct token *end;
+
+	if (fstat(fd, &st) < 0)
+		return;
+	s->cache = dup_stream_tokens(sctx_ begin, s->id, NULL, &end, __alloc_cached_token);
+	s->mtime = stat_mtime_ns(&st);
+	s->size = st.st_size;
+	s->dev = st.st_dev;
+	s->ino = st.st_ino;
+}
+
+static void free_stream_cache(SCTX_ struct stream *s)
+{
+	struct token *token = s->cache;
+
+	while (!eof_token(token)) {
+		struct token *next = token->next;
+		__free_cached_token(sctx_ token);
+		token = next;
+	}
+	s->cache = NULL;
+}
+
+static struct expansion *tokenize_cached(SCTX_ const char *name, int fd, struct token *endtoken, const char **next_path)
+{
+	struct stat st;
+	struct stream *s;
+	struct expansion *e;
+	struct token *begin, *end;
+	int stream, next;
+
+	if (fstat(fd, &st) < 0)
+		return NULL;
+
+	for (stream = *hash_stream(sctx_ name); stream >= 0; stream = next) {
+		s = sctxp input_streams + stream;
+		next = s->next_stream;
+		if (s->cache && !strcmp(name, s->name))
+			break;
+	}
+	if (stream < 0)
+		return NULL;
+	if (s->mtime != stat_mtime_ns(&st) || s->size != st.st_size ||
+	    s->dev != st.st_dev || s->ino != st.st_ino) {
+		free_stream_cache(sctx_ s);
+		return NULL;
+	}
+
+	if (stream < sctxp first_tu_stream && s->unit != sctxp unit_nr) {
+		s->unit = sctxp unit_nr;
+		s->fd = fd;
+		s->next_path = next_path;
+		s->issys = ppre_issys(sctx_ next_path);
+		s->constant = CONSTANT_FILE_MAYBE;
+		s->dirty = 0;
+		s->protect = NULL;
+		s->ifndef = NULL;
+		s->top_if = NULL;
+	} else {
+		struct token *cache = s->cache;
+		s->cache = NULL;
+		s = init_stream(sctx_ name, fd, next_path);
+		s->cache = cache;
+		s->mtime = stat_mtime_ns(&st);
+		s->size = st.st_size;
+		s->dev = st.st_dev;
+		s->ino = st.st_ino;
+	}
+
+	e = expansion_new(sctx_ EXPANSION_STREAM);
+	begin = dup_stream_tokens(sctx_ s->cache, s->id, e, &end, __alloc_token);
+	e->s = begin;
+	e->e = &begin->next;
+	s->e = e;
+	if (endtoken)
+		end->next = endtoken;
+	return e;
+}
+
 struct expansion * tokenize(SCTX_ const char *name, int fd, struct token *endtoken, const char **next_path)
 {
 	struct token *end;
@@ -1104,6 +1280,12 @@ struct expansion * tokenize(SCTX_ const char *name, int fd, struct token *endtok
 	unsigned char buffer[BUFSIZE];
 	int idx; struct stream *s;
 
+	if (sctxp incremental && fd > 0) {
+		e = tokenize_cached(sctx_ name, fd, endtoken, next_path);
+		if (e)
+			return e;
+	}
+
 	s = init_stream(sctx_ name, fd, next_path);
 	idx = s->id;
 	if (idx < 0) {
@@ -1116,6 +1298,8 @@ struct expansion * tokenize(SCTX_ const char *name, int fd, struct token *endtok
 
 	e = setup_stream(sctx_ &stream, idx, fd, buffer, 0);
 	end = tokenize_stream(sctx_ &stream);
+	if (sctxp incremental && fd > 0)
+		stream_cache_save(sctx_ sctxp input_streams + idx, e->s, fd);
 	if (endtoken)
 		end->next = endtoken;
 	
@@ -1123,3 +1307,50 @@ struct expansion * tokenize(SCTX_ const char *name, int fd, struct token *endtok
 
 	return e;
 }
+
+/*
+ * For a long-running context: forget the streams from 'first' on that
+ * have no -fincremental cache, and move the ones that have one down.
+ * Those below 'kept' come from an earlier call and own their names,
+ * the others get a copy of theirs. Returns the new number of streams.
+ */
+int trim_input_streams(SCTX_ int first, int kept)
+{
+	int i, nr = first;
+
+	for (i = first; i < sctxp input_stream_nr; i++) {
+		struct stream *s = sctxp input_streams + i;
+
+		if (!s->cache) {
+			if (i < kept)
+				free((char *)s->name);
+			if (s->path && *s->path)
+				free((char *)s->path);
+			continue;
+		}
+		if (i >= kept)
+			s->name = strdup(s->name);
+		s->id = nr;
+		s->fd = -1;
+		s->constant = CONSTANT_FILE_MAYBE;
+		s->dirty = 0;
+		s->once = 0;
+		s->protect = NULL;
+		s->ifndef = NULL;
+		s->top_if = NULL;
+		s->e = NULL;
+		sctxp input_streams[nr++] = *s;
+	}
+	sctxp input_stream_nr = nr;
+
+	for (i = 0; i < HASHED_INPUT; i++)
+		sctxp input_stream_hashes[i] = -1;
+	for (i = 0; i < nr; i++) {
+		int *hash = hash_stream(sctx_ sctxp input_streams[i].name);
+		sctxp input_streams[i].next_stream = *hash;
+		*hash = i;
+	}
+	/* it pointed to the path of the last including stream */
+	sctxp includepath[0] = "";
+	return nr;
+}
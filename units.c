@@ -0,0 +1,166 @@
+/*
+ * units.c - the per unit index of ctags -u and macrodeps -o
+ *
+ * Licensed under the Open Software License version 1.1
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "lib.h"
+#include "token.h"
+#include "units.h"
+
+struct unit_section *find_unit(struct unit_index *index, const char *unit)
+{
+	int i;
+
+	for (i = 0; i < index->nr; i++)
+		if (!strcmp(index->sections[i].unit, unit))
+			return index->sections + i;
+	return NULL;
+}
+
+/* text is the index's from now on */
+void set_unit(struct unit_index *index, const char *unit, char *text)
+{
+	struct unit_section *s = find_unit(index, unit);
+
+	if (s) {
+		free(s->text);
+		s->text = text;
+		return;
+	}
+	index->sections = realloc(index->sections, (index->nr + 1) * sizeof(*s));
+	s = index->sections + index->nr++;
+	s->unit = strdup(unit);
+	s->text = text;
+}
+
+static int strp_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+/* what isn't one of units any more goes away */
+void keep_units(SCTX_ struct unit_index *index, struct string_list *units)
+{
+	char **names = malloc((ptr_list_size(sctx_ (struct ptr_list *)units) + 1) * sizeof(char *));
+	int i, nr = 0, nr_names = 0;
+	char *unit;
+
+	FOR_EACH_PTR_NOTAG(units, unit) {
+		names[nr_names++] = unit;
+	} END_FOR_EACH_PTR_NOTAG(unit);
+	qsort(names, nr_names, sizeof(char *), strp_cmp);
+
+	for (i = 0; i < index->nr; i++) {
+		struct unit_section *s = index->sections + i;
+
+		if (!bsearch(&s->unit, names, nr_names, sizeof(char *), strp_cmp)) {
+			free(s->unit);
+			free(s->text);
+			continue;
+		}
+		index->sections[nr++] = *s;
+	}
+	index->nr = nr;
+	free(names);
+}
+
+int read_unit_index(struct unit_index *index, const char *name)
+{
+	FILE *f = fopen(name, "r");
+	char *line = NULL, *text = NULL, *unit = NULL;
+	size_t alloc = 0, len = 0;
+	ssize_t n;
+
+	if (!f)
+		return -1;
+	while ((n = getline(&line, &alloc, f)) > 0) {
+		if (!strncmp(line, "unit ", 5)) {
+			free(unit);
+			free(text);
+			unit = strndup(line + 5, n - 6);
+			text = NULL;
+			len = 0;
+		}
+		if (!unit)
+			continue;
+		text = realloc(text, len + n + 1);
+		memcpy(text + len, line, n + 1);
+		len += n;
+		if (!strcmp(line, "end\n")) {
+			set_unit(index, unit, text);
+			free(unit);
+			unit = NULL;
+			text = NULL;
+		}
+	}
+	free(unit);
+	free(text);
+	free(line);
+	fclose(f);
+	return 0;
+}
+
+int write_unit_index(struct unit_index *index, const char *name)
+{
+	FILE *f = fopen(name, "w");
+	int i;
+
+	if (!f)
+		return -1;
+	for (i = 0; i < index->nr; i++)
+		fputs(index->sections[i].text, f);
+	return fclose(f) ? -1 : 0;
+}
+
+/* a section is current when all the files it read are as they were */
+int unit_is_current(const char *text)
+{
+	const char *line;
+
+	for (line = text; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : NULL) {
+		long long mtime;
+		long size;
+		int at = 0;
+		char name[4096];
+		struct stat st;
+
+		if (strncmp(line, "input ", 6))
+			continue;
+		if (sscanf(line, "input %lld %ld %n", &mtime, &size, &at) < 2 || !at)
+			return 0;
+		snprintf(name, sizeof(name), "%.*s", (int)(strchr(line, '\n') - line - at), line + at);
+		if (stat(name, &st) || stat_mtime_ns(&st) != mtime || st.st_size != size)
+			return 0;
+	}
+	return 1;
+}
+
+static int same_input(SCTX_ int stream, int first)
+{
+	int i;
+
+	for (i = first; i < stream; i++)
+		if (!strcmp(stream_name(sctx_ i), stream_name(sctx_ stream)))
+			return 1;
+	return 0;
+}
+
+/* the head of the section of unit, which read the streams from first on */
+void show_unit_inputs(SCTX_ FILE *f, const char *unit, int first)
+{
+	int i;
+
+	fprintf(f, "unit %s\n", unit);
+	for (i = first; i < sctxp input_stream_nr; i++) {
+		const char *name = stream_name(sctx_ i);
+		struct stat st;
+
+		if (*name == '<' || same_input(sctx_ i, first) || stat(name, &st))
+			continue;
+		fprintf(f, "input %lld %ld %s\n", stat_mtime_ns(&st), (long)st.st_size, name);
+	}
+}
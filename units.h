@@ -0,0 +1,34 @@
+#ifndef UNITS_H
+#define UNITS_H
+/*
+ * The index of an incremental tool: one section per translation unit,
+ * with the files it read, kept as it is while none of them changed.
+ *
+ *	unit <file>
+ *	input <mtime> <size> <file>	one per file read, mtime in ns
+ *	...				what the tool keeps for the unit
+ *	end
+ */
+
+#include <stdio.h>
+#include "lib.h"
+
+struct unit_section {
+	char *unit;
+	char *text;		/* all of it, "unit" to "end" */
+};
+
+struct unit_index {
+	struct unit_section *sections;
+	int nr;
+};
+
+extern int read_unit_index(struct unit_index *index, const char *name);
+extern int write_unit_index(struct unit_index *index, const char *name);
+extern struct unit_section *find_unit(struct unit_index *index, const char *unit);
+extern void set_unit(struct unit_index *index, const char *unit, char *text);
+extern void keep_units(SCTX_ struct unit_index *index, struct string_list *units);
+extern int unit_is_current(const char *text);
+extern void show_unit_inputs(SCTX_ FILE *f, const char *unit, int first);
+
+#endif
@@ -0,0 +1,43 @@
+#define TWICE(x) ((x) + (x))
+static int g = TWICE(2);
+static int f(int n)
+{
+	if (n > g)
+		return TWICE(n);
+	return f(n + 1);
+}
+/*
+ * check-name: astdump round trip
+ * check-command: astdump -o $file.dump -r $file.dump $file
+ *
+ * check-output-start
+macro TWICE 2:16
+macro TWICE 6:24
+node g 2:12 basetype
+  binop '+'
+    value 2
+    value 2
+node f 3:12 fn
+  compound 3:12
+    if 5:9
+      compare '>'
+        preop '*'
+          symbol n
+        preop '*'
+          symbol g
+      return 6:17
+        binop '+'
+          preop '*'
+            symbol n
+          preop '*'
+            symbol n
+    return 7:9
+      call '('
+        preop '*'
+          symbol f
+        binop '+'
+          preop '*'
+            symbol n
+          value 1
+ * check-output-end
+ */
@@ -0,0 +1,12 @@
+struct s {
+	int a;
+	char b;
+};
+/*
+ * check-name: c2xml JSON lines
+ * check-command: c2xml --json $file
+ *
+ * check-output-start
+{"type":"struct","id":"_0","ident":"s","file":"c2xml-json.c","start-line":1,"start-col":8,"end-line":4,"end-col":2,"bit-size":64,"alignment":4,"offset":0,"symbols":[{"type":"node","id":"_1","ident":"a","file":"c2xml-json.c","start-line":2,"start-col":13,"end-line":2,"end-col":14,"bit-size":32,"alignment":4,"offset":0,"base-type-builtin":"int"},{"type":"node","id":"_2","ident":"b","file":"c2xml-json.c","start-line":3,"start-col":14,"end-line":3,"end-col":15,"bit-size":8,"alignment":1,"offset":4,"base-type-builtin":"char"}]}
+ * check-output-end
+ */
@@ -0,0 +1,2 @@
+#include "ctags-common.h"
+static point_t b_point = ORIGIN;
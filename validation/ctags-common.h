@@ -0,0 +1,2 @@
+typedef struct { int x, y; } point_t;
+#define ORIGIN { 0, 0 }
@@ -0,0 +1,126 @@
+#include "ctags-common.h"
+static int a_fn(point_t *p) { return p->x; }
+/*
+ * check-name: ctags merges the tags of its units
+ * check-command: ctags -j 2 -r ctags-stale.units -f - $file ctags-b.h
+ *
+ * Both units read ctags-common.h, its tags are there once, with the
+ * typedef and not the anonymous struct it names. The section of
+ * ctags.c in ctags-stale.units is out of date and is redone, the one
+ * of ctags-gone.c is dropped since that file isn't given.
+ *
+ * check-output-start
+!_TAG_FILE_FORMAT	2	/extended format; --format=1 will not append ;" to lines/
+!_TAG_FILE_SORTED	1	/0=unsorted, 1=sorted, 2=foldcase/
+!_TAG_PROGRAM_AUTHOR	Christopher Li	/sparse@chrisli.org/
+!_TAG_PROGRAM_NAME	Sparse Ctags	//
+!_TAG_PROGRAM_URL	http://www.kernel.org/pub/software/devel/sparse/	/official site/
+!_TAG_PROGRAM_VERSION	0.01	//
+ORIGIN	ctags-common.h	2;"	d	file:
+__BASE_FILE__	<builtin>	1;"	d	file:
+__CHECKER__	<builtin>	1;"	d	file:
+__GNUC_MINOR__	<builtin>	1;"	d	file:
+__GNUC_PATCHLEVEL__	<builtin>	1;"	d	file:
+__GNUC__	<builtin>	1;"	d	file:
+__INT_MAX__	<builtin>	1;"	d	file:
+__LONG_LONG_MAX__	<builtin>	1;"	d	file:
+__LONG_MAX__	<builtin>	1;"	d	file:
+__SCHAR_MAX__	<builtin>	1;"	d	file:
+__SHRT_MAX__	<builtin>	1;"	d	file:
+__SIZEOF_POINTER__	<builtin>	1;"	d	file:
+__SIZE_TYPE__	<builtin>	1;"	d	file:
+__STDC__	<builtin>	1;"	d	file:
+__STRICT_ANSI__	<builtin>	1;"	d	file:
+__WCHAR_MAX__	<builtin>	1;"	d	file:
+__builtin___memcpy_chk	<builtin>	1;"	f	file:
+__builtin___memmove_chk	<builtin>	1;"	f	file:
+__builtin___mempcpy_chk	<builtin>	1;"	f	file:
+__builtin___memset_chk	<builtin>	1;"	f	file:
+__builtin___snprintf_chk	<builtin>	1;"	f	file:
+__builtin___sprintf_chk	<builtin>	1;"	f	file:
+__builtin___stpcpy_chk	<builtin>	1;"	f	file:
+__builtin___strcat_chk	<builtin>	1;"	f	file:
+__builtin___strcpy_chk	<builtin>	1;"	f	file:
+__builtin___strncat_chk	<builtin>	1;"	f	file:
+__builtin___strncpy_chk	<builtin>	1;"	f	file:
+__builtin___vsnprintf_chk	<builtin>	1;"	f	file:
+__builtin___vsprintf_chk	<builtin>	1;"	f	file:
+__builtin_alloca	<builtin>	1;"	f	file:
+__builtin_alpha_cmpbge	<builtin>	1;"	f	file:
+__builtin_alpha_extbl	<builtin>	1;"	f	file:
+__builtin_alpha_extwl	<builtin>	1;"	f	file:
+__builtin_alpha_insbl	<builtin>	1;"	f	file:
+__builtin_alpha_inslh	<builtin>	1;"	f	file:
+__builtin_alpha_insql	<builtin>	1;"	f	file:
+__builtin_alpha_inswl	<builtin>	1;"	f	file:
+__builtin_bswap16	<builtin>	1;"	f	file:
+__builtin_bswap32	<builtin>	1;"	f	file:
+__builtin_bswap64	<builtin>	1;"	f	file:
+__builtin_choose_expr	<builtin>	0;"	f	file:
+__builtin_clz	<builtin>	1;"	f	file:
+__builtin_clzl	<builtin>	1;"	f	file:
+__builtin_clzll	<builtin>	1;"	f	file:
+__builtin_constant_p	<builtin>	0;"	f	file:
+__builtin_ctz	<builtin>	1;"	f	file:
+__builtin_ctzl	<builtin>	1;"	f	file:
+__builtin_ctzll	<builtin>	1;"	f	file:
+__builtin_expect	<builtin>	0;"	f	file:
+__builtin_extract_return_addr	<builtin>	1;"	f	file:
+__builtin_fabs	<builtin>	1;"	f	file:
+__builtin_ffs	<builtin>	1;"	f	file:
+__builtin_ffsl	<builtin>	1;"	f	file:
+__builtin_ffsll	<builtin>	1;"	f	file:
+__builtin_frame_address	<builtin>	1;"	f	file:
+__builtin_isgreater	<builtin>	1;"	f	file:
+__builtin_isgreaterequal	<builtin>	1;"	f	file:
+__builtin_isless	<builtin>	1;"	f	file:
+__builtin_islessequal	<builtin>	1;"	f	file:
+__builtin_islessgreater	<builtin>	1;"	f	file:
+__builtin_isunordered	<builtin>	1;"	f	file:
+__builtin_labs	<builtin>	1;"	f	file:
+__builtin_memcmp	<builtin>	1;"	f	file:
+__builtin_memcpy	<builtin>	1;"	f	file:
+__builtin_mempcpy	<builtin>	1;"	f	file:
+__builtin_memset	<builtin>	1;"	f	file:
+__builtin_ms_va_end	<builtin>	1;"	d	file:
+__builtin_ms_va_start	<builtin>	1;"	d	file:
+__builtin_object_size	<builtin>	1;"	f	file:
+__builtin_popcount	<builtin>	1;"	f	file:
+__builtin_popcountl	<builtin>	1;"	f	file:
+__builtin_popcountll	<builtin>	1;"	f	file:
+__builtin_prefetch	<builtin>	1;"	f	file:
+__builtin_return_address	<builtin>	1;"	f	file:
+__builtin_safe_p	<builtin>	0;"	f	file:
+__builtin_stdarg_start	<builtin>	1;"	d	file:
+__builtin_stpcpy	<builtin>	1;"	f	file:
+__builtin_strcat	<builtin>	1;"	f	file:
+__builtin_strchr	<builtin>	1;"	f	file:
+__builtin_strcmp	<builtin>	1;"	f	file:
+__builtin_strcpy	<builtin>	1;"	f	file:
+__builtin_strcspn	<builtin>	1;"	f	file:
+__builtin_strlen	<builtin>	1;"	f	file:
+__builtin_strncat	<builtin>	1;"	f	file:
+__builtin_strncpy	<builtin>	1;"	f	file:
+__builtin_strpbrk	<builtin>	1;"	f	file:
+__builtin_strspn	<builtin>	1;"	f	file:
+__builtin_trap	<builtin>	1;"	f	file:
+__builtin_unreachable	<builtin>	1;"	f	file:
+__builtin_va_alist	<builtin>	1;"	d	file:
+__builtin_va_arg	<builtin>	1;"	d	file:
+__builtin_va_arg_incr	<builtin>	1;"	d	file:
+__builtin_va_copy	<builtin>	1;"	d	file:
+__builtin_va_end	<builtin>	1;"	d	file:
+__builtin_va_start	<builtin>	1;"	d	file:
+__builtin_warning	<builtin>	0;"	f	file:
+__extension__	<builtin>	1;"	d	file:
+__pragma__	<builtin>	1;"	d	file:
+__sync_bool_compare_and_swap	<builtin>	1;"	f	file:
+__sync_synchronize	<builtin>	1;"	f	file:
+__x86_64__	<builtin>	1;"	d	file:
+a_fn	ctags.c	2;"	f	file:
+b_point	ctags-b.h	2;"	v	file:
+point_t	ctags-common.h	1;"	t	file:
+x	ctags-common.h	1;"	m	file:
+y	ctags-common.h	1;"	m	file:
+ * check-output-end
+ */
@@ -0,0 +1,12 @@
+extern int helper(int x);
+extern int other(int x);
+
+int helper(int x)
+{
+	return x * 2;
+}
+
+int other(int x)
+{
+	return helper(x);
+}
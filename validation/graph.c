@@ -0,0 +1,28 @@
+extern int other(int x);
+extern int missing(int x);
+extern int caller(int x);
+
+static int helper(int x)
+{
+	return x + 1;
+}
+
+int caller(int x)
+{
+	return helper(x) + other(x) + helper(x) + missing(x);
+}
+/*
+ * check-name: graph links calls across units
+ * check-command: graph -j 2 -o - $file graph-other.h
+ *
+ * helper() is static here and global in graph-other.h: each unit's
+ * calls go to its own, missing() is defined nowhere.
+ *
+ * check-output-start
+caller,caller_file,caller_line,callee,callee_file,callee_line,calls
+caller,graph.c,10,helper,graph.c,5,2
+caller,graph.c,10,other,graph-other.h,9,1
+caller,graph.c,10,missing,,0,1
+other,graph-other.h,9,helper,graph-other.h,4,1
+ * check-output-end
+ */
@@ -0,0 +1,69 @@
+struct s {
+	int a:3;
+	int b:5;
+};
+
+struct s g;
+int x, y;
+
+/*
+ * Neither the block, the statement expression nor the bitfield
+ * read use anything of h(), so both inlined copies share them
+ * with the body of h().  The first expansion collapses the
+ * single statement blocks in place: the second copy must still
+ * see the same statements.
+ */
+static inline int h(int v)
+{
+	{
+		x = 1;
+	}
+	y = ({ g.b; });
+	return v + g.a;
+}
+
+int one(void)
+{
+	return h(1);
+}
+
+int two(void)
+{
+	return h(2);
+}
+
+/*
+ * check-name: inline shared blocks
+ * check-command: test-linearize -Wno-decl $file
+ *
+ * check-output-start
+one:
+.L0:
+	<entry-point>
+	store.32    $1 -> 0[x]
+	load.32     %r1 <- 0[g]
+	lsr.32      %r2 <- %r1, $3
+	cast.32     %r3 <- (5) %r2
+	store.32    %r3 -> 0[y]
+	cast.32     %r5 <- (3) %r1
+	add.32      %r6 <- %r5, $1
+	# call      %r6 <- h, $1
+	ret.32      %r6
+
+
+two:
+.L0:
+	<entry-point>
+	store.32    $1 -> 0[x]
+	load.32     %r9 <- 0[g]
+	lsr.32      %r10 <- %r9, $3
+	cast.32     %r11 <- (5) %r10
+	store.32    %r11 -> 0[y]
+	cast.32     %r13 <- (3) %r9
+	add.32      %r14 <- %r13, $2
+	# call      %r14 <- h, $2
+	ret.32      %r14
+
+
+ * check-output-end
+ */
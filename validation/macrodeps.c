@@ -0,0 +1,33 @@
+#define ONE 1
+#define TWO (ONE + ONE)
+#define ADD(a, b) ((a) + (b))
+#define EMPTY
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+int x = TWO;
+EMPTY int y = ADD(ONE, 3);
+int (min)(int a, int b);
+int z(void)
+{
+	return min(x, y);
+}
+/*
+ * check-name: macro dependency graph
+ * check-command: macrodeps -o $file.deps -r $file.deps $file
+ *
+ * check-output-start
+node m TWO 2 macrodeps.c
+node m ONE 1 macrodeps.c
+node m EMPTY 4 macrodeps.c
+node m ADD 3 macrodeps.c
+node m min 5 macrodeps.c
+node d x 7 macrodeps.c
+node d y 8 macrodeps.c
+node d z 10 macrodeps.c
+edge 0 5
+edge 1 0 5 6
+edge 2 6
+edge 3 6
+edge 4 7
+ * check-output-end
+ */
@@ -0,0 +1,46 @@
+struct big {
+	int m0, m1, m2, m3, m4, m5, m6, m7;
+	int m8, m9, m10, m11, m12, m13, m14, m15;
+	union {
+		long u0;
+		struct {
+			char c0, c1;
+			void *deep;
+		};
+	};
+	int last;
+};
+
+static int deep(struct big *p)
+{
+	return p->deep;
+}
+
+static int c1(struct big *p)
+{
+	return p->last + p->c1;
+}
+
+static int offset(void)
+{
+	return __builtin_offsetof(struct big, deep);
+}
+
+static struct big init = { .m15 = 1, .last = 3, .deep = 0, };
+
+static int missing(struct big *p)
+{
+	return p->nope;
+}
+
+/*
+ * check-name: member lookup in big structs
+ *
+ * check-error-start
+member-index.c:16:17: warning: incorrect type in return expression (different base types)
+member-index.c:16:17:    expected int
+member-index.c:16:17:    got void *deep
+member-index.c:29:50: error: unknown field name in initializer
+member-index.c:33:17: error: no member 'nope' in struct big
+ * check-error-end
+ */
@@ -0,0 +1,28 @@
+static inline int pick(int x)
+{
+	return (x << 40) + (!x & 2);
+}
+
+static void lock(void) __attribute__((context(0,1)));
+
+static int a(int x) { lock(); return pick(x); }
+static int b(int x) { return pick(x + 1); }
+static int c(int x) { return pick(x + 2); }
+static int d(int x) { lock(); return x; }
+
+int use(int x) { return a(x) + b(x) + c(x) + d(x); }
+
+/*
+ * check-name: -j gives the diagnostics of a serial run
+ * check-command: sparse -j 3 $file
+ *
+ * check-error-start
+parallel-check.c:3:32: warning: dubious: !x & y
+parallel-check.c:3:32: warning: dubious: !x & y
+parallel-check.c:3:32: warning: dubious: !x & y
+parallel-check.c:13:5: warning: symbol 'use' was not declared. Should it be static?
+parallel-check.c:3:19: warning: shift too big (40) for type int
+parallel-check.c:8:12: warning: context imbalance in 'a' - wrong count at exit
+parallel-check.c:11:12: warning: context imbalance in 'd' - wrong count at exit
+ * check-error-end
+ */
@@ -0,0 +1,43 @@
+static inline int pick(int x)
+{
+	switch (x) {
+	case 1: return 2;
+	case 1: return 3;
+	}
+	return (x << 40) + (!x & 2);
+}
+
+static void lock(void) __attribute__((context(0,1)));
+
+static int a(int x) { return pick(x); }
+static int b(int x) { return pick(x + 1); }
+static int c(int x) { return pick(x + 2); }
+
+static int d(int x)
+{
+	switch (x) {
+	case 4: return 0;
+	case 4: return 1;
+	}
+	return 2;
+}
+
+static int e(int x) { lock(); return x; }
+
+int use(int x) { return a(x) + b(x) + c(x) + d(x) + e(x); }
+
+/*
+ * check-name: -j applies the limits in the order of a serial run
+ * check-command: sparse -j 3 $file
+ *
+ * check-error-start
+parallel-limits.c:7:32: warning: dubious: !x & y
+parallel-limits.c:7:32: warning: dubious: !x & y
+parallel-limits.c:7:32: warning: dubious: !x & y
+parallel-limits.c:27:5: warning: symbol 'use' was not declared. Should it be static?
+parallel-limits.c:5:14: error: duplicate case value
+parallel-limits.c:4:14: previously used here
+parallel-limits.c:20:14: error: duplicate case value
+parallel-limits.c:19:14: previously used here
+ * check-error-end
+ */
@@ -0,0 +1,46 @@
+#define A 3
+#define B(x) ((x) * 2)
+#if A + B(2) == 7
+ok1
+#endif
+#if -1 > 0u
+ok2
+#endif
+#if (0x80000000 >> 31) == 1 && -1 < 0
+ok3
+#endif
+#if (1 ? -1 : 0u) > 0
+ok4
+#endif
+#if 10 % 3 == 1 && 7 / -2 == -3 && -7 % 2 == -1
+ok5
+#endif
+#if 0x7fffffffffffffffL + 0 > 0 && 0xffffffffffffffffULL == -1
+ok6
+#endif
+#if defined(A) && !defined C && UNDEFINED == 0
+ok7
+#endif
+#if 1 / 0
+bad
+#endif
+/*
+ * check-name: #if arithmetic
+ * check-command: sparse -E $file
+ *
+ * check-output-start
+
+ok1
+ok2
+ok3
+ok4
+ok5
+ok6
+ok7
+ * check-output-end
+ *
+ * check-error-start
+preprocessor/if-arith.c:24:7: warning: division by zero
+preprocessor/if-arith.c:24:7: error: bad constant expression
+ * check-error-end
+ */
@@ -0,0 +1,13 @@
+#include "incremental-self.h"
+/*
+ * check-name: -fincremental and a header that includes itself
+ * check-command: sparse -E -fincremental $file $file
+ *
+ * check-output-start
+
+inner
+outer
+inner
+outer
+ * check-output-end
+ */
@@ -0,0 +1,8 @@
+#ifndef AGAIN
+#define AGAIN
+#include "incremental-self.h"
+#undef AGAIN
+outer
+#else
+inner
+#endif
@@ -0,0 +1,23 @@
+#include "incremental.h"
+#define X
+#define Y
+#include "incremental.h"
+/*
+ * check-name: -fincremental reuses cached streams
+ * check-command: sparse -E -fincremental $file $file
+ *
+ * incremental.h has no newline at its end: the lexer says so once,
+ * the three other times it is included come from the cache.
+ *
+ * check-error-start
+preprocessor/incremental.h:6:6: warning: no newline at end of file
+ * check-error-end
+ *
+ * check-output-start
+
+A
+B
+A
+B
+ * check-output-end
+ */
@@ -0,0 +1,2 @@
+#include "server.h"
+#include "no-such-header.h"
@@ -0,0 +1,31 @@
+#include "server.h"
+
+int norm(struct point *p)
+{
+	return TWICE(p->x) + TWICE(p->y);
+}
+
+int undeclared;
+/*
+ * check-name: --server answers requests one after the other
+ * check-command: test-server check $file symbols $file preprocess $file check server-fatal.h check $file
+ *
+ * The fatal error in server-fatal.h ends that request only: the last
+ * check sees server.h and norm() as the first one did.
+ *
+ * check-output-start
+server.c:8:5: warning: symbol 'undeclared' was not declared. Should it be static?
+server.c:8:5: warning: symbol 'undeclared' was not declared. Should it be static?
+server.c:3:5: function norm
+server.c:8:5: variable undeclared
+struct point { int x, y; };
+extern int norm(struct point *p);
+int norm(struct point *p)
+{
+			return ((p->x) + (p->x)) + ((p->y) + (p->y));
+}
+int undeclared;
+server-fatal.h:2:10: error: unable to open 'no-such-header.h'
+server.c:8:5: warning: symbol 'undeclared' was not declared. Should it be static?
+ * check-output-end
+ */
@@ -0,0 +1,4 @@
+#define TWICE(x) ((x) + (x))
+
+struct point { int x, y; };
+extern int norm(struct point *p);
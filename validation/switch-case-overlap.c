@@ -0,0 +1,65 @@
+static int f(int x, unsigned char c)
+{
+	switch (x) {
+	case 1: return 1;
+	case 2 ... 4: return 2;
+	case 3: return 3;
+	case 1: return 4;
+	case 10 ... 20: return 5;
+	case 15 ... 25: return 6;
+	case 9 ... 5: return 7;
+	case -1: return 8;
+	case 0xffffffff: return 9;
+	case 7: return 10;
+	default: return 0;
+	}
+	switch (c) {
+	case 1: return 1;
+	case 257: return 2;
+	}
+	return -1;
+}
+
+static int g(int x)
+{
+	switch (x) {
+	case 1: return 1;
+	case 2: return 2;
+	case 0 ... 10: return 3;
+	}
+	return 0;
+}
+
+static inline int h(int x)
+{
+	switch (x) {
+	case 1: return 1;
+	case 1: return 2;
+	}
+	return 0;
+}
+
+static int use_h(int x)
+{
+	return h(x) + h(x + 1) + h(x + 2);
+}
+
+/*
+ * check-name: duplicate and overlapping case values
+ *
+ * check-error-start
+switch-case-overlap.c:10:20: warning: empty case range
+switch-case-overlap.c:6:14: error: overlapping case ranges
+switch-case-overlap.c:5:14: previously used here
+switch-case-overlap.c:7:14: error: duplicate case value
+switch-case-overlap.c:4:14: previously used here
+switch-case-overlap.c:9:14: error: overlapping case ranges
+switch-case-overlap.c:8:14: previously used here
+switch-case-overlap.c:12:14: error: duplicate case value
+switch-case-overlap.c:11:14: previously used here
+switch-case-overlap.c:28:14: error: overlapping case ranges
+switch-case-overlap.c:26:14: previously used here
+switch-case-overlap.c:37:14: error: duplicate case value
+switch-case-overlap.c:36:14: previously used here
+ * check-error-end
+ */
@@ -0,0 +1,195 @@
+static inline int dense(int x)
+{
+	switch (x) {
+	case 1: return 10;
+	case 2: return 20;
+	case 3: return 30;
+	case 4: return 40;
+	case 5: return 50;
+	case 6: return 60;
+	}
+	return 0;
+}
+
+static inline int sparse(int x)
+{
+	switch (x) {
+	case -1000: return 1;
+	case 7: return 2;
+	case 300: return 3;
+	case 4000: return 4;
+	case 50000: return 5;
+	}
+	return 0;
+}
+
+static inline int range(int x)
+{
+	switch (x) {
+	case 1 ... 3: return 1;
+	case 9 ... 7: return 2;
+	case 10: return 3;
+	default: return 4;
+	}
+}
+
+static inline int unsigned_switch(unsigned int x)
+{
+	switch (x) {
+	case 1: return 1;
+	case 0xfffffff0 ... 0xffffffff: return 2;
+	}
+	return 0;
+}
+
+static inline int wide(long long x)
+{
+	switch (x) {
+	case 1: return 1;
+	case 0x100000001LL: return 2;
+	}
+	return 0;
+}
+
+int dense_4(void) { return dense(4); }
+int dense_7(void) { return dense(7); }
+int sparse_300(void) { return sparse(300); }
+int sparse_minus_1000(void) { return sparse(-1000); }
+int sparse_8(void) { return sparse(8); }
+int range_2(void) { return range(2); }
+int range_8(void) { return range(8); }
+int unsigned_max(void) { return unsigned_switch(-1); }
+int unsigned_1(void) { return unsigned_switch(1); }
+int wide_1(void) { return wide(1); }
+int wide_big(void) { return wide(0x100000001LL); }
+int wide_constant(void) { switch (0x100000001LL) { case 1: return 10; default: return 20; } }
+int char_minus_1(void) { char c = -1; switch (c) { case -1: return 1; } return 0; }
+
+int dispatch(int x)
+{
+	return range(x);
+}
+
+/*
+ * check-name: switch lowering
+ * check-command: test-linearize -Wno-decl $file
+ *
+ * check-output-start
+dense_4:
+.L0:
+	<entry-point>
+	# call      %r1 <- dense, $4
+	ret.32      $40
+
+
+dense_7:
+.L0:
+	<entry-point>
+	# call      %r3 <- dense, $7
+	ret.32      $0
+
+
+sparse_300:
+.L0:
+	<entry-point>
+	# call      %r5 <- sparse, $300
+	ret.32      $3
+
+
+sparse_minus_1000:
+.L0:
+	<entry-point>
+	# call      %r7 <- sparse, $0xfffffc18
+	ret.32      $1
+
+
+sparse_8:
+.L0:
+	<entry-point>
+	# call      %r9 <- sparse, $8
+	ret.32      $0
+
+
+range_2:
+.L0:
+	<entry-point>
+	# call      %r11 <- range, $2
+	ret.32      $1
+
+
+range_8:
+.L0:
+	<entry-point>
+	# call      %r13 <- range, $8
+	ret.32      $4
+
+
+unsigned_max:
+.L0:
+	<entry-point>
+	# call      %r15 <- unsigned_switch, $0xffffffff
+	ret.32      $2
+
+
+unsigned_1:
+.L0:
+	<entry-point>
+	# call      %r17 <- unsigned_switch, $1
+	ret.32      $1
+
+
+wide_1:
+.L0:
+	<entry-point>
+	# call      %r19 <- wide, $1
+	ret.32      $1
+
+
+wide_big:
+.L0:
+	<entry-point>
+	# call      %r21 <- wide, $0x100000001
+	ret.32      $2
+
+
+wide_constant:
+.L0:
+	<entry-point>
+	ret.32      $20
+
+
+char_minus_1:
+.L0:
+	<entry-point>
+	ret.32      $1
+
+
+dispatch:
+.L0:
+	<entry-point>
+	switch      %arg1, 1 ... 3 -> .L3, 10 -> .L4, default -> .L6
+
+.L3:
+	phisrc.32   %phi68(return) <- $1
+	br          .L7
+
+.L4:
+	phisrc.32   %phi70(return) <- $3
+	br          .L7
+
+.L6:
+	phisrc.32   %phi71(return) <- $4
+	br          .L7
+
+.L7:
+	phi.32      %r27 <- %phi68(return), VOID, %phi70(return), %phi71(return)
+	# call      %r27 <- range, %arg1
+	ret.32      %r27
+
+
+ * check-output-end
+ *
+ * check-error-start
+switch-lowering.c:30:20: warning: empty case range
+ * check-error-end
+ */
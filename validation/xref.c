@@ -0,0 +1,29 @@
+struct point {
+	int x, y;
+};
+
+int counter;
+static struct point origin;
+
+static int *bump(struct point *p)
+{
+	counter++;
+	p->x = origin.y;
+	return &counter;
+}
+/*
+ * check-name: xref index
+ * check-command: xref -o $file.idx -r $file.idx $file
+ *
+ * check-output-start
+xref.c:8:12	def s ---	bump	xref.c
+xref.c:5:5	def g ---	counter	xref.c
+xref.c:10:9	use g -m-	counter	xref.c
+xref.c:12:17	use g m--	counter	xref.c
+xref.c:6:21	def s ---	origin	xref.c
+xref.c:11:16	use s -r-	origin	xref.c
+xref.c:1:8	def s ---	point	xref.c
+xref.c:11:10	mem s -w-	point.x	xref.c
+xref.c:11:22	mem s -r-	point.y	xref.c
+ * check-output-end
+ */
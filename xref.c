@@ -0,0 +1,527 @@
+/*
+ * xref - cross reference index of a project from the dissect reports
+ *
+ *	xref [-j N] -o index [sparse options] files...
+ *	xref -r index [-q name]
+ *
+ * Indexing files replaces what an existing index holds for them and
+ * keeps the rest, so after the first run only the files that changed
+ * need to be given again. With -j every file is checked in a process
+ * of its own, N of them at a time.
+ *
+ * Licensed under the Open Software License version 1.1
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "dissect.h"
+#include "token.h"
+#include "xref.h"
+
+/* string table, strings are numbered as they are first seen, "" is 0 */
+static struct {
+	char **str;
+	uint32_t *slot;		/* hash -> number + 1 */
+	uint32_t nr, alloc, size;
+} strtab;
+
+static struct xref_entry *entries;
+static uint32_t nr_entries, alloc_entries;
+
+static uint32_t intern(const char *s, int len)
+{
+	uint32_t h = 0, i;
+
+	if (2 * (strtab.nr + 1) > strtab.size) {
+		uint32_t n;
+
+		free(strtab.slot);
+		strtab.size = strtab.size ? strtab.size * 2 : 4096;
+		strtab.slot = calloc(strtab.size, sizeof(uint32_t));
+		for (n = 0; n < strtab.nr; n++) {
+			const char *p = strtab.str[n];
+			for (h = 0; *p; p++)
+				h = h * 31 + (unsigned char)*p;
+			for (h &= strtab.size - 1; strtab.slot[h]; h = (h + 1) & (strtab.size - 1))
+				;
+			strtab.slot[h] = n + 1;
+		}
+	}
+
+	for (i = 0, h = 0; i < len; i++)
+		h = h * 31 + (unsigned char)s[i];
+	for (h &= strtab.size - 1; strtab.slot[h]; h = (h + 1) & (strtab.size - 1)) {
+		const char *p = strtab.str[strtab.slot[h] - 1];
+		if (!strncmp(p, s, len) && !p[len])
+			return strtab.slot[h] - 1;
+	}
+
+	if (strtab.nr == strtab.alloc) {
+		strtab.alloc = strtab.alloc ? strtab.alloc * 2 : 1024;
+		strtab.str = realloc(strtab.str, strtab.alloc * sizeof(char *));
+	}
+	strtab.str[strtab.nr] = strndup(s, len);
+	strtab.slot[h] = strtab.nr + 1;
+	return strtab.nr++;
+}
+
+static uint32_t intern_ident(struct ident *ident)
+{
+	return ident ? intern(ident->name, ident->len) : intern("?", 1);
+}
+
+static struct xref_entry *new_entry(void)
+{
+	if (nr_entries == alloc_entries) {
+		alloc_entries = alloc_entries ? alloc_entries * 2 : 4096;
+		entries = realloc(entries, alloc_entries * sizeof(*entries));
+	}
+	return memset(entries + nr_entries++, 0, sizeof(*entries));
+}
+
+/******** collecting ********/
+
+static uint32_t unit;
+
+static void add(SCTX_ int kind, uint32_t name, uint32_t member,
+	struct token *pos, struct symbol *sym, unsigned mode)
+{
+	struct xref_entry *e = new_entry();
+	const char *file = stream_name(sctx_ pos->pos.stream);
+
+	e->name = name;
+	e->member = member;
+	e->file = intern(file, strlen(file));
+	e->line = pos->pos.line;
+	e->col = pos->pos.pos;
+	e->kind = kind;
+	e->storage = dissect_storage(sctx_ sym);
+	e->mode = mode;
+	e->unit = unit;
+}
+
+/* locals are of no use outside of their function, except local prototypes */
+static int is_local(SCTX_ struct symbol *sym)
+{
+	struct symbol *base = sym->ctype.base_type;
+
+	return dissect_storage(sctx_ sym) == 'l' && !(base && base->type == SYM_FN);
+}
+
+static void r_symdef(SCTX_ struct symbol *sym)
+{
+	if (!sym->ident || is_local(sctx_ sym))
+		return;
+	add(sctx_ XREF_DEF, intern_ident(sym->ident), 0, sym->pos, sym, 0);
+}
+
+static void r_symbol(SCTX_ unsigned mode, struct token *pos, struct symbol *sym)
+{
+	if (!sym->ident || is_local(sctx_ sym))
+		return;
+	add(sctx_ XREF_USE, intern_ident(sym->ident), 0, pos, sym, mode);
+}
+
+static void r_member(SCTX_ unsigned mode, struct token *pos, struct symbol *sym, struct symbol *mem)
+{
+	/* mem == NULL means entire struct accessed */
+	uint32_t member = mem ? intern_ident(mem->ident) : intern("*", 1);
+
+	add(sctx_ XREF_MEMBER, intern_ident(sym->ident), member, pos, sym, mode);
+}
+
+static struct reporter reporter = {
+	.r_symdef = r_symdef,
+	.r_symbol = r_symbol,
+	.r_member = r_member,
+};
+
+static void index_file(SCTX_ char *file)
+{
+	unit = intern(file, strlen(file));
+	sctxp dotc_stream = sctxp input_stream_nr;
+	dissect(sctx_ __sparse(sctx_ file), &reporter);
+}
+
+/******** index files ********/
+
+static int cmp_string(const void *a, const void *b)
+{
+	return strcmp(strtab.str[*(const uint32_t *)a], strtab.str[*(const uint32_t *)b]);
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const struct xref_entry *x = a, *y = b;
+
+#define CMP(f)	if (x->f != y->f) return x->f < y->f ? -1 : 1
+	CMP(name); CMP(member); CMP(file); CMP(line); CMP(col);
+	CMP(kind); CMP(mode); CMP(unit); CMP(storage);
+#undef CMP
+	return 0;
+}
+
+/*
+ * Lay the strings that are used out in sorted order, turn the entries
+ * into offsets, sort them and drop the duplicates.
+ */
+static int write_index(const char *name)
+{
+	uint32_t *order, *offset, nr = 0, size = 0, i, n;
+	struct xref_header h;
+	char *tmp;
+	FILE *f;
+	int ret;
+
+	offset = calloc(strtab.nr, sizeof(uint32_t));
+	for (i = 0; i < nr_entries; i++) {
+		struct xref_entry *e = entries + i;
+		offset[e->name] = offset[e->member] = offset[e->file] = offset[e->unit] = 1;
+	}
+	order = malloc(strtab.nr * sizeof(uint32_t));
+	for (i = 0; i < strtab.nr; i++)
+		if (offset[i] || !*strtab.str[i])
+			order[nr++] = i;
+	qsort(order, nr, sizeof(uint32_t), cmp_string);
+	for (i = 0; i < nr; i++) {
+		offset[order[i]] = size;
+		size += strlen(strtab.str[order[i]]) + 1;
+	}
+
+	for (i = 0; i < nr_entries; i++) {
+		struct xref_entry *e = entries + i;
+		e->name = offset[e->name];
+		e->member = offset[e->member];
+		e->file = offset[e->file];
+		e->unit = offset[e->unit];
+	}
+	qsort(entries, nr_entries, sizeof(*entries), cmp_entry);
+	for (i = n = 0; i < nr_entries; i++)
+		if (!n || cmp_entry(entries + n - 1, entries + i))
+			entries[n++] = entries[i];
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, XREF_MAGIC, sizeof(h.magic));
+	h.version = XREF_VERSION;
+	h.byteorder = XREF_BYTEORDER;
+	h.strings = size;
+	h.entries = n;
+	h.strings_offset = sizeof(h);
+	h.entries_offset = (sizeof(h) + size + 7) & ~7;
+
+	/* the index is replaced at once, readers never see half of it */
+	tmp = malloc(strlen(name) + 8);
+	sprintf(tmp, "%s.tmp", name);
+	f = fopen(tmp, "wb");
+	ret = !f;
+	if (f) {
+		fwrite(&h, sizeof(h), 1, f);
+		for (i = 0; i < nr; i++)
+			fwrite(strtab.str[order[i]], strlen(strtab.str[order[i]]) + 1, 1, f);
+		fwrite("\0\0\0\0\0\0\0", h.entries_offset - sizeof(h) - size, 1, f);
+		fwrite(entries, sizeof(*entries), n, f);
+		ret = ferror(f) | fclose(f);
+		ret = ret || rename(tmp, name);
+		if (ret)
+			unlink(tmp);
+	}
+	free(tmp);
+	free(order);
+	free(offset);
+	nr_entries = 0;
+	return ret;
+}
+
+static const struct xref_header *open_index(const char *name, size_t *size)
+{
+	const struct xref_header *h;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(*h)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	h = map;
+	if (memcmp(h->magic, XREF_MAGIC, sizeof(h->magic)) ||
+	    h->version != XREF_VERSION || h->byteorder != XREF_BYTEORDER ||
+	    h->strings_offset + h->strings > st.st_size ||
+	    h->entries_offset + (uint64_t)h->entries * sizeof(struct xref_entry) > st.st_size) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	*size = st.st_size;
+	return h;
+}
+
+static int strp_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+/* a list of units, sorted to be looked up */
+struct unit_set {
+	char **names;
+	int nr;
+};
+
+static void make_unit_set(SCTX_ struct unit_set *set, struct string_list *units)
+{
+	char *u;
+
+	set->names = malloc((ptr_list_size(sctx_ (struct ptr_list *)units) + 1) * sizeof(char *));
+	set->nr = 0;
+	FOR_EACH_PTR_NOTAG(units, u) {
+		set->names[set->nr++] = u;
+	} END_FOR_EACH_PTR_NOTAG(u);
+	qsort(set->names, set->nr, sizeof(char *), strp_cmp);
+}
+
+static int in_unit_set(const struct unit_set *set, const char *file)
+{
+	return bsearch(&file, set->names, set->nr, sizeof(char *), strp_cmp) != NULL;
+}
+
+/* take over the entries of an index, but those of the units in skip */
+static int load_index(const char *name, const struct unit_set *skip)
+{
+	const struct xref_header *h;
+	const struct xref_entry *e;
+	const char *strings;
+	uint32_t i, unit = 0;
+	int skipped = 0;
+	size_t size;
+
+#define STR(s)	intern(strings + (s), strlen(strings + (s)))
+	h = open_index(name, &size);
+	if (!h)
+		return -1;
+	strings = xref_strings(h);
+	e = xref_entries(h);
+	for (i = 0; i < h->entries; i++, e++) {
+		struct xref_entry *n;
+
+		/* the entries of a unit mostly come together */
+		if (skip && (!i || e->unit != unit)) {
+			unit = e->unit;
+			skipped = in_unit_set(skip, strings + unit);
+		}
+		if (skip && skipped)
+			continue;
+		n = new_entry();
+		*n = *e;
+		n->name = STR(e->name);
+		n->member = STR(e->member);
+		n->file = STR(e->file);
+		n->unit = STR(e->unit);
+	}
+#undef STR
+	munmap((void *)h, size);
+	return 0;
+}
+
+/******** parallel indexing ********/
+
+static char *part_name(const char *out, int pid)
+{
+	char *name = malloc(strlen(out) + 32);
+
+	sprintf(name, "%s.%d", out, pid);
+	return name;
+}
+
+static int reap(SCTX_ const char *out, struct string_list **failed, char **files, int *pids, int nr)
+{
+	int status, pid, i;
+	char *name;
+
+	/* one of ours, not some child the library left behind */
+	do {
+		pid = wait(&status);
+		if (pid < 0)
+			return -1;
+		for (i = 0; i < nr && pids[i] != pid; i++)
+			;
+	} while (i == nr);
+	name = part_name(out, pid);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) || load_index(name, NULL)) {
+		fprintf(stderr, "xref: %s was not indexed\n", files[i]);
+		add_ptr_list_notag(failed, files[i]);
+	}
+	unlink(name);
+	free(name);
+	pids[i] = 0;
+	return i;
+}
+
+/* one process per file, 'jobs' at a time; returns the files that failed */
+static struct string_list *index_parallel(SCTX_ const char *out, struct string_list *filelist, int jobs)
+{
+	struct string_list *failed = NULL;
+	int nr = ptr_list_size(sctx_ (struct ptr_list *)filelist), running = 0, i = 0;
+	int *pids = calloc(nr, sizeof(int));
+	char **files = calloc(nr, sizeof(char *));
+	char *file;
+
+	fflush(NULL);
+	FOR_EACH_PTR_NOTAG(filelist, file) {
+		int pid;
+
+		if (running == jobs) {
+			reap(sctx_ out, &failed, files, pids, nr);
+			running--;
+		}
+		files[i] = file;
+		pid = fork();
+		if (!pid) {
+			char *name;
+
+			index_file(sctx_ file);
+			name = part_name(out, getpid());
+			_exit(write_index(name));
+		}
+		if (pid < 0) {
+			perror("fork");
+			add_ptr_list_notag(&failed, file);
+		} else {
+			pids[i] = pid;
+			running++;
+		}
+		i++;
+	} END_FOR_EACH_PTR_NOTAG(file);
+	while (running--)
+		reap(sctx_ out, &failed, files, pids, nr);
+
+	free(pids);
+	free(files);
+	return failed;
+}
+
+/******** showing ********/
+
+static const char *show_mode(unsigned mode)
+{
+	static char str[4];
+
+#define	U(u_r)	"-rwm"[(mode / u_r) & 3]
+	str[0] = U(U_R_AOF);
+	str[1] = U(U_R_VAL);
+	str[2] = U(U_R_PTR);
+#undef	U
+
+	return str;
+}
+
+static void show_entry(const char *strings, const struct xref_entry *e)
+{
+	static const char *kinds[] = { "def", "use", "mem" };
+
+	printf("%s:%u:%u\t%s %c %s\t%s%s%s\t%s\n",
+		strings + e->file, e->line, e->col,
+		kinds[e->kind], e->storage, e->kind == XREF_DEF ? "---" : show_mode(e->mode),
+		strings + e->name, e->member ? "." : "", strings + e->member,
+		strings + e->unit);
+}
+
+static int show_index(const char *name, const char *query)
+{
+	const struct xref_header *h = NULL;
+	const struct xref_entry *e;
+	uint32_t nr, i;
+	size_t size;
+	char *member;
+
+	h = open_index(name, &size);
+	if (!h) {
+		fprintf(stderr, "%s: not a readable index\n", name);
+		return 1;
+	}
+	e = xref_entries(h);
+	nr = h->entries;
+	member = query ? strchr(query, '.') : NULL;
+	if (member) {
+		*member++ = 0;
+	}
+	if (query)
+		e = xref_lookup(h, query, &nr);
+	for (i = 0; i < nr; i++) {
+		if (member && strcmp(xref_strings(h) + e[i].member, member))
+			continue;
+		show_entry(xref_strings(h), e + i);
+	}
+	munmap((void *)h, size);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct string_list *filelist = NULL, *failed = NULL, *redone;
+	struct unit_set set;
+	const char *out = NULL, *in = NULL;
+	char *file, *query = NULL;
+	int i, j, jobs = 1, ret = 0;
+	SPARSE_CTX_INIT;
+
+	for (i = j = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			out = argv[++i];
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			in = argv[++i];
+		else if (!strcmp(argv[i], "-q") && i + 1 < argc)
+			query = argv[++i];
+		else if (!strncmp(argv[i], "-j", 2) && (argv[i][2] || i + 1 < argc))
+			jobs = parse_jobs(sctx_ argv[i][2] ? argv[i] + 2 : argv[++i]);
+		else
+			argv[j++] = argv[i];
+	}
+	argv[j] = NULL;
+	argc = j;
+	intern("", 0);
+
+	if (out) {
+		sparse_initialize(sctx_ argc, argv, &filelist);
+		if (jobs > 1) {
+			failed = index_parallel(sctx_ out, filelist, jobs);
+		} else {
+			FOR_EACH_PTR_NOTAG(filelist, file) {
+				index_file(sctx_ file);
+			} END_FOR_EACH_PTR_NOTAG(file);
+		}
+
+		/* what is known about files that failed stays as it was */
+		redone = NULL;
+		make_unit_set(sctx_ &set, failed);
+		FOR_EACH_PTR_NOTAG(filelist, file) {
+			if (!in_unit_set(&set, file))
+				add_ptr_list_notag(&redone, file);
+		} END_FOR_EACH_PTR_NOTAG(file);
+		free(set.names);
+		make_unit_set(sctx_ &set, redone);
+		load_index(out, &set);
+		free(set.names);
+
+		if (write_index(out)) {
+			fprintf(stderr, "%s: can't write the index\n", out);
+			return 1;
+		}
+		ret = failed != NULL;
+	}
+	if (in)
+		ret |= show_index(in, query);
+	return ret;
+}
@@ -0,0 +1,82 @@
+#ifndef XREF_H
+#define XREF_H
+/*
+ * Cross reference index as written by xref from the dissect reports:
+ * a header, a string table and one fixed size record per definition,
+ * symbol use and member access. The records are sorted by name,
+ * member, file, line and column, so all references of a name are
+ * adjacent and can be bisected in the mmap()ed file, see xref_lookup().
+ *
+ * Strings are byte offsets into the string table, which is itself
+ * sorted: comparing two offsets compares the strings. 0 is "".
+ * Everything is in native byte order.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define XREF_MAGIC	"SPARSEx"
+#define XREF_VERSION	1
+#define XREF_BYTEORDER	0x01020304
+
+enum xref_kind {
+	XREF_DEF,
+	XREF_USE,
+	XREF_MEMBER,
+};
+
+struct xref_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t strings;	/* bytes */
+	uint32_t entries;	/* records */
+	uint64_t strings_offset, entries_offset;
+};
+
+struct xref_entry {
+	uint32_t name;		/* the symbol, or the struct of a member access */
+	uint32_t member;	/* the member, "*" for the whole struct */
+	uint32_t file;
+	uint32_t line;
+	uint16_t col;
+	uint8_t kind;
+	uint8_t storage;	/* 'g'lobal or 's'tatic, see dissect_storage() */
+	uint32_t mode;		/* U_R_VAL ..., 0 for definitions */
+	uint32_t unit;		/* the file that was checked */
+};
+
+static inline const char *xref_strings(const struct xref_header *h)
+{
+	return (const char *)h + h->strings_offset;
+}
+
+static inline const struct xref_entry *xref_entries(const struct xref_header *h)
+{
+	return (const struct xref_entry *)((const char *)h + h->entries_offset);
+}
+
+/* the references to 'name', *nr of them */
+static inline const struct xref_entry *xref_lookup(const struct xref_header *h,
+	const char *name, uint32_t *nr)
+{
+	const struct xref_entry *e = xref_entries(h);
+	const char *strings = xref_strings(h);
+	uint32_t lo = 0, hi = h->entries, end;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (strcmp(strings + e[mid].name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (end = lo; end < h->entries && e[end].name == e[lo].name; end++)
+		;
+	if (lo == end || strcmp(strings + e[lo].name, name))
+		end = lo;
+	*nr = end - lo;
+	return e + lo;
+}
+
+#endif